@@ -10,28 +10,251 @@
  */
 
 #include "audio.h"
+#include "mixer.h"
+#include "audiocapture.h"
+#include "vgmlog.h"
 #include "hbc56emu.h"
 #include "devices/device.h"
 
 #include "SDL.h"
 
+#include <stdarg.h>
+
 static SDL_AudioDeviceID audioDevice = 0;
 static SDL_AudioSpec audioSpec;
 
+/* sample ring buffer. emulation renders into it as emulated time advances
+   (producer) and the audio callback drains it (consumer) */
+#define AUDIO_RING_FRAMES    0x4000           /* must be a power of 2 */
+#define AUDIO_RING_MASK      (AUDIO_RING_FRAMES - 1)
+#define AUDIO_MAX_CHANNELS   HBC56_AUDIO_CHANNELS
+#define AUDIO_RENDER_FRAMES  HBC56_MIXER_MAX_FRAMES   /* frames rendered per pass. covers any single emulation step */
+
+/* rate control. the number of samples rendered per emulated second is nudged
+   (by up to AUDIO_RATE_MAX_ADJUST) to hold the ring near its target fill */
+#define AUDIO_RATE_MAX_ADJUST 0.005
+#define AUDIO_FILL_SMOOTHING  0.01
+
+static float ringBuffer[AUDIO_RING_FRAMES * AUDIO_MAX_CHANNELS];
+static SDL_atomic_t ringHead;                 /* frames written */
+static SDL_atomic_t ringTail;                 /* frames read */
+static float lastFrame[AUDIO_MAX_CHANNELS];   /* repeated on underrun */
+
+static double pendingFrames = 0.0;            /* fractional frames carried between ticks */
+static uint64_t audioCycle = 0;               /* cpu cycle the audio has been generated up to */
+static uint64_t renderStartCycle = 0;         /* cycles covered by the block being rendered */
+static uint64_t renderEndCycle = 0;
+static double rateRatio = 1.0;
+static double smoothedFill = 0.0;
+static int targetFill = 0;
+
+#define AUDIO_DEFAULT_BUFFER_SAMPLES 1024
+#define AUDIO_MIN_BUFFER_SAMPLES     64
+#define AUDIO_MAX_BUFFER_SAMPLES     8192
+
+static int bufferSamples = AUDIO_DEFAULT_BUFFER_SAMPLES;
+
+/* metrics */
+static HBC56AudioMetrics metrics;
+static double perfToMicros = 0.0;
+static Uint64 lastCallback = 0;
+
+/* latency probe. the first register write in a tick marks the ring frame
+   its tick starts at. the callback measures when it outputs that frame */
+static Uint64 pendingWriteTime = 0;
+static Uint64 latencyWriteTime = 0;
+static SDL_atomic_t latencyMark;              /* ring frame or -1 */
+
+/* Function:  histogramAdd
+ * --------------------
+ * add a value to a histogram
+ */
+static void histogramAdd(HBC56AudioHistogram* hist, uint32_t value)
+{
+  int bucket = 0;
+  while (bucket < HBC56_AUDIO_HIST_BUCKETS - 1 && value >> bucket) ++bucket;
+
+  ++hist->buckets[bucket];
+  if (!hist->count || value < hist->min) hist->min = value;
+  if (value > hist->max) hist->max = value;
+  hist->sum += value;
+  ++hist->count;
+}
+
+/* Function:  perfMicros
+ * --------------------
+ * performance counter ticks to microseconds
+ */
+static uint32_t perfMicros(Uint64 ticks)
+{
+  return (uint32_t)(ticks * perfToMicros);
+}
+
+/* Function:  ringFill
+ * --------------------
+ * frames waiting in the ring
+ */
+static int ringFill()
+{
+  return (SDL_AtomicGet(&ringHead) - SDL_AtomicGet(&ringTail)) & AUDIO_RING_MASK;
+}
+
 void hbc56AudioCallback(
   void* userdata,
   Uint8* stream,
   int    len)
 {
-  int samples = len / (sizeof(float) * audioSpec.channels);
+  Uint64 start = SDL_GetPerformanceCounter();
+
+  int channels = audioSpec.channels;
+  int frames = len / (sizeof(float) * channels);
   float* str = (float*)stream;
 
-  SDL_memset(stream, 0, len);
+  int tail = SDL_AtomicGet(&ringTail);
+  int available = (SDL_AtomicGet(&ringHead) - tail) & AUDIO_RING_MASK;
+  int count = frames < available ? frames : available;
+
+  /* a marked frame in this buffer? it is heard after the buffer ahead of it */
+  int mark = SDL_AtomicGet(&latencyMark);
+  if (mark >= 0 && ((mark - tail) & AUDIO_RING_MASK) < count)
+  {
+    int offset = (mark - tail) & AUDIO_RING_MASK;
+    double micros = (start - latencyWriteTime) * perfToMicros +
+                    (offset + audioSpec.samples) * 1000000.0 / audioSpec.freq;
+    histogramAdd(&metrics.latency, (uint32_t)micros);
+    SDL_AtomicSet(&latencyMark, -1);
+  }
+
+  for (int i = 0; i < count; ++i)
+  {
+    SDL_memcpy(str, &ringBuffer[tail * AUDIO_MAX_CHANNELS], channels * sizeof(float));
+    str += channels;
+    tail = (tail + 1) & AUDIO_RING_MASK;
+  }
+  SDL_AtomicSet(&ringTail, tail);
+
+  if (count)
+  {
+    SDL_memcpy(lastFrame, str - channels, channels * sizeof(float));
+  }
 
+  /* emulation fell behind. hold the last sample rather than click to zero */
+  if (count < frames)
+  {
+    ++metrics.underruns;
+    for (int i = count; i < frames; ++i)
+    {
+      SDL_memcpy(str, lastFrame, channels * sizeof(float));
+      str += channels;
+    }
+  }
+
+  if (lastCallback) histogramAdd(&metrics.callbackInterval, perfMicros(start - lastCallback));
+  lastCallback = start;
+  ++metrics.callbacks;
+  metrics.framesRequested += frames;
+  metrics.framesDelivered += count;
+  histogramAdd(&metrics.ringFill, available);
+  histogramAdd(&metrics.callbackDuration, perfMicros(SDL_GetPerformanceCounter() - start));
+}
+
+/* Function:  hbc56AudioTick
+ * --------------------
+ * render the audio for the cpu cycles executed since the last tick into
+ * the ring and/or the capture file
+ */
+void hbc56AudioTick()
+{
+  Uint64 writeTime = pendingWriteTime;
+  pendingWriteTime = 0;
+
+  /* the step's cycle span. it moves on even when nothing is rendered so the
+     next block never covers more than its own step */
+  uint64_t stepStart = audioCycle;
+  uint64_t stepEnd = hbc56CpuCycles();
+  uint64_t stepCycles = stepEnd > stepStart ? stepEnd - stepStart : 0;
+  audioCycle = stepEnd;
+
+  int capturing = hbc56AudioCaptureActive();
+  if (!audioDevice && !capturing) return;
+
+  int channels = hbc56AudioChannels();
+  int toRing = audioDevice != 0;
+
+  /* steer towards the target fill level. a capture alone, or one recording
+     golden psg checks, runs at exactly the nominal rate so its output doesn't
+     depend on the host */
+  int fill = audioDevice ? ringFill() : 0;
+  rateRatio = 1.0;
+  if (audioDevice && !hbc56AudioCaptureRecording())
+  {
+    smoothedFill += (fill - smoothedFill) * AUDIO_FILL_SMOOTHING;
+    double error = (targetFill - smoothedFill) / (double)targetFill;
+    if (error > 1.0) error = 1.0;
+    else if (error < -1.0) error = -1.0;
+    rateRatio = 1.0 + error * AUDIO_RATE_MAX_ADJUST;
+  }
+  metrics.rateRatio = rateRatio;
+
+  pendingFrames += stepCycles * (double)hbc56AudioFreq() / HBC56_CLOCK_FREQ * rateRatio;
+  int frames = (int)pendingFrames;
+  int totalFrames = frames;
+  pendingFrames -= frames;
+
+  /* no room? (running faster than real time). skip rendering altogether
+     unless it's being captured */
+  if (toRing && frames > AUDIO_RING_MASK - fill)
+  {
+    ++metrics.overruns;
+    if (!capturing) return;
+    toRing = 0;
+  }
+
+  static float mixBuffer[AUDIO_RENDER_FRAMES * AUDIO_MAX_CHANNELS];
   int deviceCount = hbc56NumDevices();
-  for (size_t i = 0; i < deviceCount; ++i)
+  int head = SDL_AtomicGet(&ringHead);
+  int firstFrame = head;
+
+  metrics.framesRendered += frames;
+
+  while (frames > 0)
+  {
+    int renderFrames = frames < AUDIO_RENDER_FRAMES ? frames : AUDIO_RENDER_FRAMES;
+
+    /* the part of the step this pass covers */
+    int done = totalFrames - frames;
+    renderStartCycle = stepStart + stepCycles * done / totalFrames;
+    renderEndCycle = stepStart + stepCycles * (done + renderFrames) / totalFrames;
+
+    SDL_memset(mixBuffer, 0, renderFrames * channels * sizeof(float));
+    for (int i = 0; i < deviceCount; ++i)
+    {
+      renderAudioDevice(hbc56Device(i), mixBuffer, renderFrames);
+    }
+    hbc56MixerMix(mixBuffer, channels, renderFrames);
+
+    if (capturing) hbc56AudioCaptureWrite(mixBuffer, renderFrames);
+
+    if (toRing)
+    {
+      for (int i = 0; i < renderFrames; ++i)
+      {
+        SDL_memcpy(&ringBuffer[head * AUDIO_MAX_CHANNELS], &mixBuffer[i * channels], channels * sizeof(float));
+        head = (head + 1) & AUDIO_RING_MASK;
+      }
+    }
+    frames -= renderFrames;
+  }
+
+  if (toRing)
   {
-    renderAudioDevice(hbc56Device(i), str, samples);
+    SDL_AtomicSet(&ringHead, head);
+
+    if (writeTime && head != firstFrame && SDL_AtomicGet(&latencyMark) < 0)
+    {
+      latencyWriteTime = writeTime;
+      SDL_AtomicSet(&latencyMark, firstFrame);
+    }
   }
 }
 
@@ -45,12 +268,35 @@ void hbc56Audio(int start)
     SDL_memset(&audioSpec, 0, sizeof(audioSpec));
     want.freq = HBC56_AUDIO_FREQ;
     want.format = AUDIO_F32SYS;
-    want.channels = 2;
-    want.samples = 1024;
+    want.channels = AUDIO_MAX_CHANNELS;
+    want.samples = (Uint16)bufferSamples;
     want.callback = hbc56AudioCallback;
-    if (SDL_OpenAudio(&want, &audioSpec) == 0) audioDevice = 1;
 
-    SDL_PauseAudioDevice(audioDevice, 0);
+    SDL_AtomicSet(&ringHead, 0);
+    SDL_AtomicSet(&ringTail, 0);
+    SDL_memset(lastFrame, 0, sizeof(lastFrame));
+    pendingFrames = 0.0;
+    rateRatio = 1.0;
+    SDL_AtomicSet(&latencyMark, -1);
+    perfToMicros = 1000000.0 / SDL_GetPerformanceFrequency();
+    hbc56AudioResetMetrics();
+
+    /* only the rate may differ. sdl converts any other channel count or
+       format, so the ring's stride of AUDIO_MAX_CHANNELS always holds */
+    audioDevice = SDL_OpenAudioDevice(NULL, 0, &want, &audioSpec, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
+    if (audioDevice && (audioSpec.channels < 1 || audioSpec.channels > AUDIO_MAX_CHANNELS))
+    {
+      SDL_CloseAudioDevice(audioDevice);
+      audioDevice = 0;
+      SDL_SetError("unsupported channel count: %d", audioSpec.channels);
+    }
+
+    /* aim to keep one and a half callbacks worth of audio queued */
+    targetFill = audioSpec.samples + audioSpec.samples / 2;
+    if (targetFill <= 0) targetFill = 1;
+    smoothedFill = targetFill;
+
+    if (audioDevice) SDL_PauseAudioDevice(audioDevice, 0);
 
     if (audioDevice == 0)
     {
@@ -71,10 +317,169 @@ void hbc56Audio(int start)
 
 int hbc56AudioChannels()
 {
-  return audioSpec.channels;
+  return audioDevice ? audioSpec.channels : HBC56_AUDIO_CHANNELS;
 }
 
 int hbc56AudioFreq()
 {
-  return audioSpec.freq;
+  return audioDevice ? audioSpec.freq : HBC56_AUDIO_FREQ;
+}
+
+/* Function:  hbc56AudioRenderCycles
+ * --------------------
+ * the span of cpu cycles the audio being rendered covers
+ */
+void hbc56AudioRenderCycles(uint64_t* startCycle, uint64_t* endCycle)
+{
+  *startCycle = renderStartCycle;
+  *endCycle = renderEndCycle;
+}
+
+/* Function:  hbc56AudioSetBufferSamples
+ * --------------------
+ * set the audio device buffer size (frames per callback). reopens the
+ * device if it is running
+ */
+void hbc56AudioSetBufferSamples(int samples)
+{
+  /* a power of two, as some backends require */
+  int size = AUDIO_MIN_BUFFER_SAMPLES;
+  while (size < samples && size < AUDIO_MAX_BUFFER_SAMPLES) size <<= 1;
+
+  if (size == bufferSamples) return;
+  bufferSamples = size;
+
+  if (audioDevice)
+  {
+    hbc56Audio(0);
+    hbc56Audio(1);
+  }
+}
+
+/* Function:  hbc56AudioBufferSamples
+ * --------------------
+ * the audio device buffer size (frames per callback)
+ */
+int hbc56AudioBufferSamples()
+{
+  return audioDevice ? audioSpec.samples : bufferSamples;
+}
+
+/* Function:  hbc56AudioNoteWrite
+ * --------------------
+ * a psg register has been written. used to measure output latency and
+ * for the register logs
+ */
+void hbc56AudioNoteWrite(int chip, uint8_t reg, uint8_t value)
+{
+  if (!pendingWriteTime && audioDevice) pendingWriteTime = SDL_GetPerformanceCounter();
+
+  hbc56AudioCaptureRegWrite(chip, reg, value);
+  hbc56VgmLogWrite(chip, reg, value);
+}
+
+/* Function:  hbc56AudioGetMetrics
+ * --------------------
+ * the audio pipeline metrics
+ */
+const HBC56AudioMetrics* hbc56AudioGetMetrics()
+{
+  return &metrics;
+}
+
+/* Function:  hbc56AudioResetMetrics
+ * --------------------
+ * clear the audio pipeline metrics
+ */
+void hbc56AudioResetMetrics()
+{
+  if (audioDevice) SDL_LockAudioDevice(audioDevice);
+  SDL_memset(&metrics, 0, sizeof(metrics));
+  metrics.rateRatio = rateRatio;
+  lastCallback = 0;
+  if (audioDevice) SDL_UnlockAudioDevice(audioDevice);
+}
+
+/* Function:  writeLine
+ * --------------------
+ * write a formatted line to the metrics csv
+ */
+static void writeLine(SDL_RWops* file, const char* fmt, ...)
+{
+  char line[512];
+  va_list args;
+  va_start(args, fmt);
+  SDL_vsnprintf(line, sizeof(line), fmt, args);
+  va_end(args);
+  SDL_RWwrite(file, line, 1, SDL_strlen(line));
+}
+
+/* Function:  writeHistogram
+ * --------------------
+ * write a histogram row to the metrics csv
+ */
+static void writeHistogram(SDL_RWops* file, const char* name, const HBC56AudioHistogram* hist)
+{
+  writeLine(file, "%s,%u,%u,%.1f,%u", name, hist->count, hist->min,
+            hist->count ? (double)hist->sum / hist->count : 0.0, hist->max);
+  for (int i = 0; i < HBC56_AUDIO_HIST_BUCKETS; ++i)
+  {
+    writeLine(file, ",%u", hist->buckets[i]);
+  }
+  writeLine(file, "\n");
+}
+
+/* Function:  hbc56AudioLogMetrics
+ * --------------------
+ * log a summary of the audio pipeline metrics and, if filename is given,
+ * write them (with the histogram buckets) to a csv file
+ */
+void hbc56AudioLogMetrics(const char* filename)
+{
+  HBC56AudioMetrics m = metrics;
+
+  SDL_Log("Audio: %d Hz, %d frame buffer. %u callbacks, %u underruns, %u overruns. frames requested: %llu, delivered: %llu, rendered: %llu\n",
+          hbc56AudioFreq(), hbc56AudioBufferSamples(), m.callbacks, m.underruns, m.overruns,
+          (unsigned long long)m.framesRequested, (unsigned long long)m.framesDelivered, (unsigned long long)m.framesRendered);
+
+  if (m.callbacks)
+  {
+    SDL_Log("Audio: callback interval %u/%u/%u us, duration %u/%u/%u us, ring fill %u/%u/%u frames, latency %u/%u/%u us (min/avg/max)\n",
+            m.callbackInterval.min, m.callbackInterval.count ? (uint32_t)(m.callbackInterval.sum / m.callbackInterval.count) : 0, m.callbackInterval.max,
+            m.callbackDuration.min, (uint32_t)(m.callbackDuration.sum / m.callbackDuration.count), m.callbackDuration.max,
+            m.ringFill.min, (uint32_t)(m.ringFill.sum / m.ringFill.count), m.ringFill.max,
+            m.latency.min, m.latency.count ? (uint32_t)(m.latency.sum / m.latency.count) : 0, m.latency.max);
+  }
+
+  if (!filename) return;
+
+  SDL_RWops* file = SDL_RWFromFile(filename, "wb");
+  if (!file)
+  {
+    SDL_Log("Audio metrics: unable to create '%s'\n", filename);
+    return;
+  }
+
+  writeLine(file, "metric,count,min,mean,max");
+  for (int i = 0; i < HBC56_AUDIO_HIST_BUCKETS; ++i)
+  {
+    writeLine(file, ",lt%u", 1u << i);
+  }
+  writeLine(file, "\n");
+
+  writeHistogram(file, "callback_interval_us", &m.callbackInterval);
+  writeHistogram(file, "callback_duration_us", &m.callbackDuration);
+  writeHistogram(file, "ring_fill_frames", &m.ringFill);
+  writeHistogram(file, "latency_us", &m.latency);
+
+  writeLine(file, "callbacks,%u\n", m.callbacks);
+  writeLine(file, "underruns,%u\n", m.underruns);
+  writeLine(file, "overruns,%u\n", m.overruns);
+  writeLine(file, "frames_requested,%llu\n", (unsigned long long)m.framesRequested);
+  writeLine(file, "frames_delivered,%llu\n", (unsigned long long)m.framesDelivered);
+  writeLine(file, "frames_rendered,%llu\n", (unsigned long long)m.framesRendered);
+  writeLine(file, "buffer_samples,%d\n", hbc56AudioBufferSamples());
+  writeLine(file, "sample_rate,%d\n", hbc56AudioFreq());
+
+  SDL_RWclose(file);
 }
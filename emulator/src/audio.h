@@ -12,16 +12,105 @@
 #ifndef _HBC56_AUDIO_H_
 #define _HBC56_AUDIO_H_
 
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#define HBC56_AUDIO_HIST_BUCKETS 16
+
+/* a histogram with power of two buckets. bucket 0 holds 0, bucket n holds
+   values from 2^(n-1) to 2^n - 1 and the last bucket everything above */
+typedef struct
+{
+  uint32_t count;
+  uint32_t min;
+  uint32_t max;
+  uint64_t sum;
+  uint32_t buckets[HBC56_AUDIO_HIST_BUCKETS];
+} HBC56AudioHistogram;
+
+/* audio pipeline metrics. the callback side is written by the audio thread
+   and read unlocked (a torn read only affects the display) */
+typedef struct
+{
+  /* audio callback */
+  uint32_t            callbacks;
+  HBC56AudioHistogram callbackInterval;   /* microseconds between callbacks */
+  HBC56AudioHistogram callbackDuration;   /* microseconds spent in the callback */
+  HBC56AudioHistogram ringFill;           /* frames queued when the callback starts */
+  HBC56AudioHistogram latency;            /* microseconds from a psg register write to its output (estimated) */
+  uint64_t            framesRequested;
+  uint64_t            framesDelivered;    /* requested frames served from the ring */
+  uint32_t            underruns;          /* callbacks the ring couldn't fill */
+
+  /* emulation */
+  uint64_t            framesRendered;
+  uint32_t            overruns;           /* ticks dropped because the ring was full */
+  double              rateRatio;          /* current rate control adjustment */
+} HBC56AudioMetrics;
+
 void hbc56Audio(int start);
 
+/* Function:  hbc56AudioTick
+ * --------------------
+ * render the audio for the cpu cycles executed since the last tick. called
+ * by the emulation loop after the devices have been ticked
+ */
+void hbc56AudioTick();
+
+/* Function:  hbc56AudioRenderCycles
+ * --------------------
+ * the span of cpu cycles the audio being rendered covers. for audio
+ * devices to place their register writes
+ */
+void hbc56AudioRenderCycles(uint64_t* startCycle, uint64_t* endCycle);
+
 int hbc56AudioChannels();
 
 int hbc56AudioFreq();
 
+/* Function:  hbc56AudioSetBufferSamples
+ * --------------------
+ * set the audio device buffer size (frames per callback). reopens the
+ * device if it is running
+ */
+void hbc56AudioSetBufferSamples(int samples);
+
+/* Function:  hbc56AudioBufferSamples
+ * --------------------
+ * the audio device buffer size (frames per callback). the requested size
+ * if no device is open
+ */
+int hbc56AudioBufferSamples();
+
+/* Function:  hbc56AudioNoteWrite
+ * --------------------
+ * a psg register has been written. used to measure output latency and
+ * for the register logs
+ */
+void hbc56AudioNoteWrite(int chip, uint8_t reg, uint8_t value);
+
+/* Function:  hbc56AudioGetMetrics
+ * --------------------
+ * the audio pipeline metrics
+ */
+const HBC56AudioMetrics* hbc56AudioGetMetrics();
+
+/* Function:  hbc56AudioResetMetrics
+ * --------------------
+ * clear the audio pipeline metrics
+ */
+void hbc56AudioResetMetrics();
+
+/* Function:  hbc56AudioLogMetrics
+ * --------------------
+ * log a summary of the audio pipeline metrics and, if filename is given,
+ * write them (with the histogram buckets) to a csv file
+ */
+void hbc56AudioLogMetrics(const char* filename);
+
 #ifdef __cplusplus
 }
 #endif
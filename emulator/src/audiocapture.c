@@ -0,0 +1,435 @@
+/*
+ * Troy's HBC-56 Emulator - Audio capture
+ *
+ * Copyright (c) 2021 Troy Schrapel
+ *
+ * This code is licensed under the MIT license
+ *
+ * https://github.com/visrealm/hbc-56/emulator
+ *
+ */
+
+#include "audiocapture.h"
+#include "mixer.h"
+#include "hbc56emu.h"
+
+#include "SDL.h"
+
+#define CAPTURE_MAX_FILES       (1 + 8)       /* mix and stems */
+#define CAPTURE_BUFFER_FLOATS   0x8000        /* buffered before each write */
+#define CAPTURE_MAX_FILENAME    1024
+#define CAPTURE_MAX_CHANNELS    2
+#define WAV_HEADER_SIZE         44
+
+typedef struct
+{
+  SDL_RWops*  file;
+  int         wav;
+  int         group;                          /* mixer group. -1 for the mix */
+  uint32_t    dataBytes;
+  int         bufferCount;
+  float       buffer[CAPTURE_BUFFER_FLOATS];
+} CaptureFile;
+
+static CaptureFile* files[CAPTURE_MAX_FILES];
+static int fileCount = 0;
+static int captureRate = 0;
+static int captureChannels = 0;
+
+static float stemBuffer[HBC56_MIXER_MAX_FRAMES * CAPTURE_MAX_CHANNELS];
+
+/* a recorded psg register write */
+typedef struct
+{
+  uint64_t cycle;
+  uint8_t  chip;
+  uint8_t  reg;
+  uint8_t  value;
+} CaptureRegWrite;
+
+/* in-memory recording */
+static int recording = 0;
+static uint64_t recordHash = 0;
+static int16_t* recordPcm = NULL;
+static size_t recordSamples = 0;
+static size_t recordCapacity = 0;
+static CaptureRegWrite* recordWrites = NULL;
+static size_t recordWriteCount = 0;
+static size_t recordWriteCapacity = 0;
+
+/* Function:  writeWavHeader
+ * --------------------
+ * write (or rewrite) the WAV header for the data written so far
+ */
+static void writeWavHeader(CaptureFile* capture)
+{
+  SDL_RWops* f = capture->file;
+  SDL_RWseek(f, 0, RW_SEEK_SET);
+
+  SDL_RWwrite(f, "RIFF", 1, 4);
+  SDL_WriteLE32(f, WAV_HEADER_SIZE - 8 + capture->dataBytes);
+  SDL_RWwrite(f, "WAVE", 1, 4);
+
+  SDL_RWwrite(f, "fmt ", 1, 4);
+  SDL_WriteLE32(f, 16);
+  SDL_WriteLE16(f, 3);                        /* WAVE_FORMAT_IEEE_FLOAT */
+  SDL_WriteLE16(f, (Uint16)captureChannels);
+  SDL_WriteLE32(f, captureRate);
+  SDL_WriteLE32(f, captureRate * captureChannels * sizeof(float));
+  SDL_WriteLE16(f, (Uint16)(captureChannels * sizeof(float)));
+  SDL_WriteLE16(f, 32);
+
+  SDL_RWwrite(f, "data", 1, 4);
+  SDL_WriteLE32(f, capture->dataBytes);
+
+  SDL_RWseek(f, 0, RW_SEEK_END);
+}
+
+/* Function:  flushCapture
+ * --------------------
+ * write out the buffered samples
+ */
+static void flushCapture(CaptureFile* capture)
+{
+  if (!capture->bufferCount) return;
+
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+  for (int i = 0; i < capture->bufferCount; ++i)
+  {
+    capture->buffer[i] = SDL_SwapFloatLE(capture->buffer[i]);
+  }
+#endif
+
+  size_t bytes = capture->bufferCount * sizeof(float);
+  if (SDL_RWwrite(capture->file, capture->buffer, 1, bytes) != bytes)
+  {
+    SDL_Log("Audio capture write failed: %s", SDL_GetError());
+  }
+  capture->dataBytes += (uint32_t)bytes;
+  capture->bufferCount = 0;
+}
+
+/* Function:  appendCapture
+ * --------------------
+ * buffer interleaved frames
+ */
+static void appendCapture(CaptureFile* capture, const float* frames, int numFrames)
+{
+  int count = numFrames * captureChannels;
+  while (count > 0)
+  {
+    int room = CAPTURE_BUFFER_FLOATS - capture->bufferCount;
+    int n = count < room ? count : room;
+    SDL_memcpy(&capture->buffer[capture->bufferCount], frames, n * sizeof(float));
+    capture->bufferCount += n;
+    frames += n;
+    count -= n;
+
+    if (capture->bufferCount == CAPTURE_BUFFER_FLOATS) flushCapture(capture);
+  }
+}
+
+/* Function:  openCaptureFile
+ * --------------------
+ * open a capture file
+ */
+static int openCaptureFile(const char* filename, int group)
+{
+  if (fileCount >= CAPTURE_MAX_FILES) return 0;
+
+  SDL_RWops* file = SDL_RWFromFile(filename, "wb");
+  if (!file)
+  {
+    SDL_Log("Unable to open audio capture file %s: %s", filename, SDL_GetError());
+    return 0;
+  }
+
+  CaptureFile* capture = (CaptureFile*)SDL_calloc(1, sizeof(CaptureFile));
+  if (!capture)
+  {
+    SDL_RWclose(file);
+    return 0;
+  }
+  capture->file = file;
+  capture->group = group;
+
+  size_t len = SDL_strlen(filename);
+  capture->wav = len > 4 && SDL_strcasecmp(filename + len - 4, ".wav") == 0;
+  if (capture->wav) writeWavHeader(capture);
+
+  files[fileCount++] = capture;
+
+  SDL_Log("Capturing audio to %s", filename);
+  return 1;
+}
+
+/* Function:  closeFiles
+ * --------------------
+ * flush and close the capture files
+ */
+static void closeFiles()
+{
+  for (int i = 0; i < fileCount; ++i)
+  {
+    CaptureFile* capture = files[i];
+    flushCapture(capture);
+    if (capture->wav) writeWavHeader(capture);
+    SDL_RWclose(capture->file);
+    SDL_free(capture);
+    files[i] = NULL;
+  }
+  fileCount = 0;
+}
+
+/* Function:  hbc56AudioCaptureOpen
+ * --------------------
+ * capture the mixed audio stream to a file
+ */
+int hbc56AudioCaptureOpen(const char* filename, int stems, int sampleRate, int channels)
+{
+  closeFiles();
+
+  captureRate = sampleRate;
+  captureChannels = channels < 1 ? 1 : (channels > CAPTURE_MAX_CHANNELS ? CAPTURE_MAX_CHANNELS : channels);
+
+  if (!openCaptureFile(filename, -1)) return 0;
+
+  if (stems)
+  {
+    /* stems are named after the mix. the extension (and format) is kept */
+    char base[CAPTURE_MAX_FILENAME];
+    SDL_strlcpy(base, filename, sizeof(base));
+    const char* ext = "";
+    char* dot = SDL_strrchr(base, '.');
+    char* slash = SDL_strrchr(base, '/');
+    char* backslash = SDL_strrchr(base, '\\');
+    if (dot && dot > slash && dot > backslash)
+    {
+      ext = filename + (dot - base);
+      *dot = '\0';
+    }
+
+    /* one stem per distinct group, in channel order */
+    int channelCount = hbc56MixerChannelCount();
+    for (int c = 0; c < channelCount; ++c)
+    {
+      int group = hbc56MixerChannel(c)->group;
+      int seen = 0;
+      for (int p = 0; p < c; ++p)
+      {
+        seen |= hbc56MixerChannel(p)->group == group;
+      }
+      if (seen) continue;
+
+      char stemName[CAPTURE_MAX_FILENAME];
+      SDL_snprintf(stemName, sizeof(stemName), "%s.stem%d%s", base, group, ext);
+      openCaptureFile(stemName, group);
+    }
+  }
+
+  return 1;
+}
+
+/* Function:  hbc56AudioCaptureRecord
+ * --------------------
+ * keep the mixed audio and the psg register writes in memory
+ */
+void hbc56AudioCaptureRecord(int sampleRate, int channels)
+{
+  captureRate = sampleRate;
+  captureChannels = channels < 1 ? 1 : (channels > CAPTURE_MAX_CHANNELS ? CAPTURE_MAX_CHANNELS : channels);
+
+  recording = 1;
+  recordHash = 0xcbf29ce484222325ULL;
+  recordSamples = 0;
+  recordWriteCount = 0;
+}
+
+/* Function:  recordAudio
+ * --------------------
+ * quantize interleaved samples to 16 bits, hash and keep them. the hash is
+ * over the 16-bit samples one at a time so it doesn't depend on how the
+ * audio was divided up or on the last bits of the float math
+ */
+static void recordAudio(const float* mix, int numFrames)
+{
+  size_t count = (size_t)numFrames * captureChannels;
+  if (recordSamples + count > recordCapacity)
+  {
+    size_t capacity = recordCapacity ? recordCapacity * 2 : 0x100000;
+    while (capacity < recordSamples + count) capacity *= 2;
+    int16_t* pcm = (int16_t*)SDL_realloc(recordPcm, capacity * sizeof(int16_t));
+    if (!pcm) return;
+    recordPcm = pcm;
+    recordCapacity = capacity;
+  }
+
+  const uint64_t prime = 0x100000001b3ULL;
+  uint64_t hash = recordHash;
+  int16_t* out = recordPcm + recordSamples;
+  for (size_t i = 0; i < count; ++i)
+  {
+    float value = mix[i] * 32767.0f;
+    value = value > 32767.0f ? 32767.0f : (value < -32768.0f ? -32768.0f : value);
+    int16_t sample = (int16_t)(value < 0.0f ? value - 0.5f : value + 0.5f);
+    out[i] = sample;
+    hash = (hash ^ (uint16_t)sample) * prime;
+  }
+  recordHash = hash;
+  recordSamples += count;
+}
+
+/* Function:  hbc56AudioCaptureRecording
+ * --------------------
+ * is the audio being recorded (in memory)?
+ */
+int hbc56AudioCaptureRecording()
+{
+  return recording;
+}
+
+/* Function:  hbc56AudioCaptureHash
+ * --------------------
+ * hash of the recorded audio so far
+ */
+uint64_t hbc56AudioCaptureHash()
+{
+  return recordHash;
+}
+
+/* Function:  hbc56AudioCaptureRegWrite
+ * --------------------
+ * a psg register has been written (emulation side)
+ */
+void hbc56AudioCaptureRegWrite(int chip, uint8_t reg, uint8_t value)
+{
+  if (!recording) return;
+
+  if (recordWriteCount == recordWriteCapacity)
+  {
+    size_t capacity = recordWriteCapacity ? recordWriteCapacity * 2 : 0x10000;
+    CaptureRegWrite* writes = (CaptureRegWrite*)SDL_realloc(recordWrites, capacity * sizeof(CaptureRegWrite));
+    if (!writes) return;
+    recordWrites = writes;
+    recordWriteCapacity = capacity;
+  }
+
+  CaptureRegWrite* write = &recordWrites[recordWriteCount++];
+  write->cycle = hbc56CpuCycles();
+  write->chip = (uint8_t)chip;
+  write->reg = reg;
+  write->value = value;
+}
+
+/* Function:  hbc56AudioCaptureSaveWav
+ * --------------------
+ * write the recorded audio to a 16-bit WAV file
+ */
+int hbc56AudioCaptureSaveWav(const char* filename)
+{
+  SDL_RWops* f = SDL_RWFromFile(filename, "wb");
+  if (!f) return 0;
+
+  uint32_t dataBytes = (uint32_t)(recordSamples * sizeof(int16_t));
+
+  SDL_RWwrite(f, "RIFF", 1, 4);
+  SDL_WriteLE32(f, WAV_HEADER_SIZE - 8 + dataBytes);
+  SDL_RWwrite(f, "WAVE", 1, 4);
+
+  SDL_RWwrite(f, "fmt ", 1, 4);
+  SDL_WriteLE32(f, 16);
+  SDL_WriteLE16(f, 1);                        /* WAVE_FORMAT_PCM */
+  SDL_WriteLE16(f, (Uint16)captureChannels);
+  SDL_WriteLE32(f, captureRate);
+  SDL_WriteLE32(f, captureRate * captureChannels * sizeof(int16_t));
+  SDL_WriteLE16(f, (Uint16)(captureChannels * sizeof(int16_t)));
+  SDL_WriteLE16(f, 16);
+
+  SDL_RWwrite(f, "data", 1, 4);
+  SDL_WriteLE32(f, dataBytes);
+
+  for (size_t i = 0; i < recordSamples; ++i)
+  {
+    SDL_WriteLE16(f, (Uint16)recordPcm[i]);
+  }
+
+  SDL_RWclose(f);
+  return 1;
+}
+
+/* Function:  hbc56AudioCaptureSaveLog
+ * --------------------
+ * write the recorded register writes to a text file
+ */
+int hbc56AudioCaptureSaveLog(const char* filename)
+{
+  SDL_RWops* f = SDL_RWFromFile(filename, "wb");
+  if (!f) return 0;
+
+  char line[64];
+  SDL_snprintf(line, sizeof(line), "# cycle chip reg value\n");
+  SDL_RWwrite(f, line, 1, SDL_strlen(line));
+
+  for (size_t i = 0; i < recordWriteCount; ++i)
+  {
+    const CaptureRegWrite* write = &recordWrites[i];
+    SDL_snprintf(line, sizeof(line), "%llu %u %02x %02x\n", (unsigned long long)write->cycle,
+                 write->chip, write->reg, write->value);
+    SDL_RWwrite(f, line, 1, SDL_strlen(line));
+  }
+
+  SDL_RWclose(f);
+  return 1;
+}
+
+/* Function:  hbc56AudioCaptureActive
+ * --------------------
+ * is a capture open?
+ */
+int hbc56AudioCaptureActive()
+{
+  return fileCount > 0 || recording;
+}
+
+/* Function:  hbc56AudioCaptureWrite
+ * --------------------
+ * write numFrames of the interleaved mix
+ */
+void hbc56AudioCaptureWrite(const float* mix, int numFrames)
+{
+  if (numFrames > HBC56_MIXER_MAX_FRAMES) numFrames = HBC56_MIXER_MAX_FRAMES;
+
+  if (recording) recordAudio(mix, numFrames);
+
+  for (int i = 0; i < fileCount; ++i)
+  {
+    CaptureFile* capture = files[i];
+    if (capture->group < 0)
+    {
+      appendCapture(capture, mix, numFrames);
+    }
+    else
+    {
+      SDL_memset(stemBuffer, 0, numFrames * captureChannels * sizeof(float));
+      hbc56MixerMixGroup(stemBuffer, captureChannels, numFrames, capture->group);
+      appendCapture(capture, stemBuffer, numFrames);
+    }
+  }
+}
+
+/* Function:  hbc56AudioCaptureClose
+ * --------------------
+ * flush and close the capture files and end any recording
+ */
+void hbc56AudioCaptureClose()
+{
+  closeFiles();
+
+  recording = 0;
+  SDL_free(recordPcm);
+  recordPcm = NULL;
+  recordSamples = recordCapacity = 0;
+  SDL_free(recordWrites);
+  recordWrites = NULL;
+  recordWriteCount = recordWriteCapacity = 0;
+}
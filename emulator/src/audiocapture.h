@@ -0,0 +1,90 @@
+/*
+ * Troy's HBC-56 Emulator - Audio capture
+ *
+ * Copyright (c) 2021 Troy Schrapel
+ *
+ * This code is licensed under the MIT license
+ *
+ * https://github.com/visrealm/hbc-56/emulator
+ *
+ */
+
+#ifndef _HBC56_AUDIOCAPTURE_H_
+#define _HBC56_AUDIOCAPTURE_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Function:  hbc56AudioCaptureOpen
+ * --------------------
+ * capture the mixed audio stream to a file. files ending in .wav are written
+ * as 32-bit float WAV, anything else as raw interleaved 32-bit floats.
+ * with stems, each mixer group (e.g. each PSG) is also written to
+ * <name>.stem<group><ext>. returns 1 if ok
+ */
+int hbc56AudioCaptureOpen(const char* filename, int stems, int sampleRate, int channels);
+
+/* Function:  hbc56AudioCaptureRecord
+ * --------------------
+ * keep the mixed audio (as 16-bit pcm) and the psg register writes in
+ * memory and hash the audio as it is generated. used by the golden checks
+ */
+void hbc56AudioCaptureRecord(int sampleRate, int channels);
+
+/* Function:  hbc56AudioCaptureRecording
+ * --------------------
+ * is the audio being recorded (in memory)?
+ */
+int hbc56AudioCaptureRecording();
+
+/* Function:  hbc56AudioCaptureHash
+ * --------------------
+ * hash of the recorded audio so far
+ */
+uint64_t hbc56AudioCaptureHash();
+
+/* Function:  hbc56AudioCaptureSaveWav
+ * --------------------
+ * write the recorded audio to a 16-bit WAV file. returns 1 if ok
+ */
+int hbc56AudioCaptureSaveWav(const char* filename);
+
+/* Function:  hbc56AudioCaptureSaveLog
+ * --------------------
+ * write the recorded register writes to a text file. returns 1 if ok
+ */
+int hbc56AudioCaptureSaveLog(const char* filename);
+
+/* Function:  hbc56AudioCaptureRegWrite
+ * --------------------
+ * a psg register has been written (emulation side)
+ */
+void hbc56AudioCaptureRegWrite(int chip, uint8_t reg, uint8_t value);
+
+/* Function:  hbc56AudioCaptureActive
+ * --------------------
+ * is a capture open?
+ */
+int hbc56AudioCaptureActive();
+
+/* Function:  hbc56AudioCaptureWrite
+ * --------------------
+ * write numFrames of the interleaved mix. called straight after the mixer
+ * so the stems can be mixed from the same channel buffers
+ */
+void hbc56AudioCaptureWrite(const float* mix, int numFrames);
+
+/* Function:  hbc56AudioCaptureClose
+ * --------------------
+ * flush and close the capture files and end any recording
+ */
+void hbc56AudioCaptureClose();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -14,12 +14,15 @@
 
 #include "debugger.h"
 #include "../devices/tms9918_device.h"
+#include "../mixer.h"
+#include "../audio.h"
 #include "vrEmuTms9918Util.h"
 #include "vrEmu6502.h"
 #include "imgui.h"
 
 #include <stdlib.h>
 #include <ctype.h>
+#include <math.h>
 #include <string.h>
 #include <string>
 #include <bitset>
@@ -38,11 +41,12 @@ static VrEmu6502 *cpu6502 = NULL;
 
 static char *labelMap[0x10000] = {NULL};
 static HBC56Device* tms9918 = NULL;
-
-static char tmpBuffer[256] = {0};
+static SDL_Renderer* debugRenderer = NULL;
 
 static std::map<std::string, int> constants;
 
+std::set<uint16_t> breakpoints;
+
 static uint16_t highlightAddr = 0;
 static uint16_t hoveredAddr = 0;
 
@@ -50,22 +54,80 @@ static std::set<char> operators = {'!','^','-','/','%','+','<','>','=','&','|','
 
 static int isProbablyConstant(const char* str)
 {
+  char tmpBuffer[256];
   SDL_strlcpy(tmpBuffer, str, sizeof(tmpBuffer) - 1);
   SDL_strupr(tmpBuffer);
   return SDL_strcmp(str, tmpBuffer) == 0;
 }
 
-void debuggerLoadLabels(const char* labelFileContents)
+/* a breakpoint relative to the nearest code label before it. used to keep
+   breakpoints on the same code when the labels are reloaded */
+struct BreakpointAnchor
+{
+  std::string label;
+  uint16_t    addr;
+  uint16_t    offset;
+};
+
+#define BREAKPOINT_ANCHOR_MAX_OFFSET 0x400
+
+static std::vector<BreakpointAnchor> anchorBreakpoints()
+{
+  std::vector<BreakpointAnchor> anchors;
+  for (uint16_t addr : breakpoints)
+  {
+    BreakpointAnchor anchor;
+    anchor.addr = addr;
+    anchor.offset = 0;
+    for (int labelAddr = addr; labelAddr >= 0 && addr - labelAddr < BREAKPOINT_ANCHOR_MAX_OFFSET; --labelAddr)
+    {
+      if (labelMap[labelAddr] && !isProbablyConstant(labelMap[labelAddr]))
+      {
+        anchor.label = labelMap[labelAddr];
+        anchor.offset = (uint16_t)(addr - labelAddr);
+        break;
+      }
+    }
+    anchors.push_back(anchor);
+  }
+  return anchors;
+}
+
+static void remapBreakpoints(const std::vector<BreakpointAnchor>& anchors)
+{
+  breakpoints.clear();
+  for (const auto& anchor : anchors)
+  {
+    auto iter = anchor.label.empty() ? constants.end() : constants.find(anchor.label);
+    if (iter != constants.end())
+    {
+      breakpoints.insert((uint16_t)(iter->second + anchor.offset));
+    }
+    else
+    {
+      breakpoints.insert(anchor.addr);
+    }
+  }
+}
+
+static void freeLabels(char** labels)
 {
-  for (int i = 0; i < sizeof(labelMap) / sizeof(const char*); ++i)
+  for (int i = 0; i < 0x10000; ++i)
   {
-    if (labelMap[i])
+    if (labels[i])
     {
-      free(labelMap[i]);
-      labelMap[i] = NULL;
+      free(labels[i]);
+      labels[i] = NULL;
     }
   }
+}
 
+/* Function:  parseLabels
+ * --------------------
+ * parse an acme label map in to the given label map and constants
+ */
+static void parseLabels(const char* labelFileContents, char** labels, std::map<std::string, int>& constants)
+{
   if (labelFileContents)
   {
     char lineBuffer[1024];
@@ -136,16 +198,41 @@ void debuggerLoadLabels(const char* labelFileContents)
 
       constants[std::string(lineBuffer + labelStart, labelEnd - labelStart)] = addr;
 
-      if (!labelMap[addr] || (isProbablyConstant(labelMap[addr]) && !isUnused))
+      if (!labels[addr] || (isProbablyConstant(labels[addr]) && !isUnused))
       {
         char* label = (char*)malloc((labelEnd - labelStart) + 1);
         SDL_strlcpy(label, lineBuffer + labelStart, labelEnd - labelStart + 1);
-        labelMap[addr] = label;
+        free(labels[addr]);
+        labels[addr] = label;
       }
     }
   }
 }
 
+static void waitForLoad();
+
+void debuggerLoadLabels(const char* labelFileContents)
+{
+  waitForLoad();
+
+  auto anchors = anchorBreakpoints();
+
+  constants.clear();
+  freeLabels(labelMap);
+  parseLabels(labelFileContents, labelMap, constants);
+
+  remapBreakpoints(anchors);
+}
+
+int debuggerLabelAddress(const char* label)
+{
+  auto iter = constants.find(label);
+  if (iter == constants.end())
+    return -1;
+
+  return iter->second;
+}
+
 //std::map<std::string, std::vector<std::pair<std::string, uint16_t> > > source;
 //std::map<int, std::pair<std::string, int> > addrMap;
 std::set<std::string> opcodes;
@@ -428,7 +515,7 @@ class SourceFile
 
     }
 
-    void addLine(const std::string& line, uint16_t addr)
+    void addLine(const std::string& line, uint16_t addr, std::map<std::string, int>& constants, char** labels)
     {
       m_addrMap[addr] = (int)m_lines.size();
       m_lines.push_back(SourceLine(this, line, addr));
@@ -444,7 +531,10 @@ class SourceFile
             if (m_lines[i].contains(Token::LABEL) && constants.find(m_lines[i].childOfType(Token::LABEL)->value()) == constants.end())
             {
               if (!m_lines[i].contains(Token::OPERATOR))
+              {
                 constants[m_lines[i].childOfType(Token::LABEL)->value()] = addr;
+                m_constants[m_lines[i].childOfType(Token::LABEL)->value()] = addr;
+              }
             }
           }
           else
@@ -460,7 +550,7 @@ class SourceFile
               {
                 uint16_t refAddr = 0;
                 uint16_t prevTmpAddress = tmpAddress;
-                tmpAddress = vrEmu6502DisassembleInstruction(cpu6502, tmpAddress, sizeof(instructionBuffer), instructionBuffer, &refAddr, labelMap);
+                tmpAddress = vrEmu6502DisassembleInstruction(cpu6502, tmpAddress, sizeof(instructionBuffer), instructionBuffer, &refAddr, labels);
                 m_lines[i].macroLines().push_back(SourceLine(nullptr, instructionBuffer, prevTmpAddress));
               }
             }
@@ -472,6 +562,19 @@ class SourceFile
 
     const std::string &filename() const { return m_filename; }
 
+    size_t hash() const { return m_hash; }
+    void setHash(size_t hash) { m_hash = hash; }
+
+    /* re-add the labels this file defined (when reused after a reload) */
+    void applyConstants(std::map<std::string, int>& constants) const
+    {
+      for (const auto& constant : m_constants)
+      {
+        if (constants.find(constant.first) == constants.end())
+          constants[constant.first] = constant.second;
+      }
+    }
+
     int numLines() const { return (int)m_lines.size(); }
     const SourceLine& line(size_t index) const {
       return m_lines[index];
@@ -494,23 +597,34 @@ class SourceFile
 
   private:
     std::string m_filename;
+    size_t m_hash = 0;
     std::vector<SourceLine> m_lines;
     std::map<uint16_t, int> m_addrMap;
+    std::map<std::string, int> m_constants;
 };
 
 
 class Source
 {
 public:
+  typedef std::map<std::string, std::shared_ptr<SourceFile> > FileMap;
+
   SourceFile& file(const std::string& filename)
   {
     auto iter = m_files.find(filename);
     if (iter == m_files.end())
     {
-      m_files[filename] = SourceFile(filename);
-      return m_files[filename];
+      auto file = std::make_shared<SourceFile>(filename);
+      m_files[filename] = file;
+      return *file;
     }
-    return iter->second;
+    return *iter->second;
+  }
+
+  void add(const std::shared_ptr<SourceFile>& file)
+  {
+    m_addrMap.clear();
+    m_files[file->filename()] = file;
   }
 
   const SourceFile& file(uint16_t addr)
@@ -520,9 +634,9 @@ public:
       int fileIndex = 0;
       for (auto iter = m_files.begin(); iter != m_files.end(); ++iter, ++fileIndex)
       {
-        for (int i = 0; i < iter->second.numLines(); ++i)
+        for (int i = 0; i < iter->second->numLines(); ++i)
         {
-          m_addrMap[iter->second.line(i).address()] = fileIndex;
+          m_addrMap[iter->second->line(i).address()] = fileIndex;
         }
       }
     }
@@ -538,9 +652,11 @@ public:
   const SourceFile& fileFromIndex(size_t index) const {
     auto iter = m_files.begin();
     std::advance(iter, index);
-    return iter->second;
+    return *iter->second;
   }
 
+  const FileMap& files() const { return m_files; }
+
   int numFiles() const { return (int)m_files.size(); }
   int index(const std::string& filename)
   {
@@ -561,70 +677,277 @@ public:
 
   private:
     std::map<uint16_t, size_t> m_addrMap;
-    std::map<std::string, SourceFile> m_files;
+    FileMap m_files;
 };
 
 Source source;
 bool sourceLoading = false;
 
-void debuggerLoadSource(const char* rptFileContents)
+static int currentFile = 0;
+static uint16_t lastPc = 0;
+static int lastLineNumber = 0;
+static int macroOffset = 0;
+static int macroLines = 0;
+
+static float scrollPos = -1.0f;
+
+/* Function:  parseSourceSection
+ * --------------------
+ * parse the report lines for a single source file
+ */
+static std::shared_ptr<SourceFile> parseSourceSection(const std::string& filename, const std::string& section,
+                                                      std::map<std::string, int>& constants, char** labels)
 {
-  sourceLoading = true;
-  source.clear();
+  auto file = std::make_shared<SourceFile>(filename);
 
-  for (int i = 0; i < 256; ++i)
+  size_t start = 0;
+  for (;;)
   {
-    opcodes.insert(vrEmu6502OpcodeToMnemonicStr(cpu6502, i & 0xff));
+    size_t end = section.find('\n', start);
+    if (end == std::string::npos)
+      break;
+
+    std::string line = section.substr(start, end - start);
+    start = end + 1;
+
+    int lineNumber = 0;
+    int address = 0xffff;
+    SDL_sscanf(line.c_str(), "%6d  %4x", &lineNumber, &address);
+
+    file->addLine(line.substr(32), address & 0xffff, constants, labels);
   }
+  return file;
+}
 
-  if (rptFileContents)
-  {
+/* Function:  parseSource
+ * --------------------
+ * parse an acme report file in to newSource. files whose report lines are
+ * unchanged from previousFiles are reused rather than re-parsed
+ */
+static void parseSource(const char* rptFileContents, const Source::FileMap& previousFiles, Source& newSource,
+                        std::map<std::string, int>& constants, char** labels)
+{
+  if (!rptFileContents)
+    return;
 
-    char* p = (char*)rptFileContents;
-    SourceFile *currentFile = nullptr;
+  /* split the report in to sections per source file. a file's lines can be
+     split (around !src includes) so sections are keyed by file name */
+  std::vector<std::string> sectionOrder;
+  std::map<std::string, std::string> sections;
 
-    for (;;)
-    {
-      char* end = SDL_strchr(p, '\n');
-      if (end == NULL)
-        break;
+  char* p = (char*)rptFileContents;
+  std::string* currentSection = nullptr;
 
-      if (end == p) {++p; continue;}
+  for (;;)
+  {
+    char* end = SDL_strchr(p, '\n');
+    if (end == NULL)
+      break;
+
+    if (end == p) {++p; continue;}
 
 
-      std::string line(p, end - p);
-      p += end - p;
-      if (line.size() < 2) continue;
+    std::string line(p, end - p);
+    p += end - p;
+    if (line.size() < 2) continue;
 
-      if (line[0] == ';')
+    if (line[0] == ';')
+    {
+      std::string filename = line.substr(19);
+      if (sections.find(filename) == sections.end())
       {
-        currentFile = &source.file(line.substr(19));
-        continue;
+        sectionOrder.push_back(filename);
       }
+      currentSection = &sections[filename];
+      continue;
+    }
 
-      int lineNumber = 0;
-      int address = 0xffff;
-      SDL_sscanf(line.c_str(), "%6d  %4x", &lineNumber, &address);
+    if (currentSection)
+    {
+      currentSection->append(line);
+      currentSection->push_back('\n');
+    }
+  }
+
+  int parsed = 0;
+  std::hash<std::string> hasher;
+  for (const auto& filename : sectionOrder)
+  {
+    const std::string& section = sections[filename];
+    size_t hash = hasher(section);
 
-      currentFile->addLine(line.substr(32), address & 0xffff);
+    auto previous = previousFiles.find(filename);
+    if (previous != previousFiles.end() && previous->second->hash() == hash)
+    {
+      previous->second->applyConstants(constants);
+      newSource.add(previous->second);
+      continue;
     }
+
+    auto file = parseSourceSection(filename, section, constants, labels);
+    file->setHash(hash);
+    newSource.add(file);
+    ++parsed;
+  }
+
+  if (!previousFiles.empty())
+  {
+    SDL_Log("Source: reloaded. %d of %d files changed\n", parsed, (int)sectionOrder.size());
+  }
+}
+
+/* Function:  publishSource
+ * --------------------
+ * replace the source, keeping the source view on the same file
+ */
+static void publishSource(Source& newSource)
+{
+  std::string visibleFilename;
+  if (currentFile >= 0 && currentFile < source.numFiles())
+  {
+    visibleFilename = source.fileFromIndex(currentFile).filename();
+  }
+
+  source = std::move(newSource);
+
+  if (!visibleFilename.empty())
+  {
+    currentFile = source.index(visibleFilename);
+    if (currentFile < 0) currentFile = 0;
   }
+}
+
+void debuggerLoadSource(const char* rptFileContents)
+{
+  waitForLoad();
+
+  sourceLoading = true;
+
+  Source newSource;
+  parseSource(rptFileContents, source.files(), newSource, constants, labelMap);
+  publishSource(newSource);
+
+  sourceLoading = false;
+}
+
+
+/* background loading. labels and source are parsed in to a private copy on
+   a worker thread and swapped in by debuggerUpdate() on the main thread */
+struct SymbolLoad
+{
+  char*                      labelFileContents = nullptr;
+  char*                      rptFileContents = nullptr;
+  char*                      labels[0x10000] = { nullptr };
+  std::map<std::string, int> constants;
+  Source::FileMap            previousFiles;
+  Source                     source;
+};
+
+static SymbolLoad* symbolLoad = nullptr;
+static SDL_Thread* symbolLoadThread = nullptr;
+static SDL_atomic_t symbolLoadDone;
+
+static int symbolLoadThreadFn(void* data)
+{
+  SymbolLoad* load = (SymbolLoad*)data;
+
+  parseLabels(load->labelFileContents, load->labels, load->constants);
+  parseSource(load->rptFileContents, load->previousFiles, load->source, load->constants, load->labels);
+
+  SDL_AtomicSet(&symbolLoadDone, 1);
+  return 0;
+}
+
+/* Function:  publishSymbolLoad
+ * --------------------
+ * swap in the results of a completed background load
+ */
+static void publishSymbolLoad()
+{
+  auto anchors = anchorBreakpoints();
+
+  freeLabels(labelMap);
+  memcpy(labelMap, symbolLoad->labels, sizeof(labelMap));
+  constants.swap(symbolLoad->constants);
+
+  remapBreakpoints(anchors);
+
+  publishSource(symbolLoad->source);
+
+  free(symbolLoad->labelFileContents);
+  free(symbolLoad->rptFileContents);
+  delete symbolLoad;
+  symbolLoad = nullptr;
+
   sourceLoading = false;
 }
 
+/* Function:  waitForLoad
+ * --------------------
+ * block until any background load is complete and publish it
+ */
+static void waitForLoad()
+{
+  if (!symbolLoad)
+    return;
+
+  if (symbolLoadThread)
+  {
+    SDL_WaitThread(symbolLoadThread, NULL);
+    symbolLoadThread = nullptr;
+  }
+  publishSymbolLoad();
+}
+
+void debuggerLoadAsync(char* labelFileContents, char* rptFileContents)
+{
+  waitForLoad();
+
+  symbolLoad = new SymbolLoad;
+  symbolLoad->labelFileContents = labelFileContents;
+  symbolLoad->rptFileContents = rptFileContents;
+  symbolLoad->previousFiles = source.files();
+
+  sourceLoading = true;
+  SDL_AtomicSet(&symbolLoadDone, 0);
+
+#ifndef __EMSCRIPTEN__
+  symbolLoadThread = SDL_CreateThread(symbolLoadThreadFn, "HBC-56 symbols", symbolLoad);
+#endif
+
+  /* no threads? load now */
+  if (!symbolLoadThread)
+  {
+    symbolLoadThreadFn(symbolLoad);
+    publishSymbolLoad();
+  }
+}
+
+void debuggerUpdate()
+{
+  if (symbolLoad && SDL_AtomicGet(&symbolLoadDone))
+  {
+    waitForLoad();
+  }
+}
+
 
 void debuggerInit(VrEmu6502* cpu6502_)
 {
   cpu6502 = cpu6502_;
+
+  for (int i = 0; i < 256; ++i)
+  {
+    opcodes.insert(vrEmu6502OpcodeToMnemonicStr(cpu6502, i & 0xff));
+  }
 }
 
-void debuggerInitTms(HBC56Device* tms)
+void debuggerInitTms(HBC56Device* tms, SDL_Renderer* renderer)
 {
   tms9918 = tms;
+  debugRenderer = renderer;
 }
 
-std::set<uint16_t> breakpoints;
-
 uint8_t debuggerIsBreakpoint(uint16_t addr)
 {
   return breakpoints.find(addr) != breakpoints.end();
@@ -654,15 +977,6 @@ static uint8_t printable(uint8_t b)
 
 
 
-static int currentFile = 0;
-static uint16_t lastPc = 0;
-static int lastLineNumber = 0;
-static int macroOffset = 0;
-static int macroLines = 0;
-
-static float scrollPos = -1.0f;
-
-
 void setSourceAddress(uint16_t addr)
 {
   auto f = source.file(addr);
@@ -1092,6 +1406,13 @@ void debuggerSourceView(bool* show)
 {
   if (ImGui::Begin("Source", show, ImGuiWindowFlags_HorizontalScrollbar))
   {
+    if (sourceLoading)
+    {
+      ImGui::TextUnformatted("Loading...");
+      ImGui::End();
+      return;
+    }
+
     uint16_t pc = vrEmu6502GetPC(cpu6502);
 
     //std::map<std::string, std::vector<std::pair<std::string, uint16_t>> > source;   filename, vector of lines/addresses
@@ -1412,6 +1733,143 @@ void debuggerVramMemoryView(bool* show)
   ImGui::End();
 }
 
+static const char* tmsTableText(TMS9918Table table)
+{
+  switch (table)
+  {
+    case TMS9918_TABLE_NAME:
+      return "NAME";
+    case TMS9918_TABLE_PATTERN:
+      return "PATT";
+    case TMS9918_TABLE_COLOR:
+      return "COLOR";
+    case TMS9918_TABLE_SPRITE_ATTR:
+      return "SPR ATTR";
+    case TMS9918_TABLE_SPRITE_PATT:
+      return "SPR PATT";
+    default:
+      return "-";
+  }
+}
+
+/* heatmap color for an access count. log scale, black through blue, red and
+   yellow to white. unaccessed bytes are tinted by the table they belong to */
+static uint32_t heatColor(uint32_t count, float logMax, TMS9918Table table)
+{
+  static const uint32_t tableTint[TMS9918_TABLE_COUNT] = {
+    0x003000ff, 0x000038ff, 0x300030ff, 0x302000ff, 0x002828ff, 0x000000ff
+  };
+
+  if (count == 0) return tableTint[table];
+
+  float t = logMax > 0.0f ? logf(1.0f + count) / logMax : 1.0f;
+  if (t > 1.0f) t = 1.0f;
+
+  uint8_t r, g, b;
+  if (t < 0.25f)      { r = 0;                            g = 0;                            b = (uint8_t)(64 + 764 * t); }
+  else if (t < 0.5f)  { r = (uint8_t)(1020 * (t - 0.25f)); g = 0;                            b = (uint8_t)(255 - 1020 * (t - 0.25f)); }
+  else if (t < 0.75f) { r = 255;                          g = (uint8_t)(1020 * (t - 0.5f)); b = 0; }
+  else                { r = 255;                          g = 255;                          b = (uint8_t)(1020 * (t - 0.75f)); }
+
+  return (r << 24) | (g << 16) | (b << 8) | 0xff;
+}
+
+void debuggerVramProfileView(bool* show)
+{
+  static SDL_Texture* heatTexture = NULL;
+  static int showWrites = 1;
+
+  if (ImGui::Begin("TMS9918A VRAM Profile", show))
+  {
+    if (tms9918)
+    {
+      enableTms9918Profile(tms9918);
+
+      const TMS9918Profile* frame = tms9918ProfileLastFrame(tms9918);
+      const uint32_t* heat = tms9918ProfileHeat(tms9918, showWrites);
+
+      if (frame && heat)
+      {
+        ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(0.5f, 1.0f, 0.5f, 1.0f));
+        ImGui::Text("Frame %u", frame->frame);
+        ImGui::Text("Writes: %5u  Reads: %5u  Regs: %u", frame->dataWrites, frame->dataReads, frame->regWrites);
+        ImGui::Text("  Name: %5u  Patt:  %5u  Color: %u", frame->tableWrites[TMS9918_TABLE_NAME],
+                    frame->tableWrites[TMS9918_TABLE_PATTERN], frame->tableWrites[TMS9918_TABLE_COLOR]);
+        ImGui::Text("  SAttr:%5u  SPatt: %5u  Other: %u", frame->tableWrites[TMS9918_TABLE_SPRITE_ATTR],
+                    frame->tableWrites[TMS9918_TABLE_SPRITE_PATT], frame->tableWrites[TMS9918_TABLE_OTHER]);
+        ImGui::Text("Addr sets: %u  Sequential: %u  Longest run: %u", frame->addrSets, frame->sequential, frame->longestRun);
+        ImGui::Text("Active display: %u  Blank: %u", frame->activeWrites, frame->blankWrites);
+        ImGui::PopStyleColor();
+
+        ImGui::RadioButton("Writes", &showWrites, 1); ImGui::SameLine();
+        ImGui::RadioButton("Reads", &showWrites, 0); ImGui::SameLine();
+        if (ImGui::Button("Reset")) resetTms9918ProfileHeat(tms9918);
+
+        /* one pixel per byte. 128 bytes per row */
+        if (!heatTexture && debugRenderer)
+        {
+          heatTexture = SDL_CreateTexture(debugRenderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, 128, 128);
+        }
+
+        if (heatTexture)
+        {
+          uint32_t maxCount = 0;
+          for (int i = 0; i < 0x4000; ++i)
+          {
+            if (heat[i] > maxCount) maxCount = heat[i];
+          }
+          float logMax = logf(1.0f + maxCount);
+
+          void* pixels = NULL;
+          int pitch = 0;
+          if (SDL_LockTexture(heatTexture, NULL, &pixels, &pitch) == 0)
+          {
+            for (int y = 0; y < 128; ++y)
+            {
+              uint32_t* row = (uint32_t*)((uint8_t*)pixels + y * pitch);
+              for (int x = 0; x < 128; ++x)
+              {
+                uint16_t addr = (uint16_t)(y * 128 + x);
+                row[x] = heatColor(heat[addr], logMax, tms9918VramTable(tms9918, addr));
+              }
+            }
+            SDL_UnlockTexture(heatTexture);
+          }
+
+          ImVec2 avail = ImGui::GetContentRegionAvail();
+          float size = avail.x < avail.y ? avail.x : avail.y;
+          if (size < 128.0f) size = 128.0f;
+
+          ImVec2 origin = ImGui::GetCursorScreenPos();
+          ImGui::Image(heatTexture, ImVec2(size, size));
+
+          if (ImGui::IsItemHovered())
+          {
+            ImVec2 mouse = ImGui::GetMousePos();
+            int x = (int)((mouse.x - origin.x) * 128.0f / size);
+            int y = (int)((mouse.y - origin.y) * 128.0f / size);
+            if (x >= 0 && x < 128 && y >= 0 && y < 128)
+            {
+              uint16_t addr = (uint16_t)(y * 128 + x);
+              const uint32_t* writes = tms9918ProfileHeat(tms9918, 1);
+              const uint32_t* reads = tms9918ProfileHeat(tms9918, 0);
+              ImGui::SetTooltip("$%04x %s\nWrites: %u\nReads: %u", addr,
+                                tmsTableText(tms9918VramTable(tms9918, addr)), writes[addr], reads[addr]);
+
+              if (ImGui::IsMouseClicked(0)) debugTmsMemoryAddr = addr;
+            }
+          }
+        }
+      }
+    }
+    else
+    {
+      ImGui::Text("TMS9918A not present");
+    }
+  }
+  ImGui::End();
+}
+
 static std::string tmsColorText(uint8_t c)
 {
   switch (c)
@@ -1454,6 +1912,333 @@ static std::string tmsColorText(uint8_t c)
 }
 
 
+/* decoded vram views. decoded pixels are cached and only the parts whose
+   vram (or the registers) changed since the last update are rebuilt */
+#define TMS_TILES         768
+#define TMS_SPRITES       32
+
+static uint32_t tileStamp = 0;
+static uint32_t tilePixels[192][256];     /* 3 banks of 256 8x8 tiles, 32 per row */
+static bool     tileChanged[TMS_TILES];
+static bool     tileRowsDirty[24];        /* texture rows (of 8 pixels) to upload */
+
+static uint32_t namePixels[192][256];
+static bool     nameRowsDirty[24];
+
+static uint32_t spritePixels[64][128];    /* 32 16x16 sprites, 8 per row */
+static uint8_t  spriteAttr[TMS_SPRITES][4];
+static bool     spriteRowsDirty[4];
+
+static SDL_Texture* tileTexture = NULL;
+static SDL_Texture* nameTexture = NULL;
+static SDL_Texture* spriteTexture = NULL;
+
+/* is an 8 byte vram block newer than stamp? */
+static inline bool vramBlockChanged(const uint32_t* gens, uint16_t addr, uint32_t stamp)
+{
+  return gens[(addr & 0x3fff) >> 3] > stamp;
+}
+
+/* Function:  updateTmsTiles
+ * --------------------
+ * rebuild the decoded pattern tiles (and anything depending on them) which
+ * have changed since the last update
+ */
+static void updateTmsTiles()
+{
+  uint32_t generation = tms9918Generation(tms9918);
+  if (generation == tileStamp) return;
+
+  const uint32_t* gens = tms9918VramGenerations(tms9918);
+  bool all = tms9918RegGeneration(tms9918) > tileStamp;
+
+  uint8_t r0 = readTms9918Reg(tms9918, 0);
+  uint8_t r1 = readTms9918Reg(tms9918, 1);
+  uint8_t r3 = readTms9918Reg(tms9918, 3);
+  uint8_t r4 = readTms9918Reg(tms9918, 4);
+  uint8_t r7 = readTms9918Reg(tms9918, 7);
+
+  bool graphicsII = (r0 & TMS_R0_MODE_GRAPHICS_II) != 0;
+  bool text = (r1 & TMS_R1_MODE_TEXT) != 0;
+  bool multicolor = (r1 & TMS_R1_MODE_MULTICOLOR) != 0;
+  uint32_t backdrop = vrEmuTms9918Palette[r7 & 0x0f];
+
+  /* pattern tiles */
+  for (int t = 0; t < TMS_TILES; ++t)
+  {
+    int bank = t >> 8;
+    int index = t & 0xff;
+
+    uint16_t pattAddr, colorAddr;
+    if (graphicsII)
+    {
+      pattAddr = ((r4 & 0x04) << 11) + bank * 0x800 + index * 8;
+      colorAddr = ((r3 & 0x80) << 6) + bank * 0x800 + index * 8;
+    }
+    else
+    {
+      pattAddr = ((r4 & 0x07) << 11) + index * 8;
+      colorAddr = (r3 << 6) + index / 8;
+    }
+
+    tileChanged[t] = all || vramBlockChanged(gens, pattAddr, tileStamp) ||
+                     (!text && !multicolor && vramBlockChanged(gens, colorAddr, tileStamp));
+    if (!tileChanged[t]) continue;
+
+    int tileX = (t & 31) * 8;
+    int tileY = (t >> 5) * 8;
+    tileRowsDirty[t >> 5] = true;
+
+    for (int y = 0; y < 8; ++y)
+    {
+      uint8_t patt = readTms9918Vram(tms9918, (pattAddr + y) & 0x3fff);
+      uint8_t color = text ? r7 : readTms9918Vram(tms9918, (colorAddr + (graphicsII ? y : 0)) & 0x3fff);
+      uint32_t* dst = &tilePixels[tileY + y][tileX];
+
+      for (int x = 0; x < 8; ++x)
+      {
+        uint8_t c = 0;
+        if (multicolor)
+          c = (x < 4) ? (patt >> 4) : (patt & 0x0f);
+        else
+          c = (patt & (0x80 >> x)) ? (color >> 4) : (color & 0x0f);
+
+        dst[x] = c ? vrEmuTms9918Palette[c] : backdrop;
+      }
+    }
+  }
+
+  /* name table. built from the decoded tiles */
+  int cols = text ? 40 : 32;
+  int cellWidth = text ? 6 : 8;
+  uint16_t nameAddr = (readTms9918Reg(tms9918, 2) & 0x0f) << 10;
+  for (int i = 0; i < cols * 24; ++i)
+  {
+    int row = i / cols;
+    uint16_t addr = (nameAddr + i) & 0x3fff;
+    uint8_t name = readTms9918Vram(tms9918, addr);
+    int tile = name + (graphicsII ? (row / 8) * 256 : 0);
+
+    if (!all && !tileChanged[tile] && !vramBlockChanged(gens, addr, tileStamp)) continue;
+
+    nameRowsDirty[row] = true;
+
+    int srcX = (tile & 31) * 8;
+    int srcY = (tile >> 5) * 8;
+    int dstX = (i % cols) * cellWidth;
+    for (int y = 0; y < 8; ++y)
+    {
+      SDL_memcpy(&namePixels[row * 8 + y][dstX], &tilePixels[srcY + y][srcX], cellWidth * sizeof(uint32_t));
+    }
+  }
+  if (all && text)
+  {
+    /* text mode leaves 16 pixels at the right */
+    for (int y = 0; y < 192; ++y)
+    {
+      for (int x = 240; x < 256; ++x) namePixels[y][x] = backdrop;
+    }
+  }
+
+  /* sprites */
+  uint16_t attrAddr = (readTms9918Reg(tms9918, 5) & 0x7f) << 7;
+  uint16_t spritePattAddr = (readTms9918Reg(tms9918, 6) & 0x07) << 11;
+  bool sprite16 = (r1 & TMS_R1_SPRITE_16) != 0;
+  for (int s = 0; s < TMS_SPRITES; ++s)
+  {
+    uint16_t addr = attrAddr + s * 4;
+    bool changed = all || vramBlockChanged(gens, addr, tileStamp);
+
+    uint8_t name = readTms9918Vram(tms9918, addr + 2);
+    uint16_t pattAddr = spritePattAddr + (sprite16 ? (name & 0xfc) : name) * 8;
+    for (int b = 0; b < (sprite16 ? 4 : 1); ++b)
+    {
+      changed = changed || vramBlockChanged(gens, pattAddr + b * 8, tileStamp);
+    }
+    if (!changed) continue;
+
+    for (int b = 0; b < 4; ++b)
+    {
+      spriteAttr[s][b] = readTms9918Vram(tms9918, addr + b);
+    }
+    spriteRowsDirty[s / 8] = true;
+
+    uint32_t color = vrEmuTms9918Palette[spriteAttr[s][3] & 0x0f];
+    int size = sprite16 ? 16 : 8;
+    for (int y = 0; y < 16; ++y)
+    {
+      uint32_t* dst = &spritePixels[(s / 8) * 16 + y][(s & 7) * 16];
+      for (int x = 0; x < 16; ++x)
+      {
+        bool set = false;
+        if (x < size && y < size)
+        {
+          /* 16x16 sprites are four 8x8 quadrants: top left, bottom left, top right, bottom right */
+          uint16_t rowAddr = pattAddr + (x / 8) * 16 + y;
+          set = (readTms9918Vram(tms9918, rowAddr & 0x3fff) & (0x80 >> (x & 7))) != 0;
+        }
+
+        /* checkered background so transparent pixels are visible */
+        dst[x] = set ? color : ((((x >> 2) ^ (y >> 2)) & 1) ? 0x303030ff : 0x202020ff);
+      }
+    }
+  }
+
+  tileStamp = generation;
+}
+
+/* Function:  uploadTmsTexture
+ * --------------------
+ * copy the dirty rows of a decoded view in to its texture
+ */
+static SDL_Texture* uploadTmsTexture(SDL_Texture** texture, const uint32_t* pixels, int width, int height,
+                                     bool* rowsDirty, int rowHeight)
+{
+  if (!*texture && debugRenderer)
+  {
+    *texture = SDL_CreateTexture(debugRenderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, width, height);
+    for (int i = 0; i < height / rowHeight; ++i) rowsDirty[i] = true;
+  }
+  if (!*texture) return NULL;
+
+  for (int i = 0; i < height / rowHeight; ++i)
+  {
+    if (!rowsDirty[i]) continue;
+
+    SDL_Rect rect = { 0, i * rowHeight, width, rowHeight };
+    SDL_UpdateTexture(*texture, &rect, pixels + i * rowHeight * width, width * sizeof(uint32_t));
+    rowsDirty[i] = false;
+  }
+
+  return *texture;
+}
+
+/* Function:  tmsImage
+ * --------------------
+ * show (part of) a texture scaled to fit the window. returns the pixel
+ * position under the mouse, or -1
+ */
+static void tmsImage(SDL_Texture* texture, int width, int height, int texWidth, int texHeight, int* hoverX, int* hoverY)
+{
+  ImVec2 avail = ImGui::GetContentRegionAvail();
+  float scale = avail.x / width;
+  if (avail.y / height < scale) scale = avail.y / height;
+  if (scale < 1.0f) scale = 1.0f;
+
+  ImVec2 origin = ImGui::GetCursorScreenPos();
+  ImGui::Image(texture, ImVec2(width * scale, height * scale), ImVec2(0, 0),
+               ImVec2(width / (float)texWidth, height / (float)texHeight));
+
+  *hoverX = *hoverY = -1;
+  if (ImGui::IsItemHovered())
+  {
+    ImVec2 mouse = ImGui::GetMousePos();
+    *hoverX = (int)((mouse.x - origin.x) / scale);
+    *hoverY = (int)((mouse.y - origin.y) / scale);
+  }
+}
+
+void debuggerPatternView(bool* show)
+{
+  if (ImGui::Begin("TMS9918A Patterns", show))
+  {
+    if (tms9918)
+    {
+      updateTmsTiles();
+      SDL_Texture* texture = uploadTmsTexture(&tileTexture, &tilePixels[0][0], 256, 192, tileRowsDirty, 8);
+
+      bool graphicsII = (readTms9918Reg(tms9918, 0) & TMS_R0_MODE_GRAPHICS_II) != 0;
+      int height = graphicsII ? 192 : 64;
+      int x = -1, y = -1;
+      if (texture) tmsImage(texture, 256, height, 256, 192, &x, &y);
+
+      if (x >= 0 && y >= 0 && x < 256 && y < height)
+      {
+        int tile = (y / 8) * 32 + x / 8;
+        uint16_t pattAddr = graphicsII ? (((readTms9918Reg(tms9918, 4) & 0x04) << 11) + tile * 8)
+                                       : (((readTms9918Reg(tms9918, 4) & 0x07) << 11) + tile * 8);
+        ImGui::SetTooltip("Pattern $%02x (bank %d)\n$%04x", tile & 0xff, tile >> 8, pattAddr & 0x3fff);
+        if (ImGui::IsMouseClicked(0)) debugTmsMemoryAddr = pattAddr & 0x3fff;
+      }
+    }
+    else
+    {
+      ImGui::Text("TMS9918A not present");
+    }
+  }
+  ImGui::End();
+}
+
+void debuggerNameTableView(bool* show)
+{
+  if (ImGui::Begin("TMS9918A Name Table", show))
+  {
+    if (tms9918)
+    {
+      updateTmsTiles();
+      SDL_Texture* texture = uploadTmsTexture(&nameTexture, &namePixels[0][0], 256, 192, nameRowsDirty, 8);
+
+      bool text = (readTms9918Reg(tms9918, 1) & TMS_R1_MODE_TEXT) != 0;
+      int width = text ? 240 : 256;
+      int x = -1, y = -1;
+      if (texture) tmsImage(texture, width, 192, 256, 192, &x, &y);
+
+      if (x >= 0 && y >= 0 && x < width && y < 192)
+      {
+        int cols = text ? 40 : 32;
+        int col = x / (text ? 6 : 8);
+        uint16_t addr = (((readTms9918Reg(tms9918, 2) & 0x0f) << 10) + (y / 8) * cols + col) & 0x3fff;
+        ImGui::SetTooltip("(%d, %d) $%04x\nName: $%02x", col, y / 8, addr, readTms9918Vram(tms9918, addr));
+        if (ImGui::IsMouseClicked(0)) debugTmsMemoryAddr = addr;
+      }
+    }
+    else
+    {
+      ImGui::Text("TMS9918A not present");
+    }
+  }
+  ImGui::End();
+}
+
+void debuggerSpriteView(bool* show)
+{
+  if (ImGui::Begin("TMS9918A Sprites", show))
+  {
+    if (tms9918)
+    {
+      updateTmsTiles();
+      SDL_Texture* texture = uploadTmsTexture(&spriteTexture, &spritePixels[0][0], 128, 64, spriteRowsDirty, 16);
+
+      int x = -1, y = -1;
+      if (texture) tmsImage(texture, 128, 64, 128, 64, &x, &y);
+      if (x >= 0 && y >= 0 && x < 128 && y < 64)
+      {
+        int s = (y / 16) * 8 + x / 16;
+        ImGui::SetTooltip("Sprite %d", s);
+      }
+
+      /* attributes. sprites after a y of $d0 aren't displayed */
+      bool active = true;
+      for (int s = 0; s < TMS_SPRITES; ++s)
+      {
+        const uint8_t* attr = spriteAttr[s];
+        if (attr[0] == 0xd0) active = false;
+
+        ImGui::PushStyleColor(ImGuiCol_Text, active ? ImVec4(0.5f, 1.0f, 0.5f, 1.0f) : ImVec4(0.5f, 0.5f, 0.5f, 1.0f));
+        ImGui::Text("%2d Y:%3d X:%3d P:$%02x %s%s", s, attr[0], attr[1], attr[2],
+                    tmsColorText(attr[3] & 0x0f).c_str(), (attr[3] & 0x80) ? " EC" : "");
+        ImGui::PopStyleColor();
+      }
+    }
+    else
+    {
+      ImGui::Text("TMS9918A not present");
+    }
+  }
+  ImGui::End();
+}
+
+
 void debuggerTmsRegistersView(bool* show)
 {
   static int regInput = -1;
@@ -1553,3 +2338,133 @@ void debuggerTmsRegistersView(bool* show)
   }
   ImGui::End();
 }
+
+void debuggerMixerView(bool* show)
+{
+  if (ImGui::Begin("Audio Mixer", show))
+  {
+    if (ImGui::BeginTable("MixerTable", 5, ImGuiTableFlags_SizingFixedFit | ImGuiTableFlags_Resizable))
+    {
+      ImGui::TableSetupColumn("Channel");
+      ImGui::TableSetupColumn("Level");
+      ImGui::TableSetupColumn("Gain");
+      ImGui::TableSetupColumn("Pan");
+      ImGui::TableSetupColumn("M / S");
+      ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(1.0f, 1.0f, 0.5f, 1.0f));
+      ImGui::TableHeadersRow();
+      ImGui::PopStyleColor();
+
+      for (int i = 0; i < hbc56MixerChannelCount(); ++i)
+      {
+        HBC56MixerChannel* channel = hbc56MixerChannel(i);
+        ImGui::PushID(i);
+        ImGui::TableNextRow();
+
+        ImGui::TableNextColumn();
+        ImGui::Text("%s", channel->name);
+
+        ImGui::TableNextColumn();
+        ImGui::ProgressBar(channel->peak, ImVec2(80.0f, 0.0f), "");
+
+        ImGui::TableNextColumn();
+        ImGui::SetNextItemWidth(100.0f);
+        ImGui::SliderFloat("##gain", &channel->gain, 0.0f, 2.0f, "%.2f");
+
+        ImGui::TableNextColumn();
+        ImGui::SetNextItemWidth(100.0f);
+        ImGui::SliderFloat("##pan", &channel->pan, -1.0f, 1.0f, "%.2f");
+
+        ImGui::TableNextColumn();
+        bool mute = channel->mute != 0;
+        bool solo = channel->solo != 0;
+        if (ImGui::Checkbox("##mute", &mute)) channel->mute = mute;
+        ImGui::SameLine();
+        if (ImGui::Checkbox("##solo", &solo)) channel->solo = solo;
+
+        ImGui::PopID();
+      }
+      ImGui::EndTable();
+    }
+  }
+  ImGui::End();
+}
+
+/* Function:  audioHistogramView
+ * --------------------
+ * a row of histogram stats and its buckets
+ */
+static void audioHistogramView(const char* name, const char* unit, const HBC56AudioHistogram* hist)
+{
+  float buckets[HBC56_AUDIO_HIST_BUCKETS];
+  for (int i = 0; i < HBC56_AUDIO_HIST_BUCKETS; ++i)
+  {
+    buckets[i] = (float)hist->buckets[i];
+  }
+
+  ImGui::TableNextRow();
+  ImGui::TableNextColumn();
+  ImGui::Text("%s (%s)", name, unit);
+  ImGui::TableNextColumn();
+  ImGui::Text("%u", hist->count ? hist->min : 0);
+  ImGui::TableNextColumn();
+  ImGui::Text("%u", hist->count ? (uint32_t)(hist->sum / hist->count) : 0);
+  ImGui::TableNextColumn();
+  ImGui::Text("%u", hist->max);
+  ImGui::TableNextColumn();
+  ImGui::PushID(name);
+  ImGui::PlotHistogram("##hist", buckets, HBC56_AUDIO_HIST_BUCKETS, 0, NULL, 0.0f, 3.4e38f, ImVec2(160.0f, 30.0f));
+  if (ImGui::IsItemHovered())
+  {
+    ImGui::SetTooltip("bucket n: < 2^n %s", unit);
+  }
+  ImGui::PopID();
+}
+
+void debuggerAudioMetricsView(bool* show)
+{
+  if (ImGui::Begin("Audio Metrics", show))
+  {
+    const HBC56AudioMetrics* metrics = hbc56AudioGetMetrics();
+
+    static const char* bufferSizes[] = { "64", "128", "256", "512", "1024", "2048", "4096", "8192" };
+    int bufferIndex = 0;
+    while (bufferIndex < 7 && (64 << bufferIndex) < hbc56AudioBufferSamples()) ++bufferIndex;
+
+    ImGui::SetNextItemWidth(100.0f);
+    if (ImGui::Combo("Buffer (frames)", &bufferIndex, bufferSizes, 8))
+    {
+      hbc56AudioSetBufferSamples(64 << bufferIndex);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Reset"))
+    {
+      hbc56AudioResetMetrics();
+    }
+
+    ImGui::Text("Callbacks: %u   Underruns: %u   Overruns: %u", metrics->callbacks, metrics->underruns, metrics->overruns);
+    ImGui::Text("Frames requested: %llu   delivered: %llu   rendered: %llu",
+                (unsigned long long)metrics->framesRequested, (unsigned long long)metrics->framesDelivered,
+                (unsigned long long)metrics->framesRendered);
+    ImGui::Text("Rate adjustment: %+.3f%%", (metrics->rateRatio - 1.0) * 100.0);
+
+    if (ImGui::BeginTable("AudioMetricsTable", 5, ImGuiTableFlags_SizingFixedFit | ImGuiTableFlags_Resizable))
+    {
+      ImGui::TableSetupColumn("Metric");
+      ImGui::TableSetupColumn("Min");
+      ImGui::TableSetupColumn("Avg");
+      ImGui::TableSetupColumn("Max");
+      ImGui::TableSetupColumn("Histogram");
+      ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(1.0f, 1.0f, 0.5f, 1.0f));
+      ImGui::TableHeadersRow();
+      ImGui::PopStyleColor();
+
+      audioHistogramView("Callback interval", "us", &metrics->callbackInterval);
+      audioHistogramView("Callback duration", "us", &metrics->callbackDuration);
+      audioHistogramView("Ring fill", "frames", &metrics->ringFill);
+      audioHistogramView("Write latency", "us", &metrics->latency);
+
+      ImGui::EndTable();
+    }
+  }
+  ImGui::End();
+}
@@ -20,13 +20,20 @@ typedef struct vrEmu6502_s VrEmu6502;
 
 void debuggerInit(VrEmu6502 *cpu6502);
 
-void debuggerInitTms(HBC56Device *tms9918);
+void debuggerInitTms(HBC56Device *tms9918, SDL_Renderer* renderer);
 
 uint8_t debuggerIsBreakpoint(uint16_t addr);
 
 void debuggerLoadLabels(const char* labelFileContents);
 void debuggerLoadSource(const char* rptFileContents);
 
+/* parse labels and source on a worker thread. takes ownership of the
+   (malloc'd) contents. results are swapped in by debuggerUpdate() */
+void debuggerLoadAsync(char* labelFileContents, char* rptFileContents);
+void debuggerUpdate();
+
+int debuggerLabelAddress(const char* label);  /* returns -1 if not found */
+
 void debuggerRegistersView(bool* show);
 void debuggerStackView(bool* show);
 void debuggerDisassemblyView(bool* show);
@@ -35,6 +42,12 @@ void debuggerMemoryView(bool *show);
 void debuggerBreakpointsView(bool *show);
 void debuggerVramMemoryView(bool* show);
 void debuggerTmsRegistersView(bool* show);
+void debuggerVramProfileView(bool* show);
+void debuggerPatternView(bool* show);
+void debuggerNameTableView(bool* show);
+void debuggerSpriteView(bool* show);
+void debuggerMixerView(bool* show);
+void debuggerAudioMetricsView(bool* show);
 
 extern uint16_t debugMemoryAddr;
 extern uint16_t debugTmsMemoryAddr;
@@ -22,6 +22,9 @@
 static void reset6502CpuDevice(HBC56Device*);
 static void destroy6502CpuDevice(HBC56Device*);
 static void tick6502CpuDevice(HBC56Device*,uint32_t,double);
+static uint8_t read6502CpuDevice(HBC56Device*, uint16_t, uint8_t*, uint8_t);
+static uint32_t save6502CpuDevice(HBC56Device*, uint8_t*, uint32_t);
+static uint8_t load6502CpuDevice(HBC56Device*, const uint8_t*, uint32_t);
 
 #define CPU_6502_MAX_CALL_STACK   128
 #define CPU_6502_JSR              0x20
@@ -29,8 +32,16 @@ static void tick6502CpuDevice(HBC56Device*,uint32_t,double);
 #define CPU_6502_WAI              0xcb
 #define CPU_6502_BRK              0xdb
 
-#define CPU_6502_MAX_TIMESTEP_SEC   0.001
-#define CPU_6502_MAX_TIMESTEP_STEPS 4000
+/* vrEmu6502 doesn't allow registers to be set directly, so they are restored
+   by resetting the cpu into a small program which is fed to the cpu by this
+   device while restoring:
+      LDX #sp-1, TXS, LDA #a, LDX #x, LDY #y, PLP, JMP pc
+   the status register is fed to the PLP as the value on the stack */
+#define CPU_6502_RESTORE_ADDR       0xff00
+#define CPU_6502_RESTORE_SIZE       13
+#define CPU_6502_RESTORE_JMP_OFFSET 10
+
+#define CPU_6502_STATE_SIZE         7
 
 struct CPU6502Device
 {
@@ -44,7 +55,11 @@ struct CPU6502Device
   uint16_t             breakAddr;
   uint64_t             ticks;
   uint64_t             ticksWai;
+  uint64_t             cycles;
   IsBreakpointFn       isBreakFn;
+  uint8_t              restoreProgram[CPU_6502_RESTORE_SIZE];
+  uint8_t              restoreStatus;
+  uint8_t              restoreStackPtr;
 };
 typedef struct CPU6502Device CPU6502Device;
 
@@ -69,12 +84,15 @@ HBC56Device create6502CpuDevice(IsBreakpointFn brkCb)
     cpuDevice->breakMode = 0;
     cpuDevice->breakAddr = 0;
     cpuDevice->ticks = cpuDevice->ticksWai = 0L;
+    cpuDevice->cycles = 0L;
     cpuDevice->isBreakFn = brkCb;
     device.data = cpuDevice;
 
     device.resetFn = &reset6502CpuDevice;
     device.destroyFn = &destroy6502CpuDevice;
     device.tickFn = &tick6502CpuDevice;
+    device.saveFn = &save6502CpuDevice;
+    device.loadFn = &load6502CpuDevice;
   }
   else
   {
@@ -100,6 +118,7 @@ static void reset6502CpuDevice(HBC56Device* device)
   CPU6502Device* cpuDevice = get6502CpuDevice(device);
   if (cpuDevice)
   {
+    device->readFn = NULL; /* cancel any pending restore */
     vrEmu6502Reset(cpuDevice->cpu6502);
   }
 }
@@ -144,11 +163,14 @@ static void tick6502CpuDevice(HBC56Device* device, uint32_t deltaTicks, double d
   CPU6502Device* cpuDevice = get6502CpuDevice(device);
   if (cpuDevice)
   {
-    /* introduce a limit to the amount of time we can process in a single step
-       to prevent a runaway condition for slow processors */
-    if (deltaTime > CPU_6502_MAX_TIMESTEP_SEC)
+    /* waiting for an interrupt? other devices tick after us, so nothing can
+       interrupt the cpu during this step. skip it */
+    if (isCpu6502Waiting(device))
     {
-      deltaTicks = CPU_6502_MAX_TIMESTEP_STEPS;
+      cpuDevice->cycles += deltaTicks;
+      cpuDevice->ticks += deltaTicks;
+      cpuDevice->ticksWai += deltaTicks;
+      return;
     }
 
     uint16_t intVec = (hbc56MemRead(0xfffe, true) | (hbc56MemRead(0xffff, true) << 8));
@@ -159,8 +181,9 @@ static void tick6502CpuDevice(HBC56Device* device, uint32_t deltaTicks, double d
       /* currently, we disable interrupts while debugging since the tms9918
          will constantly trigger interrupts which don't allow debugging user code. 
          this will become an option */
-      if (cpuDevice->currentState == CPU_RUNNING ||
-          cpuDevice->currentState == CPU_BREAK_ON_INTERRUPT)
+      if (!device->readFn && (
+          cpuDevice->currentState == CPU_RUNNING ||
+          cpuDevice->currentState == CPU_BREAK_ON_INTERRUPT))
       {
         checkInterrupt(&cpuDevice->nmiSignal, vrEmu6502Nmi(cpuDevice->cpu6502));
         checkInterrupt(&cpuDevice->intSignal, vrEmu6502Int(cpuDevice->cpu6502));
@@ -174,9 +197,17 @@ static void tick6502CpuDevice(HBC56Device* device, uint32_t deltaTicks, double d
       if (doTick)
       {
         vrEmu6502Tick(cpuDevice->cpu6502);
+        ++cpuDevice->cycles;
 
         if (vrEmu6502GetOpcodeCycle(cpuDevice->cpu6502) == 0) /* end of the instruction */
         {
+          /* restore program finished? */
+          if (device->readFn &&
+              vrEmu6502GetCurrentOpcodeAddr(cpuDevice->cpu6502) == CPU_6502_RESTORE_ADDR + CPU_6502_RESTORE_JMP_OFFSET)
+          {
+            device->readFn = NULL;
+          }
+
           if (cpuDevice->currentState == CPU_BREAK_ON_INTERRUPT)
           {
             if (vrEmu6502GetCurrentOpcodeAddr(cpuDevice->cpu6502) == intVec ||
@@ -222,6 +253,24 @@ static void tick6502CpuDevice(HBC56Device* device, uint32_t deltaTicks, double d
   }
 } 
 
+/* Function:  isCpu6502Waiting
+ * --------------------
+ * is the cpu running and waiting (WAI) for an interrupt which isn't yet raised?
+ */
+int isCpu6502Waiting(HBC56Device* device)
+{
+  CPU6502Device* cpuDevice = get6502CpuDevice(device);
+  if (cpuDevice)
+  {
+    return cpuDevice->currentState == CPU_RUNNING &&
+           !device->readFn &&
+           vrEmu6502GetCurrentOpcode(cpuDevice->cpu6502) == CPU_6502_WAI &&
+           cpuDevice->intSignal != INTERRUPT_RAISE &&
+           cpuDevice->nmiSignal != INTERRUPT_RAISE;
+  }
+  return 0;
+}
+
 void interrupt6502(HBC56Device* device, HBC56InterruptType type, HBC56InterruptSignal signal)
 {
   CPU6502Device* cpuDevice = get6502CpuDevice(device);
@@ -319,6 +368,127 @@ float getCpuUtilization(HBC56Device* device)
 }
 
 
+/* Function:  read6502CpuDevice
+ * --------------------
+ * only installed while restoring. feeds the restore program to the cpu
+ */
+static uint8_t read6502CpuDevice(HBC56Device* device, uint16_t addr, uint8_t* val, uint8_t dbg)
+{
+  CPU6502Device* cpuDevice = get6502CpuDevice(device);
+  if (cpuDevice && val)
+  {
+    if (addr == 0xfffc || addr == 0xfffd)
+    {
+      *val = (addr & 0x01) ? (CPU_6502_RESTORE_ADDR >> 8) : (CPU_6502_RESTORE_ADDR & 0xff);
+      return 1;
+    }
+    else if (addr >= CPU_6502_RESTORE_ADDR && addr < CPU_6502_RESTORE_ADDR + CPU_6502_RESTORE_SIZE)
+    {
+      *val = cpuDevice->restoreProgram[addr - CPU_6502_RESTORE_ADDR];
+      return 1;
+    }
+    else if (addr == 0x100 + cpuDevice->restoreStackPtr)
+    {
+      *val = cpuDevice->restoreStatus;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* Function:  save6502CpuDevice
+ * --------------------
+ * save the cpu registers. only valid at the end of an instruction
+ */
+static uint32_t save6502CpuDevice(HBC56Device* device, uint8_t* buffer, uint32_t size)
+{
+  CPU6502Device* cpuDevice = get6502CpuDevice(device);
+  if (cpuDevice)
+  {
+    if (buffer)
+    {
+      if (size < CPU_6502_STATE_SIZE)
+        return 0;
+
+      uint16_t pc = vrEmu6502GetPC(cpuDevice->cpu6502);
+      buffer[0] = vrEmu6502GetAcc(cpuDevice->cpu6502);
+      buffer[1] = vrEmu6502GetX(cpuDevice->cpu6502);
+      buffer[2] = vrEmu6502GetY(cpuDevice->cpu6502);
+      buffer[3] = vrEmu6502GetStackPointer(cpuDevice->cpu6502);
+      buffer[4] = vrEmu6502GetStatus(cpuDevice->cpu6502);
+      buffer[5] = pc & 0xff;
+      buffer[6] = pc >> 8;
+    }
+    return CPU_6502_STATE_SIZE;
+  }
+  return 0;
+}
+
+/* Function:  load6502CpuDevice
+ * --------------------
+ * restore the cpu registers. the cpu is reset and the registers are set
+ * by the restore program over the next few ticks
+ */
+static uint8_t load6502CpuDevice(HBC56Device* device, const uint8_t* buffer, uint32_t size)
+{
+  CPU6502Device* cpuDevice = get6502CpuDevice(device);
+  if (cpuDevice && buffer && size == CPU_6502_STATE_SIZE)
+  {
+    uint8_t* prg = cpuDevice->restoreProgram;
+    prg[0] = 0xa2; prg[1] = buffer[3] - 1;  /* LDX #sp-1 */
+    prg[2] = 0x9a;                          /* TXS       */
+    prg[3] = 0xa9; prg[4] = buffer[0];      /* LDA #a    */
+    prg[5] = 0xa2; prg[6] = buffer[1];      /* LDX #x    */
+    prg[7] = 0xa0; prg[8] = buffer[2];      /* LDY #y    */
+    prg[9] = 0x28;                          /* PLP       */
+    prg[10] = 0x4c; prg[11] = buffer[5]; prg[12] = buffer[6]; /* JMP pc */
+
+    cpuDevice->restoreStackPtr = buffer[3];
+    cpuDevice->restoreStatus = buffer[4];
+    cpuDevice->callStackPtr = 0;
+
+    device->readFn = &read6502CpuDevice;
+    vrEmu6502Reset(cpuDevice->cpu6502);
+    return 1;
+  }
+  return 0;
+}
+/* Function:  jump6502
+ * --------------------
+ * continue execution at addr. uses the restore program to set the PC
+ */
+void jump6502(HBC56Device* device, uint16_t addr)
+{
+  CPU6502Device* cpuDevice = get6502CpuDevice(device);
+  if (!cpuDevice) return;
+
+  /* already restoring? just update the restore program's jmp */
+  if (device->readFn)
+  {
+    cpuDevice->restoreProgram[CPU_6502_RESTORE_JMP_OFFSET + 1] = addr & 0xff;
+    cpuDevice->restoreProgram[CPU_6502_RESTORE_JMP_OFFSET + 2] = addr >> 8;
+    return;
+  }
+
+  uint8_t state[CPU_6502_STATE_SIZE];
+  if (save6502CpuDevice(device, state, sizeof(state)) == sizeof(state))
+  {
+    state[5] = addr & 0xff;
+    state[6] = addr >> 8;
+    load6502CpuDevice(device, state, sizeof(state));
+  }
+}
+
+uint64_t getCpuCycles(HBC56Device* device)
+{
+  CPU6502Device* cpuDevice = get6502CpuDevice(device);
+  if (cpuDevice)
+  {
+    return cpuDevice->cycles;
+  }
+  return 0;
+}
+
 VrEmu6502* getCpuDevice(HBC56Device* device)
 {
   CPU6502Device* cpuDevice = get6502CpuDevice(device);
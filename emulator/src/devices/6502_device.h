@@ -50,6 +50,18 @@ VrEmu6502* getCpuDevice(HBC56Device* device);
 
 float getCpuUtilization(HBC56Device* device);
 
+uint64_t getCpuCycles(HBC56Device* device);
+
+/* is the cpu waiting (WAI) for an interrupt which hasn't been raised? */
+int isCpu6502Waiting(HBC56Device* device);
+
+/* Function:  jump6502
+ * --------------------
+ * continue execution at addr. registers other than PC are unchanged.
+ * should only be called at the end of an instruction
+ */
+void jump6502(HBC56Device* device, uint16_t addr);
+
 #ifdef __cplusplus
 }
 #endif
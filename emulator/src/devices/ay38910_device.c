@@ -10,8 +10,11 @@
  */
 
 #include "ay38910_device.h"
+#include "../hbc56emu.h"
+#include "../mixer.h"
+#include "../audio.h"
 
-#include "emu2149.h"
+#include "ay38910_synth.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -26,19 +29,59 @@ static void destroyAy38910Device(HBC56Device*);
 static void audioAy38910Device(HBC56Device* device, float* buffer, int numSamples);
 static uint8_t readAy38910Device(HBC56Device*, uint16_t, uint8_t*, uint8_t);
 static uint8_t writeAy38910Device(HBC56Device*, uint16_t, uint8_t);
+static uint32_t saveAy38910Device(HBC56Device*, uint8_t*, uint32_t);
+static uint8_t loadAy38910Device(HBC56Device*, const uint8_t*, uint32_t);
 
 #define AY3891X_INACTIVE 0x03
 #define AY3891X_READ     0x02
 #define AY3891X_WRITE    0x01
 #define AY3891X_ADDR     0x00
 
+#define AY3891X_NUM_REGS 16
+#define AY3891X_STATE_SIZE (AY3891X_NUM_REGS + 1)
+
+/* register write log size (must be a power of 2) */
+#define AY3891X_QUEUE_SIZE  0x1000
+#define AY3891X_QUEUE_MASK  (AY3891X_QUEUE_SIZE - 1)
+#define AY3891X_QUEUE_RESET 0xff          /* log entry register: reset the psg */
+
+/* samples rendered per pass */
+#define AY3891X_BLOCK_SAMPLES AY38910_SYNTH_MAX_SAMPLES
+
+/* a logged register write, stamped with the cpu cycle it happened on */
+typedef struct
+{
+  uint64_t       cycle;
+  uint8_t        reg;
+  uint8_t        value;
+} AY38910Write;
+
+/* ay-3-8910 device data. the cpu side only touches the shadow registers
+   and pushes writes to the log. the audio renderer owns the psg and applies
+   each logged write at the sample matching its cycle. no locks are shared
+   between the two */
 struct AY38910Device
 {
   uint16_t       baseAddr;
+  int            chip;              /* psg number (0 = first) */
   uint8_t        regAddr;
   int            channels;
-  PSG           *psg;
-  SDL_mutex     *mutex;
+  int            clockFreq;
+  int            sampleRate;
+  AY38910Synth  *synth;
+
+  /* emulation side */
+  uint8_t        shadowRegs[AY3891X_NUM_REGS];
+
+  /* single producer (cpu), single consumer (renderer) write log */
+  AY38910Write   queue[AY3891X_QUEUE_SIZE];
+  SDL_atomic_t   queueHead;
+  SDL_atomic_t   queueTail;
+  SDL_atomic_t   resync;            /* queue overflowed. reapply the shadow registers */
+
+  /* audio side */
+  uint8_t        appliedRegs[AY3891X_NUM_REGS];
+  int            mixChannel;        /* first of our three mixer channels (-1 if none) */
 };
 typedef struct AY38910Device AY38910Device;
 
@@ -52,11 +95,25 @@ HBC56Device createAY38910Device(uint16_t baseAddr, int clockFreq, int sampleRate
   AY38910Device* ayDevice = (AY38910Device*)malloc(sizeof(AY38910Device));
   if (ayDevice)
   {
+    SDL_memset(ayDevice, 0, sizeof(AY38910Device));
     ayDevice->baseAddr = baseAddr;
-    ayDevice->psg = PSG_new(clockFreq, sampleRate);
+    ayDevice->clockFreq = clockFreq;
+    ayDevice->sampleRate = sampleRate;
+    ayDevice->synth = ay38910SynthCreate(clockFreq, sampleRate, AY38910_QUALITY_BLEP);
     ayDevice->regAddr = 0;
     ayDevice->channels = channels;
-    ayDevice->mutex = SDL_CreateMutex();
+
+    /* a mixer channel per psg channel. the default gains and pans match the
+       original hbc-56 wiring: a left, b right, c (half level) on both sides */
+    static int psgCount = 0;
+    char name[HBC56_MIXER_NAME_LEN];
+    ayDevice->chip = psgCount++;
+    SDL_snprintf(name, sizeof(name), "PSG %d A", psgCount);
+    ayDevice->mixChannel = hbc56MixerAddChannel(name, psgCount, 2.0f / 3.0f, -1.0f);
+    SDL_snprintf(name, sizeof(name), "PSG %d B", psgCount);
+    hbc56MixerAddChannel(name, psgCount, 2.0f / 3.0f, 1.0f);
+    SDL_snprintf(name, sizeof(name), "PSG %d C", psgCount);
+    if (hbc56MixerAddChannel(name, psgCount, 1.0f / 3.0f, 0.0f) < 0) ayDevice->mixChannel = -1;
 
     device.data = ayDevice;
 
@@ -65,6 +122,8 @@ HBC56Device createAY38910Device(uint16_t baseAddr, int clockFreq, int sampleRate
     device.readFn = &readAy38910Device;
     device.writeFn = &writeAy38910Device;
     device.audioFn = &audioAy38910Device;
+    device.saveFn = &saveAy38910Device;
+    device.loadFn = &loadAy38910Device;
   }
   else
   {
@@ -85,14 +144,121 @@ inline static AY38910Device* getAy38910Device(HBC56Device* device)
   return (AY38910Device*)device->data;
 }
 
+/* Function:  pushWrite
+ * --------------------
+ * log a register write for the audio side (cpu side only)
+ */
+static void pushWrite(AY38910Device* ayDevice, uint8_t reg, uint8_t value)
+{
+  int head = SDL_AtomicGet(&ayDevice->queueHead);
+  int next = (head + 1) & AY3891X_QUEUE_MASK;
+
+  /* full? the audio side isn't keeping up (or isn't running). drop the write
+     and have the audio side catch up from the shadow registers instead */
+  if (next == SDL_AtomicGet(&ayDevice->queueTail))
+  {
+    SDL_AtomicSet(&ayDevice->resync, 1);
+    return;
+  }
+
+  ayDevice->queue[head].cycle = hbc56CpuCycles();
+  ayDevice->queue[head].reg = reg;
+  ayDevice->queue[head].value = value;
+  SDL_AtomicSet(&ayDevice->queueHead, next);
+}
+
+/* Function:  applyWrite
+ * --------------------
+ * apply a register write to the psg (audio side only)
+ */
+static void applyWrite(AY38910Device* ayDevice, uint8_t reg, uint8_t value)
+{
+  if (reg == AY3891X_QUEUE_RESET)
+  {
+    ay38910SynthReset(ayDevice->synth);
+    SDL_memset(ayDevice->appliedRegs, 0, sizeof(ayDevice->appliedRegs));
+  }
+  else
+  {
+    ay38910SynthWrite(ayDevice->synth, reg, value);
+    if (reg < AY3891X_NUM_REGS) ayDevice->appliedRegs[reg] = value;
+  }
+}
+
+/* Function:  resyncWrites
+ * --------------------
+ * writes were dropped. catch up with the registers which differ (audio side only).
+ * unchanged registers are left alone so the envelope isn't retriggered
+ */
+static void resyncWrites(AY38910Device* ayDevice)
+{
+  if (SDL_AtomicCAS(&ayDevice->resync, 1, 0))
+  {
+    /* the queued writes are older than the shadow registers. discard them
+       first or they would be replayed over the newer values */
+    SDL_AtomicSet(&ayDevice->queueTail, SDL_AtomicGet(&ayDevice->queueHead));
+
+    for (int i = 0; i < AY3891X_NUM_REGS; ++i)
+    {
+      uint8_t value = ayDevice->shadowRegs[i];
+      if (value != ayDevice->appliedRegs[i]) applyWrite(ayDevice, (uint8_t)i, value);
+    }
+  }
+}
+
+/* Function:  applyDueWrites
+ * --------------------
+ * apply the logged writes due at or before sample (audio side only).
+ * the block of numSamples spans cycles cpu cycles from startCycle.
+ * returns the sample the next logged write is due at (numSamples if none)
+ */
+static int applyDueWrites(AY38910Device* ayDevice, int sample, int numSamples, uint64_t startCycle, uint64_t cycles)
+{
+  int tail = SDL_AtomicGet(&ayDevice->queueTail);
+  int head = SDL_AtomicGet(&ayDevice->queueHead);
+  int due = numSamples;
+
+  while (tail != head)
+  {
+    AY38910Write* write = &ayDevice->queue[tail];
+
+    if (write->cycle <= startCycle)
+    {
+      due = 0;
+    }
+    else if (write->cycle - startCycle >= cycles)
+    {
+      due = numSamples;      /* belongs to a later block */
+    }
+    else
+    {
+      due = (int)((write->cycle - startCycle) * numSamples / cycles);
+    }
+
+    if (due > sample) break;
+
+    applyWrite(ayDevice, write->reg, write->value);
+    tail = (tail + 1) & AY3891X_QUEUE_MASK;
+    due = numSamples;
+  }
+  SDL_AtomicSet(&ayDevice->queueTail, tail);
+
+  return due;
+}
+
 static void resetAy38910Device(HBC56Device* device)
 {
   AY38910Device* ayDevice = getAy38910Device(device);
   if (ayDevice)
   {
-    SDL_LockMutex(ayDevice->mutex);
-    PSG_reset(ayDevice->psg);
-    SDL_UnlockMutex(ayDevice->mutex);
+    SDL_memset(ayDevice->shadowRegs, 0, sizeof(ayDevice->shadowRegs));
+    pushWrite(ayDevice, AY3891X_QUEUE_RESET, 0);
+
+    /* the register logs have no reset. log it as clearing each register */
+    for (int i = 0; i < AY3891X_NUM_REGS; ++i)
+    {
+      hbc56AudioNoteWrite(ayDevice->chip, (uint8_t)i, 0);
+    }
   }
 }
 
@@ -101,37 +267,60 @@ static void destroyAy38910Device(HBC56Device *device)
   AY38910Device *ayDevice = getAy38910Device(device);
   if (ayDevice)
   {
-    SDL_LockMutex(ayDevice->mutex);
-    PSG_delete(ayDevice->psg);
-    ayDevice->psg = NULL;
-    SDL_UnlockMutex(ayDevice->mutex);
-
-    SDL_DestroyMutex(ayDevice->mutex);
-    ayDevice->mutex = NULL;
+    ay38910SynthDestroy(ayDevice->synth);
+    ayDevice->synth = NULL;
   }
   free(ayDevice);
   device->data = NULL;
 }
 
+/* Function:  audioAy38910Device
+ * --------------------
+ * render a block of audio. each psg channel is generated into its mixer
+ * channel. the mixer combines them into the stream
+ */
 static void audioAy38910Device(HBC56Device* device, float* buffer, int numSamples)
 {
   AY38910Device* ayDevice = getAy38910Device(device);
-  if (ayDevice)
+  if (ayDevice && ayDevice->synth && ayDevice->mixChannel >= 0)
   {
-    SDL_LockMutex(ayDevice->mutex);
+    resyncWrites(ayDevice);
 
-    for (int i = 0; i < numSamples; ++i)
+    /* the cpu cycles this block covers. writes from earlier (unrendered)
+       steps are applied at its start */
+    uint64_t startCycle = 0, endCycle = 0;
+    hbc56AudioRenderCycles(&startCycle, &endCycle);
+    uint64_t cycles = endCycle > startCycle ? endCycle - startCycle : 0;
+
+    if (numSamples > HBC56_MIXER_MAX_FRAMES) numSamples = HBC56_MIXER_MAX_FRAMES;
+
+    float* chA = hbc56MixerChannel(ayDevice->mixChannel)->buffer;
+    float* chB = hbc56MixerChannel(ayDevice->mixChannel + 1)->buffer;
+    float* chC = hbc56MixerChannel(ayDevice->mixChannel + 2)->buffer;
+
+    int rendered = 0;
+    while (rendered < numSamples)
     {
-      PSG_calc(ayDevice->psg);
-      buffer[i * ayDevice->channels] += ((ayDevice->psg->ch_out[0] * 2 + ayDevice->psg->ch_out[2]) / (8192.0f * 3.0f));;
+      int blockSamples = numSamples - rendered;
+      if (blockSamples > AY3891X_BLOCK_SAMPLES) blockSamples = AY3891X_BLOCK_SAMPLES;
 
-      if (ayDevice->channels > 1)
+      /* generate. in runs between logged writes */
+      int sample = 0;
+      while (sample < blockSamples)
       {
-        buffer[i * ayDevice->channels + 1] += ((ayDevice->psg->ch_out[1] * 2 + ayDevice->psg->ch_out[2]) / (8192.0f * 3.0f));;
+        int runEnd = applyDueWrites(ayDevice, rendered + sample, numSamples, startCycle, cycles) - rendered;
+        if (runEnd > blockSamples) runEnd = blockSamples;
+
+        if (runEnd > sample)
+        {
+          float* out[3] = { chA + rendered + sample, chB + rendered + sample, chC + rendered + sample };
+          ay38910SynthRender(ayDevice->synth, out, runEnd - sample);
+          sample = runEnd;
+        }
       }
-    }
 
-    SDL_UnlockMutex(ayDevice->mutex);
+      rendered += blockSamples;
+    }
   }
 }
 
@@ -142,9 +331,7 @@ static uint8_t readAy38910Device(HBC56Device* device, uint16_t addr, uint8_t *va
   {
     if (addr == (ayDevice->baseAddr | AY3891X_READ))
     {
-      SDL_LockMutex(ayDevice->mutex);
-      *val = PSG_readReg(ayDevice->psg, ayDevice->regAddr);
-      SDL_UnlockMutex(ayDevice->mutex);
+      *val = ayDevice->regAddr < AY3891X_NUM_REGS ? ayDevice->shadowRegs[ayDevice->regAddr] : 0;
       return 1;
     }
   }
@@ -159,18 +346,87 @@ static uint8_t writeAy38910Device(HBC56Device* device, uint16_t addr, uint8_t va
   {
     if (addr == (ayDevice->baseAddr | AY3891X_ADDR))
     {
-      SDL_LockMutex(ayDevice->mutex);
       ayDevice->regAddr = val;
-      SDL_UnlockMutex(ayDevice->mutex);
       return 1;
     }
     else if (addr == (ayDevice->baseAddr | AY3891X_WRITE))
     {
-      SDL_LockMutex(ayDevice->mutex);
-      PSG_writeReg(ayDevice->psg, ayDevice->regAddr, val);
-      SDL_UnlockMutex(ayDevice->mutex);
+      if (ayDevice->regAddr < AY3891X_NUM_REGS)
+      {
+        ayDevice->shadowRegs[ayDevice->regAddr] = val;
+        pushWrite(ayDevice, ayDevice->regAddr, val);
+        hbc56AudioNoteWrite(ayDevice->chip, ayDevice->regAddr, val);
+      }
       return 1;
     }
   }
   return 0;
-}
\ No newline at end of file
+}
+
+/* Function:  saveAy38910Device
+ * --------------------
+ * save the psg registers and the currently selected register
+ */
+static uint32_t saveAy38910Device(HBC56Device* device, uint8_t* buffer, uint32_t size)
+{
+  AY38910Device* ayDevice = getAy38910Device(device);
+  if (ayDevice)
+  {
+    if (buffer)
+    {
+      if (size < AY3891X_STATE_SIZE)
+        return 0;
+
+      for (int i = 0; i < AY3891X_NUM_REGS; ++i)
+      {
+        buffer[i] = ayDevice->shadowRegs[i];
+      }
+      buffer[AY3891X_NUM_REGS] = ayDevice->regAddr;
+    }
+    return AY3891X_STATE_SIZE;
+  }
+  return 0;
+}
+
+/* Function:  loadAy38910Device
+ * --------------------
+ * restore the psg registers and the currently selected register
+ */
+static uint8_t loadAy38910Device(HBC56Device* device, const uint8_t* buffer, uint32_t size)
+{
+  AY38910Device* ayDevice = getAy38910Device(device);
+  if (ayDevice && buffer && size == AY3891X_STATE_SIZE)
+  {
+    for (int i = 0; i < AY3891X_NUM_REGS; ++i)
+    {
+      ayDevice->shadowRegs[i] = buffer[i];
+      pushWrite(ayDevice, (uint8_t)i, buffer[i]);
+      hbc56AudioNoteWrite(ayDevice->chip, (uint8_t)i, buffer[i]);
+    }
+    ayDevice->regAddr = buffer[AY3891X_NUM_REGS];
+    return 1;
+  }
+  return 0;
+}
+
+/* Function:  setAy38910Quality
+ * --------------------
+ * select the synthesis quality. the registers carry over
+ */
+void setAy38910Quality(HBC56Device* device, AY38910Quality quality)
+{
+  AY38910Device* ayDevice = getAy38910Device(device);
+  if (ayDevice)
+  {
+    AY38910Synth* synth = ay38910SynthCreate(ayDevice->clockFreq, ayDevice->sampleRate, quality);
+    if (!synth) return;
+
+    for (int i = 0; i < AY3891X_NUM_REGS; ++i)
+    {
+      ay38910SynthWrite(synth, (uint8_t)i, ayDevice->appliedRegs[i]);
+    }
+
+    ay38910SynthDestroy(ayDevice->synth);
+    ayDevice->synth = synth;
+  }
+}
@@ -13,6 +13,7 @@
 #define _HBC56_AY38910_DEVICE_H_
 
 #include "device.h"
+#include "ay38910_synth.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -24,6 +25,12 @@ extern "C" {
  */
 HBC56Device createAY38910Device(uint16_t baseAddr, int clockFreq, int sampleRate, int channels);
 
+/* Function:  setAy38910Quality
+ * --------------------
+ * select the synthesis quality
+ */
+void setAy38910Quality(HBC56Device* device, AY38910Quality quality);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,885 @@
+/*
+ * Troy's HBC-56 Emulator - AY-3-8910 synthesis
+ *
+ * Copyright (c) 2021 Troy Schrapel
+ *
+ * This code is licensed under the MIT license
+ *
+ * https://github.com/visrealm/hbc-56/emulator
+ *
+ */
+
+#include "ay38910_synth.h"
+
+#include "emu2149.h"
+
+#include "SDL.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define AY_NUM_REGS        16
+#define AY_NUM_CHANNELS    3
+
+#define AY_REG_NOISE       6
+#define AY_REG_MIXER       7
+#define AY_REG_AMPLITUDE   8
+#define AY_REG_ENV_FINE    11
+#define AY_REG_ENV_COARSE  12
+#define AY_REG_ENV_SHAPE   13
+
+/* the generators are clocked at clock / 8. a tone output toggles every period
+   ticks, the noise lfsr steps every 2 * period ticks and the envelope steps
+   every 2 * period ticks (16 steps per cycle. fE = clock / (256 * period)) */
+#define AY_TICK_DIVIDER    8
+
+/* band-limited step table */
+#define BLEP_PHASES        64
+#define BLEP_TAPS          16
+#define BLEP_HALF_WIDTH    (BLEP_TAPS / 2 - 1)
+#define BLEP_CUTOFF        0.9          /* fraction of the output nyquist */
+
+/* polyphase resampler */
+#define POLY_PHASES        64
+#define POLY_HISTORY       128          /* must be a power of 2 and >= the taps */
+#define POLY_HISTORY_MASK  (POLY_HISTORY - 1)
+
+#define AY_PI              3.14159265358979323846
+
+/* ay-3-8910 dac levels (measured), normalised */
+static const float ayLevels[16] = {
+  0.0000f, 0.0100f, 0.0145f, 0.0211f, 0.0307f, 0.0455f, 0.0644f, 0.1074f,
+  0.1266f, 0.2050f, 0.2922f, 0.3728f, 0.4925f, 0.6353f, 0.8056f, 1.0000f
+};
+
+/* writable bits of each register */
+static const uint8_t ayRegMasks[AY_NUM_REGS] = {
+  0xff, 0x0f, 0xff, 0x0f, 0xff, 0x0f, 0x1f, 0xff,
+  0x1f, 0x1f, 0x1f, 0xff, 0xff, 0x0f, 0xff, 0xff
+};
+
+static const char* qualityNames[AY38910_QUALITY_COUNT] = { "legacy", "blep", "low", "medium", "high" };
+static const int qualityTaps[AY38910_QUALITY_COUNT] = { 0, 0, 16, 32, 64 };
+
+/* band-limited step. blepTable[phase][tap] is the portion of a unit step
+   (occurring phase / BLEP_PHASES into a sample) falling on each tap */
+static float blepTable[BLEP_PHASES][BLEP_TAPS];
+static int blepTableReady = 0;
+
+struct AY38910Synth
+{
+  AY38910Quality quality;
+  uint8_t        regs[AY_NUM_REGS];
+
+  /* generators */
+  uint32_t       tonePeriod[AY_NUM_CHANNELS];
+  uint32_t       toneCount[AY_NUM_CHANNELS];
+  uint8_t        toneOut[AY_NUM_CHANNELS];
+  uint32_t       noisePeriod;        /* ticks */
+  uint32_t       noiseCount;
+  uint32_t       noiseLfsr;
+  uint8_t        noiseOut;
+  uint32_t       envPeriod;          /* ticks */
+  uint32_t       envCount;
+  uint8_t        envPos;             /* 0 - 15 within the current cycle */
+  uint8_t        envInvert;          /* 0x00 attack, 0x0f decay */
+  uint8_t        envHolding;
+  uint8_t        envLevel;
+
+  float          amp[AY_NUM_CHANNELS];
+
+  /* band-limited steps */
+  double         tickStep;           /* output samples per tick */
+  double         blepTime;           /* next tick (output samples) */
+  double         blepSum[AY_NUM_CHANNELS];
+  int            blepSettled;        /* no steps in flight */
+  float          blepBuf[AY_NUM_CHANNELS][AY38910_SYNTH_MAX_SAMPLES + BLEP_TAPS];
+
+  /* polyphase resampler */
+  int            polyTaps;
+  double         polyStep;           /* ticks per output sample */
+  double         polyPos;
+  int            polyWrite;
+  float         *polyTable;          /* [POLY_PHASES][polyTaps] */
+  float          polyHist[AY_NUM_CHANNELS][POLY_HISTORY * 2];
+
+  /* legacy */
+  PSG           *psg;
+};
+
+
+/* Function:  windowedSinc
+ * --------------------
+ * low-pass kernel. cutoff is in cycles per sample * 2. zero beyond halfWidth
+ */
+static double windowedSinc(double x, double cutoff, double halfWidth)
+{
+  if (fabs(x) >= halfWidth) return 0.0;
+
+  double sinc = (fabs(x) < 1e-9) ? 1.0 : sin(AY_PI * cutoff * x) / (AY_PI * cutoff * x);
+  double n = (x + halfWidth) / (2.0 * halfWidth);
+  double blackman = 0.42 - 0.5 * cos(2.0 * AY_PI * n) + 0.08 * cos(4.0 * AY_PI * n);
+  return cutoff * sinc * blackman;
+}
+
+/* Function:  buildBlepTable
+ * --------------------
+ * integrate the kernel over each tap for each step phase
+ */
+static void buildBlepTable()
+{
+  if (blepTableReady) return;
+
+  const int steps = 32;
+  for (int p = 0; p < BLEP_PHASES; ++p)
+  {
+    double phase = p / (double)BLEP_PHASES;
+    double total = 0.0;
+
+    for (int k = 0; k < BLEP_TAPS; ++k)
+    {
+      double from = k - 1 - phase - BLEP_HALF_WIDTH;
+      double sum = 0.0;
+      for (int s = 0; s < steps; ++s)
+      {
+        sum += windowedSinc(from + (s + 0.5) / steps, BLEP_CUTOFF, BLEP_HALF_WIDTH);
+      }
+      blepTable[p][k] = (float)(sum / steps);
+      total += sum / steps;
+    }
+
+    /* each step must add exactly its delta */
+    for (int k = 0; k < BLEP_TAPS; ++k)
+    {
+      blepTable[p][k] = (float)(blepTable[p][k] / total);
+    }
+  }
+  blepTableReady = 1;
+}
+
+/* Function:  buildPolyTable
+ * --------------------
+ * windowed sinc coefficients for each phase. cutoff just below the output
+ * nyquist. coefficients are in history order (oldest first)
+ */
+static int buildPolyTable(AY38910Synth* synth, int taps, double inRate, double outRate)
+{
+  synth->polyTable = (float*)malloc(POLY_PHASES * taps * sizeof(float));
+  if (!synth->polyTable) return 0;
+
+  double cutoff = 0.9 * outRate / inRate;
+  if (cutoff > 0.9) cutoff = 0.9;
+
+  double delay = taps / 2;
+  double halfWidth = taps / 2 - 1;
+
+  for (int p = 0; p < POLY_PHASES; ++p)
+  {
+    float* coef = synth->polyTable + p * taps;
+    double pos = p / (double)POLY_PHASES;
+    double total = 0.0;
+
+    for (int j = 0; j < taps; ++j)
+    {
+      double c = windowedSinc((taps - 1 - j) + pos - delay, cutoff, halfWidth);
+      coef[j] = (float)c;
+      total += c;
+    }
+
+    for (int j = 0; j < taps; ++j)
+    {
+      coef[j] = (float)(coef[j] / total);
+    }
+  }
+
+  synth->polyTaps = taps;
+  synth->polyStep = inRate / outRate;
+  return 1;
+}
+
+/* Function:  ay38910SynthCreate
+ * --------------------
+ * create an AY-3-8910 synthesizer
+ */
+AY38910Synth* ay38910SynthCreate(int clockFreq, int sampleRate, AY38910Quality quality)
+{
+  AY38910Synth* synth = (AY38910Synth*)malloc(sizeof(AY38910Synth));
+  if (!synth) return NULL;
+
+  SDL_memset(synth, 0, sizeof(AY38910Synth));
+  if (quality < 0 || quality >= AY38910_QUALITY_COUNT) quality = AY38910_QUALITY_BLEP;
+  synth->quality = quality;
+
+  double tickRate = clockFreq / (double)AY_TICK_DIVIDER;
+
+  switch (quality)
+  {
+    case AY38910_QUALITY_LEGACY:
+      synth->psg = PSG_new(clockFreq, sampleRate);
+      break;
+
+    case AY38910_QUALITY_BLEP:
+      buildBlepTable();
+      synth->tickStep = sampleRate / tickRate;
+      break;
+
+    default:
+      if (!buildPolyTable(synth, qualityTaps[quality], tickRate, sampleRate))
+      {
+        free(synth);
+        return NULL;
+      }
+      break;
+  }
+
+  ay38910SynthReset(synth);
+
+  return synth;
+}
+
+/* Function:  ay38910SynthDestroy
+ * --------------------
+ * destroy a synthesizer
+ */
+void ay38910SynthDestroy(AY38910Synth* synth)
+{
+  if (synth)
+  {
+    if (synth->psg) PSG_delete(synth->psg);
+    free(synth->polyTable);
+    free(synth);
+  }
+}
+
+/* Function:  updatePeriods
+ * --------------------
+ * derive the generator periods (in ticks) from the registers
+ */
+static void updatePeriods(AY38910Synth* synth)
+{
+  for (int c = 0; c < AY_NUM_CHANNELS; ++c)
+  {
+    synth->tonePeriod[c] = synth->regs[c * 2] | (synth->regs[c * 2 + 1] << 8);
+    if (synth->tonePeriod[c] == 0) synth->tonePeriod[c] = 1;
+  }
+
+  synth->noisePeriod = synth->regs[AY_REG_NOISE];
+  if (synth->noisePeriod == 0) synth->noisePeriod = 1;
+  synth->noisePeriod *= 2;
+
+  synth->envPeriod = synth->regs[AY_REG_ENV_FINE] | (synth->regs[AY_REG_ENV_COARSE] << 8);
+  if (synth->envPeriod == 0) synth->envPeriod = 1;
+  synth->envPeriod *= 2;
+}
+
+/* Function:  restartEnvelope
+ * --------------------
+ * envelope shape written. start a new cycle
+ */
+static void restartEnvelope(AY38910Synth* synth)
+{
+  synth->envPos = 0;
+  synth->envCount = 0;
+  synth->envHolding = 0;
+  synth->envInvert = (synth->regs[AY_REG_ENV_SHAPE] & 0x04) ? 0x00 : 0x0f;
+  synth->envLevel = synth->envInvert;
+}
+
+/* Function:  stepEnvelope
+ * --------------------
+ * advance the envelope by one step
+ */
+static void stepEnvelope(AY38910Synth* synth)
+{
+  if (synth->envHolding) return;
+
+  if (++synth->envPos > 15)
+  {
+    uint8_t shape = synth->regs[AY_REG_ENV_SHAPE];
+
+    if (!(shape & 0x08))          /* !continue: drop to zero and stay there */
+    {
+      synth->envHolding = 1;
+      synth->envLevel = 0;
+      return;
+    }
+
+    if (shape & 0x02)             /* alternate */
+    {
+      synth->envInvert ^= 0x0f;
+    }
+
+    if (shape & 0x01)             /* hold */
+    {
+      synth->envHolding = 1;
+      synth->envLevel = 0x0f ^ synth->envInvert;
+      return;
+    }
+
+    synth->envPos = 0;
+  }
+
+  synth->envLevel = synth->envPos ^ synth->envInvert;
+}
+
+/* Function:  stepNoise
+ * --------------------
+ * advance the 17-bit noise lfsr
+ */
+static inline void stepNoise(AY38910Synth* synth)
+{
+  uint32_t bit = (synth->noiseLfsr ^ (synth->noiseLfsr >> 3)) & 1;
+  synth->noiseLfsr = (synth->noiseLfsr >> 1) | (bit << 16);
+  synth->noiseOut = synth->noiseLfsr & 1;
+}
+
+/* Function:  tick
+ * --------------------
+ * clock the generators once and update the channel outputs
+ */
+static inline void tick(AY38910Synth* synth)
+{
+  for (int c = 0; c < AY_NUM_CHANNELS; ++c)
+  {
+    if (++synth->toneCount[c] >= synth->tonePeriod[c])
+    {
+      synth->toneCount[c] = 0;
+      synth->toneOut[c] ^= 1;
+    }
+  }
+
+  if (++synth->noiseCount >= synth->noisePeriod)
+  {
+    synth->noiseCount = 0;
+    stepNoise(synth);
+  }
+
+  if (++synth->envCount >= synth->envPeriod)
+  {
+    synth->envCount = 0;
+    stepEnvelope(synth);
+  }
+
+  /* mixer bits disable (force high) the tone and noise inputs */
+  uint8_t mixer = synth->regs[AY_REG_MIXER];
+  for (int c = 0; c < AY_NUM_CHANNELS; ++c)
+  {
+    int gate = (synth->toneOut[c] | (mixer >> c)) & (synth->noiseOut | (mixer >> (c + 3))) & 1;
+    uint8_t amplitude = synth->regs[AY_REG_AMPLITUDE + c];
+    int level = (amplitude & 0x10) ? synth->envLevel : (amplitude & 0x0f);
+    synth->amp[c] = gate ? ayLevels[level] : 0.0f;
+  }
+}
+
+/* Function:  ay38910SynthReset
+ * --------------------
+ * reset the registers and generators
+ */
+void ay38910SynthReset(AY38910Synth* synth)
+{
+  if (!synth) return;
+
+  SDL_memset(synth->regs, 0, sizeof(synth->regs));
+  SDL_memset(synth->toneCount, 0, sizeof(synth->toneCount));
+  SDL_memset(synth->toneOut, 0, sizeof(synth->toneOut));
+  synth->noiseCount = 0;
+  synth->noiseLfsr = 1;
+  synth->noiseOut = 1;
+
+  updatePeriods(synth);
+  restartEnvelope(synth);
+
+  if (synth->psg) PSG_reset(synth->psg);
+}
+
+/* Function:  ay38910SynthWrite
+ * --------------------
+ * write a register. takes effect from the next rendered sample
+ */
+void ay38910SynthWrite(AY38910Synth* synth, uint8_t reg, uint8_t value)
+{
+  if (!synth || reg >= AY_NUM_REGS) return;
+
+  if (synth->psg)
+  {
+    PSG_writeReg(synth->psg, reg, value);
+  }
+
+  synth->regs[reg] = value & ayRegMasks[reg];
+
+  if (reg == AY_REG_ENV_SHAPE)
+  {
+    restartEnvelope(synth);
+  }
+  else if (reg <= AY_REG_NOISE || reg == AY_REG_ENV_FINE || reg == AY_REG_ENV_COARSE)
+  {
+    updatePeriods(synth);
+  }
+}
+
+/* Function:  isStatic
+ * --------------------
+ * can any channel's output change before the next register write? each
+ * channel must be silent, or have a fixed level with tone and noise both
+ * disabled (dc). the current outputs must already be at those levels
+ */
+static int isStatic(AY38910Synth* synth)
+{
+  uint8_t mixer = synth->regs[AY_REG_MIXER];
+  for (int c = 0; c < AY_NUM_CHANNELS; ++c)
+  {
+    uint8_t amplitude = synth->regs[AY_REG_AMPLITUDE + c];
+    int level = amplitude & 0x0f;
+    if (amplitude & 0x10)
+    {
+      if (!synth->envHolding) return 0;
+      level = synth->envLevel;
+    }
+
+    if (level != 0 && !((mixer >> c) & (mixer >> (c + 3)) & 1)) return 0;
+    if (synth->amp[c] != ayLevels[level]) return 0;
+  }
+  return 1;
+}
+
+/* Function:  advanceCounter
+ * --------------------
+ * advance a generator counter by ticks. returns how many times it wrapped
+ */
+static uint32_t advanceCounter(uint32_t* count, uint32_t period, uint32_t ticks)
+{
+  uint32_t wraps = 0;
+  if (ticks == 0) return 0;
+
+  /* period was shortened below the count. it wraps on the next tick */
+  if (*count >= period)
+  {
+    *count = 0;
+    ++wraps;
+    --ticks;
+  }
+
+  uint64_t total = (uint64_t)*count + ticks;
+  *count = (uint32_t)(total % period);
+  return wraps + (uint32_t)(total / period);
+}
+
+/* Function:  advanceGenerators
+ * --------------------
+ * advance the generators by ticks without producing output. keeps the tone,
+ * noise and envelope phases where full synthesis would have left them
+ */
+static void advanceGenerators(AY38910Synth* synth, uint32_t ticks)
+{
+  for (int c = 0; c < AY_NUM_CHANNELS; ++c)
+  {
+    synth->toneOut[c] ^= advanceCounter(&synth->toneCount[c], synth->tonePeriod[c], ticks) & 1;
+  }
+
+  uint32_t noiseSteps = advanceCounter(&synth->noiseCount, synth->noisePeriod, ticks);
+  while (noiseSteps--)
+  {
+    stepNoise(synth);
+  }
+
+  uint32_t envSteps = advanceCounter(&synth->envCount, synth->envPeriod, ticks);
+  while (envSteps-- && !synth->envHolding)
+  {
+    stepEnvelope(synth);
+  }
+}
+
+/* Function:  fillStatic
+ * --------------------
+ * output the (constant) channel levels
+ */
+static void fillStatic(AY38910Synth* synth, float* out[3], int numSamples)
+{
+  for (int c = 0; c < AY_NUM_CHANNELS; ++c)
+  {
+    float level = synth->amp[c];
+    float* dest = out[c];
+    for (int i = 0; i < numSamples; ++i)
+    {
+      dest[i] = level;
+    }
+  }
+}
+
+/* Function:  renderBlep
+ * --------------------
+ * each change in a channel's output is added as a band-limited step at the
+ * (fractional) sample it happened on. the output is the running sum
+ */
+static void renderBlep(AY38910Synth* synth, float* out[3], int numSamples)
+{
+  double t = synth->blepTime;
+
+  /* nothing can change and nothing in flight? skip the synthesis */
+  if (synth->blepSettled && isStatic(synth))
+  {
+    uint32_t ticks = 0;
+    if (t < numSamples)
+    {
+      ticks = (uint32_t)ceil((numSamples - t) / synth->tickStep);
+      t += ticks * synth->tickStep;
+    }
+    synth->blepTime = t - numSamples;
+    advanceGenerators(synth, ticks);
+    fillStatic(synth, out, numSamples);
+    return;
+  }
+
+  while (t < numSamples)
+  {
+    float prev0 = synth->amp[0], prev1 = synth->amp[1], prev2 = synth->amp[2];
+    tick(synth);
+
+    if (synth->amp[0] != prev0 || synth->amp[1] != prev1 || synth->amp[2] != prev2)
+    {
+      int i = (int)t;
+      const float* step = blepTable[(int)((t - i) * BLEP_PHASES)];
+      float delta[AY_NUM_CHANNELS] = { synth->amp[0] - prev0, synth->amp[1] - prev1, synth->amp[2] - prev2 };
+
+      for (int c = 0; c < AY_NUM_CHANNELS; ++c)
+      {
+        if (delta[c] == 0.0f) continue;
+        float* buf = synth->blepBuf[c] + i;
+        for (int k = 0; k < BLEP_TAPS; ++k)
+        {
+          buf[k] += delta[c] * step[k];
+        }
+      }
+    }
+    t += synth->tickStep;
+  }
+  synth->blepTime = t - numSamples;
+
+  synth->blepSettled = 1;
+  for (int c = 0; c < AY_NUM_CHANNELS; ++c)
+  {
+    float* buf = synth->blepBuf[c];
+    float* dest = out[c];
+    double sum = synth->blepSum[c];
+
+    for (int i = 0; i < numSamples; ++i)
+    {
+      sum += buf[i];
+      dest[i] = (float)sum;
+    }
+
+    /* carry the steps which spill into the next block */
+    memmove(buf, buf + numSamples, BLEP_TAPS * sizeof(float));
+    memset(buf + BLEP_TAPS, 0, numSamples * sizeof(float));
+
+    /* nothing in flight? snap to the exact level so rounding can't accumulate */
+    int settled = 1;
+    for (int k = 0; k < BLEP_TAPS; ++k)
+    {
+      if (buf[k] != 0.0f) { settled = 0; break; }
+    }
+    synth->blepSum[c] = settled ? synth->amp[c] : sum;
+    synth->blepSettled &= settled;
+  }
+}
+
+/* Function:  renderPoly
+ * --------------------
+ * generate at the chip tick rate (where every edge is exact) and resample
+ * to the output rate with a polyphase windowed sinc
+ */
+static void renderPoly(AY38910Synth* synth, float* out[3], int numSamples)
+{
+  const int taps = synth->polyTaps;
+
+  /* nothing can change and the filter history is flat? skip the synthesis */
+  if (isStatic(synth))
+  {
+    int flat = 1;
+    for (int c = 0; flat && c < AY_NUM_CHANNELS; ++c)
+    {
+      const float* x = synth->polyHist[c] + synth->polyWrite + POLY_HISTORY - (taps - 1);
+      for (int j = 0; j < taps; ++j)
+      {
+        if (x[j] != synth->amp[c]) { flat = 0; break; }
+      }
+    }
+
+    if (flat)
+    {
+      double pos = synth->polyPos + numSamples * synth->polyStep;
+      uint32_t ticks = (uint32_t)pos;
+      synth->polyPos = pos - ticks;
+      advanceGenerators(synth, ticks);
+      fillStatic(synth, out, numSamples);
+      return;
+    }
+  }
+
+
+  for (int i = 0; i < numSamples; ++i)
+  {
+    synth->polyPos += synth->polyStep;
+    while (synth->polyPos >= 1.0)
+    {
+      tick(synth);
+
+      /* history is written twice so the filter always reads a contiguous run */
+      int w = (synth->polyWrite + 1) & POLY_HISTORY_MASK;
+      for (int c = 0; c < AY_NUM_CHANNELS; ++c)
+      {
+        synth->polyHist[c][w] = synth->polyHist[c][w + POLY_HISTORY] = synth->amp[c];
+      }
+      synth->polyWrite = w;
+      synth->polyPos -= 1.0;
+    }
+
+    const float* coef = synth->polyTable + (int)(synth->polyPos * POLY_PHASES) * taps;
+    int start = synth->polyWrite + POLY_HISTORY - (taps - 1);
+
+    for (int c = 0; c < AY_NUM_CHANNELS; ++c)
+    {
+      const float* x = synth->polyHist[c] + start;
+      float acc = 0.0f;
+      for (int j = 0; j < taps; ++j)
+      {
+        acc += x[j] * coef[j];
+      }
+      out[c][i] = acc;
+    }
+  }
+}
+
+/* Function:  renderLegacy
+ * --------------------
+ * emu2149's own rate conversion
+ */
+static void renderLegacy(AY38910Synth* synth, float* out[3], int numSamples)
+{
+  PSG* psg = synth->psg;
+  for (int i = 0; i < numSamples; ++i)
+  {
+    PSG_calc(psg);
+    out[0][i] = psg->ch_out[0] / 8192.0f;
+    out[1][i] = psg->ch_out[1] / 8192.0f;
+    out[2][i] = psg->ch_out[2] / 8192.0f;
+  }
+}
+
+/* Function:  ay38910SynthRender
+ * --------------------
+ * render numSamples of each channel's output
+ */
+void ay38910SynthRender(AY38910Synth* synth, float* out[3], int numSamples)
+{
+  if (!synth || numSamples <= 0) return;
+  if (numSamples > AY38910_SYNTH_MAX_SAMPLES) numSamples = AY38910_SYNTH_MAX_SAMPLES;
+
+  switch (synth->quality)
+  {
+    case AY38910_QUALITY_LEGACY:
+      renderLegacy(synth, out, numSamples);
+      break;
+
+    case AY38910_QUALITY_BLEP:
+      renderBlep(synth, out, numSamples);
+      break;
+
+    default:
+      renderPoly(synth, out, numSamples);
+      break;
+  }
+}
+
+/* Function:  ay38910QualityName
+ * --------------------
+ * name of a quality setting
+ */
+const char* ay38910QualityName(AY38910Quality quality)
+{
+  if (quality < 0 || quality >= AY38910_QUALITY_COUNT) return "unknown";
+  return qualityNames[quality];
+}
+
+/* Function:  ay38910QualityFromName
+ * --------------------
+ * quality setting from its name. returns -1 if not found
+ */
+int ay38910QualityFromName(const char* name)
+{
+  for (int i = 0; name && i < AY38910_QUALITY_COUNT; ++i)
+  {
+    if (SDL_strcasecmp(name, qualityNames[i]) == 0) return i;
+  }
+  return -1;
+}
+
+/* Function:  benchmarkRun
+ * --------------------
+ * seconds taken to render seconds of audio from a register set
+ */
+static double benchmarkRun(int clockFreq, int sampleRate, AY38910Quality quality, const uint8_t* regs, int seconds)
+{
+  float channels[AY_NUM_CHANNELS][AY38910_SYNTH_MAX_SAMPLES];
+  float* out[AY_NUM_CHANNELS] = { channels[0], channels[1], channels[2] };
+
+  AY38910Synth* synth = ay38910SynthCreate(clockFreq, sampleRate, quality);
+  if (!synth) return 0.0;
+
+  for (int r = 0; r < AY_NUM_REGS; ++r)
+  {
+    ay38910SynthWrite(synth, (uint8_t)r, regs[r]);
+  }
+
+  int remaining = seconds * sampleRate;
+  volatile float sink = 0.0f;
+  Uint64 start = SDL_GetPerformanceCounter();
+  while (remaining > 0)
+  {
+    int count = remaining < AY38910_SYNTH_MAX_SAMPLES ? remaining : AY38910_SYNTH_MAX_SAMPLES;
+    ay38910SynthRender(synth, out, count);
+    sink += channels[0][0] + channels[1][0] + channels[2][0];
+    remaining -= count;
+  }
+  double elapsed = (SDL_GetPerformanceCounter() - start) / (double)SDL_GetPerformanceFrequency();
+
+  ay38910SynthDestroy(synth);
+  return elapsed;
+}
+
+/* Function:  ay38910SynthBenchmark
+ * --------------------
+ * render a busy and a silent register configuration at each quality setting
+ * and log the host time taken per second of audio
+ */
+void ay38910SynthBenchmark(int clockFreq, int sampleRate)
+{
+  static const uint8_t busyRegs[AY_NUM_REGS] = {
+    0xfe, 0x00,       /* tone a: low */
+    0x50, 0x00,       /* tone b: mid */
+    0x03, 0x00,       /* tone c: very high. aliases without band limiting */
+    0x05,             /* noise period */
+    0x18,             /* tones on. noise on c */
+    0x0f, 0x10, 0x0a, /* a: fixed, b: envelope, c: fixed */
+    0x00, 0x02,       /* envelope period */
+    0x0e,             /* triangle */
+    0x00, 0x00
+  };
+  static const uint8_t silentRegs[AY_NUM_REGS] = {
+    0xfe, 0x00, 0x50, 0x00, 0x03, 0x00, 0x05,
+    0x38,             /* tones on. volumes all zero */
+    0x00, 0x00, 0x00,
+    0x00, 0x02, 0x0e, 0x00, 0x00
+  };
+  const int seconds = 10;
+
+  SDL_Log("AY-3-8910 synthesis benchmark: %d seconds at %d Hz (clock %d Hz)", seconds, sampleRate, clockFreq);
+  SDL_Log("  quality  ms per second of audio (busy / silent)");
+
+  for (int q = 0; q < AY38910_QUALITY_COUNT; ++q)
+  {
+    double busy = benchmarkRun(clockFreq, sampleRate, (AY38910Quality)q, busyRegs, seconds);
+    double silent = benchmarkRun(clockFreq, sampleRate, (AY38910Quality)q, silentRegs, seconds);
+
+    SDL_Log("  %-8s %8.3f / %8.3f", qualityNames[q], busy * 1000.0 / seconds, silent * 1000.0 / seconds);
+  }
+}
+
+/* Function:  envelopeCycles
+ * --------------------
+ * render a repeating sawtooth envelope on channel a and count its cycles.
+ * returns cycles per second
+ */
+static double envelopeCycles(int clockFreq, int sampleRate, AY38910Quality quality, const uint8_t* regs, int seconds)
+{
+  float channels[AY_NUM_CHANNELS][AY38910_SYNTH_MAX_SAMPLES];
+  float* out[AY_NUM_CHANNELS] = { channels[0], channels[1], channels[2] };
+
+  int numSamples = seconds * sampleRate;
+  float* level = (float*)SDL_malloc(numSamples * sizeof(float));
+  AY38910Synth* synth = ay38910SynthCreate(clockFreq, sampleRate, quality);
+  if (!synth || !level)
+  {
+    ay38910SynthDestroy(synth);
+    SDL_free(level);
+    return 0.0;
+  }
+
+  for (int r = 0; r < AY_NUM_REGS; ++r)
+  {
+    ay38910SynthWrite(synth, (uint8_t)r, regs[r]);
+  }
+
+  for (int rendered = 0; rendered < numSamples; )
+  {
+    int count = numSamples - rendered;
+    if (count > AY38910_SYNTH_MAX_SAMPLES) count = AY38910_SYNTH_MAX_SAMPLES;
+    ay38910SynthRender(synth, out, count);
+    SDL_memcpy(level + rendered, channels[0], count * sizeof(float));
+    rendered += count;
+  }
+
+  /* each cycle decays then jumps back up. count the rises (with hysteresis
+     so the band-limited edges and their ringing count once) */
+  float minLevel = level[0], maxLevel = level[0];
+  for (int i = 1; i < numSamples; ++i)
+  {
+    if (level[i] < minLevel) minLevel = level[i];
+    if (level[i] > maxLevel) maxLevel = level[i];
+  }
+  float low = minLevel + (maxLevel - minLevel) * 0.25f;
+  float high = minLevel + (maxLevel - minLevel) * 0.75f;
+
+  int cycles = 0;
+  int armed = 0;
+  for (int i = 0; i < numSamples; ++i)
+  {
+    if (level[i] < low) armed = 1;
+    else if (armed && level[i] > high)
+    {
+      ++cycles;
+      armed = 0;
+    }
+  }
+
+  ay38910SynthDestroy(synth);
+  SDL_free(level);
+  return cycles / (double)seconds;
+}
+
+/* Function:  ay38910SynthCheck
+ * --------------------
+ * check the envelope rate of each quality setting against the legacy
+ * (emu2149) path and the datasheet. returns 1 if they all match
+ */
+int ay38910SynthCheck(int clockFreq, int sampleRate)
+{
+  static const uint8_t envRegs[AY_NUM_REGS] = {
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x3f,             /* tones and noise off. the output follows the envelope */
+    0x10, 0x00, 0x00, /* a: envelope */
+    0x20, 0x00,       /* envelope period */
+    0x08,             /* repeating sawtooth (decay) */
+    0x00, 0x00
+  };
+  const int seconds = 4;
+  const double tolerance = 0.01;
+
+  int period = envRegs[AY_REG_ENV_FINE] | (envRegs[AY_REG_ENV_COARSE] << 8);
+  double expected = clockFreq / (256.0 * period);
+  double legacy = envelopeCycles(clockFreq, sampleRate, AY38910_QUALITY_LEGACY, envRegs, seconds);
+  int ok = 1;
+
+  SDL_Log("AY-3-8910 envelope check: expected %.2f Hz", expected);
+  for (int q = 0; q < AY38910_QUALITY_COUNT; ++q)
+  {
+    double rate = (q == AY38910_QUALITY_LEGACY) ? legacy :
+                  envelopeCycles(clockFreq, sampleRate, (AY38910Quality)q, envRegs, seconds);
+    int match = fabs(rate / expected - 1.0) <= tolerance &&
+                (legacy <= 0.0 || fabs(rate / legacy - 1.0) <= tolerance);
+    SDL_Log("  %-8s %8.2f Hz %s", qualityNames[q], rate, match ? "ok" : "MISMATCH");
+    ok &= match;
+  }
+  return ok;
+}
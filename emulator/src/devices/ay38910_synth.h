@@ -0,0 +1,98 @@
+/*
+ * Troy's HBC-56 Emulator - AY-3-8910 synthesis
+ *
+ * Copyright (c) 2021 Troy Schrapel
+ *
+ * This code is licensed under the MIT license
+ *
+ * https://github.com/visrealm/hbc-56/emulator
+ *
+ */
+
+#ifndef _HBC56_AY38910_SYNTH_H_
+#define _HBC56_AY38910_SYNTH_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* maximum samples per render call */
+#define AY38910_SYNTH_MAX_SAMPLES 512
+
+/* synthesis quality */
+typedef enum
+{
+  AY38910_QUALITY_LEGACY,     /* emu2149 internal rate conversion */
+  AY38910_QUALITY_BLEP,       /* band-limited steps at the output rate (default) */
+  AY38910_QUALITY_LOW,        /* generated at the chip rate. polyphase resampler. 16 taps */
+  AY38910_QUALITY_MEDIUM,     /* 32 taps */
+  AY38910_QUALITY_HIGH,       /* 64 taps */
+  AY38910_QUALITY_COUNT
+} AY38910Quality;
+
+typedef struct AY38910Synth AY38910Synth;
+
+/* Function:  ay38910SynthCreate
+ * --------------------
+ * create an AY-3-8910 synthesizer
+ */
+AY38910Synth* ay38910SynthCreate(int clockFreq, int sampleRate, AY38910Quality quality);
+
+/* Function:  ay38910SynthDestroy
+ * --------------------
+ * destroy a synthesizer
+ */
+void ay38910SynthDestroy(AY38910Synth* synth);
+
+/* Function:  ay38910SynthReset
+ * --------------------
+ * reset the registers and generators
+ */
+void ay38910SynthReset(AY38910Synth* synth);
+
+/* Function:  ay38910SynthWrite
+ * --------------------
+ * write a register. takes effect from the next rendered sample
+ */
+void ay38910SynthWrite(AY38910Synth* synth, uint8_t reg, uint8_t value);
+
+/* Function:  ay38910SynthRender
+ * --------------------
+ * render numSamples (up to AY38910_SYNTH_MAX_SAMPLES) of each channel's
+ * output (0.0 to 1.0) to out[0], out[1] and out[2]
+ */
+void ay38910SynthRender(AY38910Synth* synth, float* out[3], int numSamples);
+
+/* Function:  ay38910QualityName
+ * --------------------
+ * name of a quality setting
+ */
+const char* ay38910QualityName(AY38910Quality quality);
+
+/* Function:  ay38910QualityFromName
+ * --------------------
+ * quality setting from its name. returns -1 if not found
+ */
+int ay38910QualityFromName(const char* name);
+
+/* Function:  ay38910SynthBenchmark
+ * --------------------
+ * render a busy and a silent register configuration at each quality setting
+ * and log the host time taken per second of audio
+ */
+void ay38910SynthBenchmark(int clockFreq, int sampleRate);
+
+/* Function:  ay38910SynthCheck
+ * --------------------
+ * check the envelope rate of each quality setting against the legacy
+ * (emu2149) path and the datasheet. returns 1 if they all match
+ */
+int ay38910SynthCheck(int clockFreq, int sampleRate);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
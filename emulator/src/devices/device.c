@@ -30,6 +30,8 @@ HBC56Device createDevice(const char* name)
   device.renderFn = NULL;
   device.audioFn = NULL;
   device.eventFn = NULL;
+  device.saveFn = NULL;
+  device.loadFn = NULL;
   device.output = NULL;
   device.data = NULL;
   device.visible = true;
@@ -135,4 +137,31 @@ void eventDevice(HBC56Device* device, SDL_Event* evt)
   {
     device->eventFn(device, evt);
   }
+}
+
+/* Function:  saveDevice
+ * --------------------
+ * save device state to buffer (buffer may be NULL to query the size)
+ * returns the size of the state (0 if the device has no state to save)
+ */
+uint32_t saveDevice(HBC56Device* device, uint8_t* buffer, uint32_t size)
+{
+  if (device && device->saveFn)
+  {
+    return device->saveFn(device, buffer, size);
+  }
+  return 0;
+}
+
+/* Function:  loadDevice
+ * --------------------
+ * load device state previously saved with saveDevice
+ */
+uint8_t loadDevice(HBC56Device* device, const uint8_t* buffer, uint32_t size)
+{
+  if (device && device->loadFn)
+  {
+    return device->loadFn(device, buffer, size);
+  }
+  return 0;
 }
\ No newline at end of file
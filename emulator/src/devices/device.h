@@ -74,6 +74,18 @@ typedef void (*DeviceAudioFn)(HBC56Device*, float*, int);
 /* event function pointer */
 typedef void (*DeviceEventFn)(HBC56Device*, SDL_Event*);
 
+/* save state function pointer
+     uint8_t* buffer: buffer to save the state to (NULL to query the size)
+     uint32_t size:   size of buffer
+     returns size of the state in bytes (0 if not saved) */
+typedef uint32_t (*DeviceSaveFn)(HBC56Device*, uint8_t*, uint32_t);
+
+/* load state function pointer
+     const uint8_t* buffer: state previously saved by the save function
+     uint32_t size:         size of buffer
+     returns 1 if ok, 0 if not */
+typedef uint8_t (*DeviceLoadFn)(HBC56Device*, const uint8_t*, uint32_t);
+
 /* device struct */
 struct HBC56Device
 {
@@ -87,6 +99,8 @@ struct HBC56Device
   DeviceRenderFn    renderFn;
   DeviceAudioFn     audioFn;
   DeviceEventFn     eventFn;
+  DeviceSaveFn      saveFn;
+  DeviceLoadFn      loadFn;
 
   void             *data;         /* private data */
 
@@ -149,6 +163,19 @@ void renderAudioDevice(HBC56Device* device, float *buffer, int numSamples);
  */
 void eventDevice(HBC56Device* device, SDL_Event *evt);
 
+/* Function:  saveDevice
+ * --------------------
+ * save device state to buffer (buffer may be NULL to query the size)
+ * returns the size of the state (0 if the device has no state to save)
+ */
+uint32_t saveDevice(HBC56Device* device, uint8_t *buffer, uint32_t size);
+
+/* Function:  loadDevice
+ * --------------------
+ * load device state previously saved with saveDevice
+ */
+uint8_t loadDevice(HBC56Device* device, const uint8_t *buffer, uint32_t size);
+
 #ifdef __cplusplus
 }
 #endif
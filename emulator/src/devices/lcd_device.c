@@ -26,12 +26,18 @@ static void destroyLcdDevice(HBC56Device*);
 static void renderLcdDevice(HBC56Device* device);
 static uint8_t readLcdDevice(HBC56Device*, uint16_t, uint8_t*, uint8_t);
 static uint8_t writeLcdDevice(HBC56Device*, uint16_t, uint8_t);
+static uint32_t saveLcdDevice(HBC56Device*, uint8_t*, uint32_t);
+static uint8_t loadLcdDevice(HBC56Device*, const uint8_t*, uint32_t);
 
 /* lcd constants */
 #define LCD_PIXEL_SCALE     5
 #define LCD_BORDER_X        5
 #define LCD_BORDER_Y        5
 
+/* the lcd state isn't exposed, so we keep a log of writes which can be
+   replayed to restore it. each entry is two bytes: port (0 = cmd, 1 = data), value */
+#define LCD_WRITE_LOG_MAX   (32 * 1024)
+
 typedef enum
 {
   LCD_PIXEL_NONE,
@@ -53,10 +59,16 @@ struct LCDDevice
   uint16_t       dataAddr;
   uint16_t       cmdAddr;
   VrEmuLcd      *lcd;
+  int            lcdCols;
+  int            lcdRows;
   int            pixelsX;
   int            pixelsY;
   uint32_t      *frameBuffer;
+  uint8_t       *pixelState;        /* last rendered lcd pixel states */
   SDL_Texture   *hiddenOutput;
+  uint8_t       *writeLog;
+  uint32_t       writeLogEntries;
+  int            writeLogOverflow;
 };
 typedef struct LCDDevice LCDDevice;
 
@@ -73,29 +85,38 @@ HBC56Device createLcdDevice(LCDType type, uint16_t dataAddr, uint16_t cmdAddr, S
   {
     lcdDevice->dataAddr = dataAddr;
     lcdDevice->cmdAddr = cmdAddr;
+    lcdDevice->writeLog = NULL;
+    lcdDevice->writeLogEntries = 0;
+    lcdDevice->writeLogOverflow = 0;
 
     switch (type)
     {
       case LCD_1602:
-        lcdDevice->lcd = vrEmuLcdNew(16, 2, EmuLcdRomA00);
+        lcdDevice->lcdCols = 16;
+        lcdDevice->lcdRows = 2;
         device.name = "LCD (1602)";
         break;
 
       case LCD_2004:
-        lcdDevice->lcd = vrEmuLcdNew(20, 4, EmuLcdRomA00);
+        lcdDevice->lcdCols = 20;
+        lcdDevice->lcdRows = 4;
         device.name = "LCD (2004)";
         break;
 
       case LCD_GRAPHICS:
-        lcdDevice->lcd = vrEmuLcdNew(128, 64, EmuLcdRomA00);
+        lcdDevice->lcdCols = 128;
+        lcdDevice->lcdRows = 64;
         device.name = "LCD (12864B)";
         break;
 
       default:
-        lcdDevice->lcd = NULL;
+        lcdDevice->lcdCols = 0;
+        lcdDevice->lcdRows = 0;
         break;
     }
 
+    lcdDevice->lcd = lcdDevice->lcdCols ? vrEmuLcdNew(lcdDevice->lcdCols, lcdDevice->lcdRows, EmuLcdRomA00) : NULL;
+
     if (lcdDevice->lcd)
     {
       int nativeWidth = vrEmuLcdNumPixelsX(lcdDevice->lcd);
@@ -106,9 +127,13 @@ HBC56Device createLcdDevice(LCDType type, uint16_t dataAddr, uint16_t cmdAddr, S
 
       size_t numPixels = (size_t)lcdDevice->pixelsX * (size_t)lcdDevice->pixelsY;
       lcdDevice->frameBuffer = malloc(numPixels * sizeof(uint32_t));
+      lcdDevice->pixelState = malloc((size_t)nativeWidth * (size_t)nativeHeight);
       
-      if (lcdDevice->frameBuffer)
+      if (lcdDevice->frameBuffer && lcdDevice->pixelState)
       {
+        /* an invalid state so the first render draws everything */
+        memset(lcdDevice->pixelState, 0xff, (size_t)nativeWidth * (size_t)nativeHeight);
+
         for (size_t i = 0; i < numPixels; ++i)
         {
           lcdDevice->frameBuffer[i] = lcdPal[LCD_PIXEL_NONE];
@@ -126,6 +151,8 @@ HBC56Device createLcdDevice(LCDType type, uint16_t dataAddr, uint16_t cmdAddr, S
       device.readFn = &readLcdDevice;
       device.writeFn = &writeLcdDevice;
       device.renderFn = &renderLcdDevice;
+      device.saveFn = &saveLcdDevice;
+      device.loadFn = &loadLcdDevice;
 
       lcdDevice->hiddenOutput = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING,
                                           lcdDevice->pixelsX, lcdDevice->pixelsY);
@@ -153,6 +180,24 @@ inline static LCDDevice* getLcdDevice(HBC56Device* device)
   return (LCDDevice*)device->data;
 }
 
+/* Function:  resetLcdController
+ * --------------------
+ * replace the lcd controller with a freshly created one and clear the
+ * write log so the log always describes the controller state from power-on
+ */
+static void resetLcdController(LCDDevice* lcdDevice)
+{
+  VrEmuLcd* lcd = vrEmuLcdNew(lcdDevice->lcdCols, lcdDevice->lcdRows, EmuLcdRomA00);
+  if (lcd)
+  {
+    vrEmuLcdDestroy(lcdDevice->lcd);
+    lcdDevice->lcd = lcd;
+  }
+
+  lcdDevice->writeLogEntries = 0;
+  lcdDevice->writeLogOverflow = 0;
+}
+
 /* Function:  resetLcdDevice
  * --------------------
  * reset the lcd data structure
@@ -162,6 +207,7 @@ static void resetLcdDevice(HBC56Device* device)
   LCDDevice* lcdDevice = getLcdDevice(device);
   if (lcdDevice)
   {
+    resetLcdController(lcdDevice);
     device->output = NULL;
   }
 }
@@ -181,6 +227,12 @@ static void destroyLcdDevice(HBC56Device *device)
     free(lcdDevice->frameBuffer);
     lcdDevice->frameBuffer = NULL;
 
+    free(lcdDevice->pixelState);
+    lcdDevice->pixelState = NULL;
+
+    free(lcdDevice->writeLog);
+    lcdDevice->writeLog = NULL;
+
     SDL_DestroyTexture(lcdDevice->hiddenOutput);
     lcdDevice->hiddenOutput = NULL;
   }
@@ -192,7 +244,8 @@ static void destroyLcdDevice(HBC56Device *device)
 
 /* Function:  renderLcdDevice
  * --------------------
- * renders the LCD to the output texture
+ * renders the LCD to the output texture. the texture is only updated when
+ * a pixel has changed
  */
 static void renderLcdDevice(HBC56Device* device)
 {
@@ -210,11 +263,23 @@ static void renderLcdDevice(HBC56Device* device)
                             + (LCD_BORDER_X * LCD_PIXEL_SCALE) 
                             + (LCD_BORDER_Y * LCD_PIXEL_SCALE * lcdDevice->pixelsX);
 
+      uint8_t* statePtr = lcdDevice->pixelState;
+      int changed = 0;
+
       for (int y = 0; y < h; ++y)
       {
-        for (int x = 0; x < w; ++x)
+        for (int x = 0; x < w; ++x, ++statePtr)
         {
-          uint32_t  currentColor = lcdPal[vrEmuLcdPixelState(lcdDevice->lcd, x, y) + 1];
+          uint8_t state = (uint8_t)(vrEmuLcdPixelState(lcdDevice->lcd, x, y) + 1);
+          if (state == *statePtr)
+          {
+            fbPtr += LCD_PIXEL_SCALE;
+            continue;
+          }
+          *statePtr = state;
+          changed = 1;
+
+          uint32_t  currentColor = lcdPal[state];
 
           for (int iy = 0; iy < LCD_PIXEL_SCALE - 1; ++iy)
           {
@@ -234,9 +299,15 @@ static void renderLcdDevice(HBC56Device* device)
 
       void* pixels = NULL;
       int pitch = 0;
-      SDL_LockTexture(device->output, NULL, &pixels, &pitch);
-      memcpy(pixels, lcdDevice->frameBuffer, lcdDevice->pixelsX * lcdDevice->pixelsY * sizeof(uint32_t));
-      SDL_UnlockTexture(device->output);
+      if (changed && SDL_LockTexture(device->output, NULL, &pixels, &pitch) == 0)
+      {
+        size_t rowBytes = lcdDevice->pixelsX * sizeof(uint32_t);
+        for (int y = 0; y < lcdDevice->pixelsY; ++y)
+        {
+          memcpy((uint8_t*)pixels + y * pitch, lcdDevice->frameBuffer + y * lcdDevice->pixelsX, rowBytes);
+        }
+        SDL_UnlockTexture(device->output);
+      }
     }
   }
 }
@@ -271,6 +342,31 @@ static uint8_t readLcdDevice(HBC56Device* device, uint16_t addr, uint8_t *val, u
   return 0;
 }
 
+/* Function:  logLcdWrite
+ * --------------------
+ * record a write so the lcd state can be saved
+ */
+static void logLcdWrite(LCDDevice* lcdDevice, uint8_t isData, uint8_t val)
+{
+  if (lcdDevice->writeLogOverflow)
+    return;
+
+  if (!lcdDevice->writeLog)
+  {
+    lcdDevice->writeLog = malloc(LCD_WRITE_LOG_MAX * 2);
+  }
+
+  if (!lcdDevice->writeLog || lcdDevice->writeLogEntries >= LCD_WRITE_LOG_MAX)
+  {
+    lcdDevice->writeLogOverflow = 1;
+    return;
+  }
+
+  lcdDevice->writeLog[lcdDevice->writeLogEntries * 2] = isData;
+  lcdDevice->writeLog[lcdDevice->writeLogEntries * 2 + 1] = val;
+  ++lcdDevice->writeLogEntries;
+}
+
 /* Function:  writeLcdDevice
  * --------------------
  * write to the lcd. address determines address/register or data
@@ -284,13 +380,96 @@ static uint8_t writeLcdDevice(HBC56Device* device, uint16_t addr, uint8_t val)
     {
       device->output = lcdDevice->hiddenOutput;
       vrEmuLcdSendCommand(lcdDevice->lcd, val);
+      logLcdWrite(lcdDevice, 0, val);
       return 1;
     }
     else if (addr == lcdDevice->dataAddr)
     {
       vrEmuLcdWriteByte(lcdDevice->lcd, val);
+      logLcdWrite(lcdDevice, 1, val);
       return 1;
     }
   }
   return 0;
 }
+
+/* Function:  saveLcdDevice
+ * --------------------
+ * save the lcd write log. fails if the log has overflowed
+ */
+static uint32_t saveLcdDevice(HBC56Device* device, uint8_t* buffer, uint32_t size)
+{
+  LCDDevice* lcdDevice = getLcdDevice(device);
+  if (lcdDevice && !lcdDevice->writeLogOverflow)
+  {
+    uint32_t logSize = lcdDevice->writeLogEntries * 2;
+    if (buffer)
+    {
+      if (size < logSize + 1)
+        return 0;
+
+      buffer[0] = device->output ? 1 : 0;
+      if (logSize) memcpy(buffer + 1, lcdDevice->writeLog, logSize);
+    }
+    return logSize + 1;
+  }
+  return 0;
+}
+
+/* Function:  loadLcdDevice
+ * --------------------
+ * restore the lcd state by replaying a saved write log
+ */
+static uint8_t loadLcdDevice(HBC56Device* device, const uint8_t* buffer, uint32_t size)
+{
+  LCDDevice* lcdDevice = getLcdDevice(device);
+  if (lcdDevice && buffer && size && (size & 0x01) && (size / 2) <= LCD_WRITE_LOG_MAX)
+  {
+    resetLcdController(lcdDevice);
+
+    for (uint32_t i = 1; i < size; i += 2)
+    {
+      if (buffer[i])
+      {
+        vrEmuLcdWriteByte(lcdDevice->lcd, buffer[i + 1]);
+      }
+      else
+      {
+        vrEmuLcdSendCommand(lcdDevice->lcd, buffer[i + 1]);
+      }
+      logLcdWrite(lcdDevice, buffer[i], buffer[i + 1]);
+    }
+    device->output = buffer[0] ? lcdDevice->hiddenOutput : NULL;
+    return 1;
+  }
+  return 0;
+}
+
+/* Function:  readLcdPixels
+ * --------------------
+ * read the current pixel states (LCDPixelState) in to buffer
+ */
+int readLcdPixels(HBC56Device* device, uint8_t* buffer, int bufferSize, int* width, int* height)
+{
+  LCDDevice* lcdDevice = getLcdDevice(device);
+  if (!lcdDevice || !buffer) return 0;
+
+  vrEmuLcdUpdatePixels(lcdDevice->lcd);
+
+  int w = vrEmuLcdNumPixelsX(lcdDevice->lcd);
+  int h = vrEmuLcdNumPixelsY(lcdDevice->lcd);
+  if (w * h > bufferSize) return 0;
+
+  for (int y = 0; y < h; ++y)
+  {
+    for (int x = 0; x < w; ++x)
+    {
+      *(buffer++) = (uint8_t)(vrEmuLcdPixelState(lcdDevice->lcd, x, y) + 1);
+    }
+  }
+
+  if (width) *width = w;
+  if (height) *height = h;
+
+  return w * h;
+}
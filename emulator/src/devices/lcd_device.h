@@ -35,6 +35,14 @@ typedef enum
  */
 HBC56Device createLcdDevice(LCDType type, uint16_t dataAddr, uint16_t cmdAddr, SDL_Renderer *renderer);
 
+/* Function:  readLcdPixels
+ * --------------------
+ * read the current pixel states in to buffer. one byte per pixel:
+ * 0 = no pixel (gap between characters), 1 = off, 2 = on
+ * returns the number of pixels or 0 if the buffer is too small
+ */
+int readLcdPixels(HBC56Device* device, uint8_t* buffer, int bufferSize, int* width, int* height);
+
 #ifdef __cplusplus
 }
 #endif
@@ -17,6 +17,8 @@
 static void destroyMemoryDevice(HBC56Device*);
 static uint8_t readMemoryDevice(HBC56Device*, uint16_t, uint8_t*, uint8_t);
 static uint8_t writeMemoryDevice(HBC56Device*, uint16_t, uint8_t);
+static uint32_t saveMemoryDevice(HBC56Device*, uint8_t*, uint32_t);
+static uint8_t loadMemoryDevice(HBC56Device*, const uint8_t*, uint32_t);
 
 /* memory device data */
 struct MemoryDevice
@@ -57,6 +59,8 @@ static HBC56Device createMemoryDevice(
       device.destroyFn = &destroyMemoryDevice;
       device.readFn = &readMemoryDevice;
       device.writeFn = &writeMemoryDevice;
+      device.saveFn = &saveMemoryDevice;
+      device.loadFn = &loadMemoryDevice;
     }
   }
   else
@@ -95,6 +99,8 @@ HBC56Device createRomDevice(uint32_t startAddr, uint32_t endAddr, const uint8_t*
 {
   HBC56Device device = createMemoryDevice("ROM", startAddr, endAddr);
   device.writeFn = NULL;
+  device.saveFn = NULL;   /* rom contents are part of the snapshot key */
+  device.loadFn = NULL;
   MemoryDevice* romDevice = getMemoryDevice(&device);
   if (romDevice)
   {
@@ -156,6 +162,37 @@ static uint8_t writeMemoryDevice(HBC56Device* device, uint16_t addr, uint8_t val
   return 0;
 }
 
+/* Function:  saveMemoryDevice
+ * --------------------
+ * save the memory contents
+ */
+static uint32_t saveMemoryDevice(HBC56Device* device, uint8_t* buffer, uint32_t size)
+{
+  MemoryDevice* memoryDevice = getMemoryDevice(device);
+  if (memoryDevice)
+  {
+    uint32_t memorySize = memoryDevice->endAddr - memoryDevice->startAddr;
+    if (buffer)
+    {
+      if (size < memorySize)
+        return 0;
+
+      memcpy(buffer, memoryDevice->data, memorySize);
+    }
+    return memorySize;
+  }
+  return 0;
+}
+
+/* Function:  loadMemoryDevice
+ * --------------------
+ * restore the memory contents
+ */
+static uint8_t loadMemoryDevice(HBC56Device* device, const uint8_t* buffer, uint32_t size)
+{
+  return (uint8_t)setMemoryDeviceContents(device, buffer, size);
+}
+
 /* Function:  setMemoryDeviceContents
  * --------------------
  * update a ram/rom device contents. contents size must be equal to device size
@@ -173,3 +210,19 @@ int setMemoryDeviceContents(HBC56Device* device, const uint8_t* contents, uint32
   }
   return 0;
 }
+
+/* Function:  getMemoryDeviceContents
+ * --------------------
+ * get a pointer to a ram/rom device contents. contentSize is set to the device size
+ */
+const uint8_t* getMemoryDeviceContents(HBC56Device* device, uint32_t* contentSize)
+{
+  MemoryDevice* memoryDevice = getMemoryDevice(device);
+  if (memoryDevice)
+  {
+    if (contentSize) *contentSize = memoryDevice->endAddr - memoryDevice->startAddr;
+    return memoryDevice->data;
+  }
+  if (contentSize) *contentSize = 0;
+  return NULL;
+}
\ No newline at end of file
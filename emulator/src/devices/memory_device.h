@@ -37,6 +37,12 @@ HBC56Device createRomDevice(uint32_t startAddr, uint32_t endAddr, const uint8_t
  */
 int setMemoryDeviceContents(HBC56Device *device, const uint8_t* contents, uint32_t contentSize);
 
+/* Function:  getMemoryDeviceContents
+ * --------------------
+ * get a pointer to a ram/rom device contents. contentSize is set to the device size
+ */
+const uint8_t* getMemoryDeviceContents(HBC56Device* device, uint32_t* contentSize);
+
 #ifdef __cplusplus
 }
 #endif
@@ -20,7 +20,20 @@
 
 #include <stdlib.h>
 #include <string.h>
-#include <math.h>
+
+/* simd palette expansion */
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+  #define TMS9918_PALETTE_SSSE3 1
+  #include <tmmintrin.h>
+  #if defined(__GNUC__) || defined(__clang__)
+    #define TMS9918_TARGET_SSSE3 __attribute__((target("ssse3")))
+  #else
+    #define TMS9918_TARGET_SSSE3
+  #endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+  #define TMS9918_PALETTE_NEON 1
+  #include <arm_neon.h>
+#endif
 
 static void resetTms9918Device(HBC56Device*);
 static void destroyTms9918Device(HBC56Device*);
@@ -28,86 +41,988 @@ static void renderTms9918Device(HBC56Device* device);
 static void tickTms9918Device(HBC56Device*, uint32_t, double);
 static uint8_t readTms9918Device(HBC56Device*, uint16_t, uint8_t*, uint8_t);
 static uint8_t writeTms9918Device(HBC56Device*, uint16_t, uint8_t);
+static uint32_t saveTms9918Device(HBC56Device*, uint8_t*, uint32_t);
+static uint8_t loadTms9918Device(HBC56Device*, const uint8_t*, uint32_t);
+
+/* tms9918 constants */
+#define TMS9918_DISPLAY_WIDTH   320
+#define TMS9918_DISPLAY_HEIGHT  240
+#define TMS9918_FPS             60
+#define TMS9918_TICK_MIN_PIXELS 26
+#define TMS9918_NUM_REGS        8
+#define TMS9918_VRAM_SIZE       0x4000
+
+/* tms9918 computed constants */
+#define TMS9918_FRAME_CYCLES    (HBC56_CLOCK_FREQ / TMS9918_FPS)    /* cpu cycles per frame */
+#define TMS9918_BORDER_X        ((TMS9918_DISPLAY_WIDTH - TMS9918_PIXELS_X) / 2)
+#define TMS9918_BORDER_Y        ((TMS9918_DISPLAY_HEIGHT - TMS9918_PIXELS_Y) / 2)
+#define TMS9918_DISPLAY_PIXELS  (TMS9918_DISPLAY_WIDTH * TMS9918_DISPLAY_HEIGHT)
+#define TMS9918_LAST_ROW        (TMS9918_BORDER_Y + TMS9918_PIXELS_Y - 1)   /* always rendered. sets the frame status flag */
+#define TMS9918_VBLANK_PIXEL    (TMS9918_DISPLAY_WIDTH * (TMS9918_DISPLAY_HEIGHT - TMS9918_BORDER_Y))
+
+/* threaded rendering event log size (must be a power of 2) */
+#define TMS9918_EVENT_LOG_SIZE  0x10000
+#define TMS9918_EVENT_LOG_MASK  (TMS9918_EVENT_LOG_SIZE - 1)
+
+/* tms9918 display renderer. renders spans of the display from a tms9918
+   instance. inline rendering uses the device's instance. threaded rendering
+   uses a private instance kept in sync by replaying a write log */
+struct TMS9918Renderer
+{
+  VrEmuTms9918  *tms9918;
+  uint8_t        frameBuffers[2][TMS9918_DISPLAY_PIXELS];   /* palette indices */
+  uint8_t       *frameBuffer;       /* back buffer. being emulated */
+  uint8_t       *frontBuffer;       /* last completed frame */
+  int            newFrame;          /* front buffer not yet presented? */
+  SDL_mutex     *frameMutex;        /* guards the flip (threaded only) */
+
+  /* rendered display rows (palette indices). rows are only regenerated when
+     something which affects them has changed */
+  uint8_t        lineCache[TMS9918_DISPLAY_HEIGHT][TMS9918_DISPLAY_WIDTH];
+  uint8_t        lineDirty[TMS9918_DISPLAY_HEIGHT];
+
+  /* shadow of the tms address latch so we know which vram bytes are written */
+  uint16_t       shadowAddr;
+  uint8_t        shadowLatch;
+  uint8_t        shadowStage;
+};
+typedef struct TMS9918Renderer TMS9918Renderer;
+
+/* an entry in the threaded rendering log. port accesses and display spans
+   in the order they happened, stamped with the beam position */
+typedef enum
+{
+  TMS_EVENT_WRITE_ADDR,
+  TMS_EVENT_WRITE_DATA,
+  TMS_EVENT_READ_DATA,
+  TMS_EVENT_READ_STATUS,
+  TMS_EVENT_WRITE_REG,
+  TMS_EVENT_RESET,
+  TMS_EVENT_SPAN
+} TMS9918EventType;
+
+typedef struct
+{
+  uint8_t        type;
+  uint8_t        value;
+  uint8_t        reg;
+  uint16_t       count;             /* span pixels */
+  uint32_t       beam;              /* frame pixel position */
+} TMS9918Event;
+
+/* vram port access profiling */
+typedef struct
+{
+  TMS9918Profile    current;
+  TMS9918Profile    last;
+  uint32_t          runLength;
+  uint32_t          writeHeat[TMS9918_VRAM_SIZE];
+  uint32_t          readHeat[TMS9918_VRAM_SIZE];
+  TMS9918ProfileFn  frameFn;
+  void             *frameFnData;
+} TMS9918ProfileData;
+
+/* tms9918 device data */
+struct TMS9918Device
+{
+  uint16_t          dataAddr;
+  uint16_t          regAddr;
+  VrEmuTms9918     *tms9918;
+  uint64_t          pixelRemainder;   /* partial pixel carried between ticks (pixels * TMS9918_FRAME_CYCLES) */
+  int               currentFramePixels;
+  uint8_t           irq;
+
+  /* renders the display (inline) or only what's required for the status register (threaded) */
+  TMS9918Renderer   renderer;
+
+  /* threaded rendering */
+  TMS9918Renderer  *threadRenderer;
+  SDL_Thread       *thread;
+  SDL_sem          *eventSem;
+  SDL_atomic_t      eventHead;
+  SDL_atomic_t      eventTail;
+  SDL_atomic_t      threadQuit;
+  TMS9918Event     *events;
+
+  /* NULL unless profiling */
+  TMS9918ProfileData *profile;
+
+  /* change stamps for the debugger views. every vram write, register write
+     or reset takes a new stamp */
+  uint32_t          generation;
+  uint32_t          regGeneration;
+  uint32_t          vramGenerations[TMS9918_VRAM_SIZE >> 3];
+
+  /* frame skipping. frames which aren't rendered evaluate sprites for the
+     status register themselves */
+  int               renderEvery;      /* 1 = every frame, N = every Nth frame, 0 = never */
+  uint32_t          frameCount;
+  int               renderFrame;      /* is the current frame being rendered? */
+  uint8_t           status;           /* status flags from frames which weren't rendered */
+};
+typedef struct TMS9918Device TMS9918Device;
+
+/* the palette split in to byte planes (for simd table lookups) */
+static uint8_t paletteBytes[4][16];
+
+typedef void (*ExpandPaletteFn)(uint32_t*, const uint8_t*, int);
+static ExpandPaletteFn expandPalette = NULL;
+
+/* Function:  expandPaletteScalar
+ * --------------------
+ * convert palette indices to rgba
+ */
+static void expandPaletteScalar(uint32_t* dst, const uint8_t* src, int count)
+{
+  for (int i = 0; i < count; ++i)
+  {
+    dst[i] = vrEmuTms9918Palette[src[i] & 0x0f];
+  }
+}
+
+#if TMS9918_PALETTE_SSSE3
+/* Function:  expandPaletteSsse3
+ * --------------------
+ * convert palette indices to rgba. 16 pixels at a time. each byte plane is
+ * looked up with pshufb then the planes are interleaved back in to pixels
+ */
+TMS9918_TARGET_SSSE3
+static void expandPaletteSsse3(uint32_t* dst, const uint8_t* src, int count)
+{
+  const __m128i mask = _mm_set1_epi8(0x0f);
+  const __m128i plane0 = _mm_loadu_si128((const __m128i*)paletteBytes[0]);
+  const __m128i plane1 = _mm_loadu_si128((const __m128i*)paletteBytes[1]);
+  const __m128i plane2 = _mm_loadu_si128((const __m128i*)paletteBytes[2]);
+  const __m128i plane3 = _mm_loadu_si128((const __m128i*)paletteBytes[3]);
+
+  int i = 0;
+  for (; i + 16 <= count; i += 16)
+  {
+    __m128i idx = _mm_and_si128(_mm_loadu_si128((const __m128i*)(src + i)), mask);
+
+    __m128i b0 = _mm_shuffle_epi8(plane0, idx);
+    __m128i b1 = _mm_shuffle_epi8(plane1, idx);
+    __m128i b2 = _mm_shuffle_epi8(plane2, idx);
+    __m128i b3 = _mm_shuffle_epi8(plane3, idx);
+
+    __m128i lo01 = _mm_unpacklo_epi8(b0, b1);
+    __m128i hi01 = _mm_unpackhi_epi8(b0, b1);
+    __m128i lo23 = _mm_unpacklo_epi8(b2, b3);
+    __m128i hi23 = _mm_unpackhi_epi8(b2, b3);
+
+    _mm_storeu_si128((__m128i*)(dst + i + 0), _mm_unpacklo_epi16(lo01, lo23));
+    _mm_storeu_si128((__m128i*)(dst + i + 4), _mm_unpackhi_epi16(lo01, lo23));
+    _mm_storeu_si128((__m128i*)(dst + i + 8), _mm_unpacklo_epi16(hi01, hi23));
+    _mm_storeu_si128((__m128i*)(dst + i + 12), _mm_unpackhi_epi16(hi01, hi23));
+  }
+
+  expandPaletteScalar(dst + i, src + i, count - i);
+}
+#endif
+
+#if TMS9918_PALETTE_NEON
+/* Function:  expandPaletteNeon
+ * --------------------
+ * convert palette indices to rgba. 16 pixels at a time. each byte plane is
+ * looked up with tbl then the planes are interleaved by the store
+ */
+static void expandPaletteNeon(uint32_t* dst, const uint8_t* src, int count)
+{
+  const uint8x16_t mask = vdupq_n_u8(0x0f);
+  const uint8x16_t plane0 = vld1q_u8(paletteBytes[0]);
+  const uint8x16_t plane1 = vld1q_u8(paletteBytes[1]);
+  const uint8x16_t plane2 = vld1q_u8(paletteBytes[2]);
+  const uint8x16_t plane3 = vld1q_u8(paletteBytes[3]);
+
+  int i = 0;
+  for (; i + 16 <= count; i += 16)
+  {
+    uint8x16_t idx = vandq_u8(vld1q_u8(src + i), mask);
+
+    uint8x16x4_t pixels;
+    pixels.val[0] = vqtbl1q_u8(plane0, idx);
+    pixels.val[1] = vqtbl1q_u8(plane1, idx);
+    pixels.val[2] = vqtbl1q_u8(plane2, idx);
+    pixels.val[3] = vqtbl1q_u8(plane3, idx);
+
+    vst4q_u8((uint8_t*)(dst + i), pixels);
+  }
+
+  expandPaletteScalar(dst + i, src + i, count - i);
+}
+#endif
+
+/* Function:  initPaletteExpansion
+ * --------------------
+ * build the palette byte planes and choose the best expansion function
+ */
+static void initPaletteExpansion()
+{
+  if (expandPalette) return;
+
+  for (int i = 0; i < 16; ++i)
+  {
+    /* byte planes in memory order (pixels are stored as native uint32_t) */
+    uint32_t color = vrEmuTms9918Palette[i];
+    const uint8_t* colorBytes = (const uint8_t*)&color;
+    for (int b = 0; b < 4; ++b)
+    {
+      paletteBytes[b][i] = colorBytes[b];
+    }
+  }
+
+  expandPalette = expandPaletteScalar;
+
+#if TMS9918_PALETTE_SSSE3
+  if (SDL_HasSSSE3()) expandPalette = expandPaletteSsse3;
+#elif TMS9918_PALETTE_NEON
+  expandPalette = expandPaletteNeon;
+#endif
+}
+
+
+/* Function:  initRenderer
+ * --------------------
+ * initialise a renderer for a tms9918 instance
+ */
+static void initRenderer(TMS9918Renderer* r, VrEmuTms9918* tms9918)
+{
+  r->tms9918 = tms9918;
+  memset(r->frameBuffers, 0, sizeof(r->frameBuffers));
+  r->frameBuffer = r->frameBuffers[0];
+  r->frontBuffer = r->frameBuffers[1];
+  r->newFrame = 1;
+  r->frameMutex = NULL;
+  memset(r->lineCache, 6, sizeof(r->lineCache));
+  memset(r->lineDirty, 1, sizeof(r->lineDirty));
+  r->shadowAddr = 0;
+  r->shadowLatch = 0;
+  r->shadowStage = 0;
+}
+
+/* Function:  markAllLinesDirty
+ * --------------------
+ * every display row needs to be regenerated
+ */
+static void markAllLinesDirty(TMS9918Renderer* r)
+{
+  memset(r->lineDirty, 1, sizeof(r->lineDirty));
+}
+
+/* Function:  markPatternRowDirty
+ * --------------------
+ * a pattern (or graphics II color) byte changed. it could be used by any
+ * tile so mark every tms row with the same row within a tile
+ */
+static void markPatternRowDirty(TMS9918Renderer* r, uint16_t vramAddr)
+{
+  for (int y = vramAddr & 0x07; y < TMS9918_PIXELS_Y; y += 8)
+  {
+    r->lineDirty[TMS9918_BORDER_Y + y] = 1;
+  }
+}
+
+/* Function:  markVramWriteDirty
+ * --------------------
+ * determine which display rows a vram write affects. tables can overlap
+ * so each is checked. writes outside of the active tables affect nothing
+ */
+static void markVramWriteDirty(TMS9918Renderer* r, uint16_t vramAddr)
+{
+  VrEmuTms9918* tms = r->tms9918;
+  uint8_t r0 = vrEmuTms9918RegValue(tms, TMS_REG_0);
+  uint8_t r1 = vrEmuTms9918RegValue(tms, TMS_REG_1);
+
+  int textMode = (r1 & TMS_R1_MODE_TEXT) != 0;
+  int multicolorMode = (r1 & TMS_R1_MODE_MULTICOLOR) != 0;
+  int graphicsIIMode = (r0 & TMS_R0_MODE_GRAPHICS_II) != 0;
+
+  /* name table: a row of tiles is 8 display rows */
+  int nameCols = textMode ? 40 : 32;
+  uint16_t nameAddr = (vrEmuTms9918RegValue(tms, TMS_REG_2) & 0x0f) << 10;
+  if (vramAddr >= nameAddr && vramAddr < nameAddr + nameCols * 24)
+  {
+    int tileRow = (vramAddr - nameAddr) / nameCols;
+    memset(r->lineDirty + TMS9918_BORDER_Y + tileRow * 8, 1, 8);
+  }
+
+  /* multicolor patterns don't map neatly to rows */
+  if (multicolorMode)
+  {
+    markAllLinesDirty(r);
+    return;
+  }
+
+  /* pattern table */
+  uint8_t r4 = vrEmuTms9918RegValue(tms, TMS_REG_4);
+  uint16_t patternAddr = graphicsIIMode ? ((r4 & 0x04) << 11) : ((r4 & 0x07) << 11);
+  uint16_t patternSize = graphicsIIMode ? 0x1800 : 0x800;
+  if (vramAddr >= patternAddr && vramAddr < patternAddr + patternSize)
+  {
+    markPatternRowDirty(r, vramAddr);
+  }
+
+  if (textMode) return;
+
+  /* color table */
+  uint8_t r3 = vrEmuTms9918RegValue(tms, TMS_REG_3);
+  if (graphicsIIMode)
+  {
+    uint16_t colorAddr = (r3 & 0x80) << 6;
+    if (vramAddr >= colorAddr && vramAddr < colorAddr + 0x1800)
+    {
+      markPatternRowDirty(r, vramAddr);
+    }
+  }
+  else
+  {
+    uint16_t colorAddr = r3 << 6;
+    if (vramAddr >= colorAddr && vramAddr < colorAddr + 32)
+    {
+      markAllLinesDirty(r);
+    }
+  }
+
+  /* sprites can be anywhere */
+  uint16_t spriteAttrAddr = (vrEmuTms9918RegValue(tms, TMS_REG_5) & 0x7f) << 7;
+  uint16_t spritePattAddr = (vrEmuTms9918RegValue(tms, TMS_REG_6) & 0x07) << 11;
+  if ((vramAddr >= spriteAttrAddr && vramAddr < spriteAttrAddr + 128) ||
+      (vramAddr >= spritePattAddr && vramAddr < spritePattAddr + 0x800))
+  {
+    markAllLinesDirty(r);
+  }
+}
+
+/* Function:  spritesActive
+ * --------------------
+ * could sprites be displayed? the tms sets collision and fifth sprite status
+ * flags while rendering, so rows must always be regenerated when they are
+ */
+static int spritesActive(TMS9918Renderer* r)
+{
+  VrEmuTms9918* tms = r->tms9918;
+  if (vrEmuTms9918RegValue(tms, TMS_REG_1) & TMS_R1_MODE_TEXT) return 0;
+
+  uint16_t spriteAttrAddr = (vrEmuTms9918RegValue(tms, TMS_REG_5) & 0x7f) << 7;
+  return vrEmuTms9918VramValue(tms, spriteAttrAddr) != 0xd0;
+}
+
+/* Function:  vramTable
+ * --------------------
+ * which table a vram address belongs to in the current mode. where tables
+ * overlap, the first of name, sprite attributes, pattern, color, sprite
+ * patterns wins
+ */
+static TMS9918Table vramTable(VrEmuTms9918* tms, uint16_t vramAddr)
+{
+  uint8_t r0 = vrEmuTms9918RegValue(tms, TMS_REG_0);
+  uint8_t r1 = vrEmuTms9918RegValue(tms, TMS_REG_1);
+
+  int textMode = (r1 & TMS_R1_MODE_TEXT) != 0;
+  int multicolorMode = (r1 & TMS_R1_MODE_MULTICOLOR) != 0;
+  int graphicsIIMode = (r0 & TMS_R0_MODE_GRAPHICS_II) != 0;
+
+  uint16_t nameAddr = (vrEmuTms9918RegValue(tms, TMS_REG_2) & 0x0f) << 10;
+  if (vramAddr >= nameAddr && vramAddr < nameAddr + (textMode ? 40 : 32) * 24)
+    return TMS9918_TABLE_NAME;
+
+  uint16_t spriteAttrAddr = (vrEmuTms9918RegValue(tms, TMS_REG_5) & 0x7f) << 7;
+  if (!textMode && vramAddr >= spriteAttrAddr && vramAddr < spriteAttrAddr + 128)
+    return TMS9918_TABLE_SPRITE_ATTR;
+
+  uint8_t r4 = vrEmuTms9918RegValue(tms, TMS_REG_4);
+  uint16_t patternAddr = graphicsIIMode ? ((r4 & 0x04) << 11) : ((r4 & 0x07) << 11);
+  uint16_t patternSize = graphicsIIMode ? 0x1800 : (multicolorMode ? 0x600 : 0x800);
+  if (vramAddr >= patternAddr && vramAddr < patternAddr + patternSize)
+    return TMS9918_TABLE_PATTERN;
+
+  if (!textMode && !multicolorMode)
+  {
+    uint8_t r3 = vrEmuTms9918RegValue(tms, TMS_REG_3);
+    uint16_t colorAddr = graphicsIIMode ? ((r3 & 0x80) << 6) : (r3 << 6);
+    uint16_t colorSize = graphicsIIMode ? 0x1800 : 32;
+    if (vramAddr >= colorAddr && vramAddr < colorAddr + colorSize)
+      return TMS9918_TABLE_COLOR;
+  }
+
+  uint16_t spritePattAddr = (vrEmuTms9918RegValue(tms, TMS_REG_6) & 0x07) << 11;
+  if (!textMode && vramAddr >= spritePattAddr && vramAddr < spritePattAddr + 0x800)
+    return TMS9918_TABLE_SPRITE_PATT;
+
+  return TMS9918_TABLE_OTHER;
+}
+
+/* Function:  rendererWriteAddr
+ * --------------------
+ * write to the address/register port. follows the tms address latch. a
+ * register write can change anything, so every row is marked dirty
+ * (mid-frame changes are honoured from the next span)
+ */
+static void rendererWriteAddr(TMS9918Renderer* r, uint8_t val)
+{
+  if (r->shadowStage == 0)
+  {
+    r->shadowLatch = val;
+    r->shadowStage = 1;
+  }
+  else
+  {
+    r->shadowStage = 0;
+    if (val & 0x80)
+    {
+      markAllLinesDirty(r);
+    }
+    else
+    {
+      r->shadowAddr = ((val & 0x3f) << 8) | r->shadowLatch;
+
+      /* read mode pre-fetches and increments */
+      if ((val & 0x40) == 0)
+      {
+        r->shadowAddr = (r->shadowAddr + 1) & (TMS9918_VRAM_SIZE - 1);
+      }
+    }
+  }
+
+  vrEmuTms9918WriteAddr(r->tms9918, val);
+}
+
+/* Function:  rendererWriteData
+ * --------------------
+ * write to the data port
+ */
+static void rendererWriteData(TMS9918Renderer* r, uint8_t val)
+{
+  markVramWriteDirty(r, r->shadowAddr);
+  r->shadowStage = 0;
+  r->shadowAddr = (r->shadowAddr + 1) & (TMS9918_VRAM_SIZE - 1);
+  vrEmuTms9918WriteData(r->tms9918, val);
+}
+
+/* Function:  rendererReadData
+ * --------------------
+ * read from the data port
+ */
+static uint8_t rendererReadData(TMS9918Renderer* r)
+{
+  r->shadowStage = 0;
+  r->shadowAddr = (r->shadowAddr + 1) & (TMS9918_VRAM_SIZE - 1);
+  return vrEmuTms9918ReadData(r->tms9918);
+}
+
+/* Function:  rendererReadStatus
+ * --------------------
+ * read the status register
+ */
+static uint8_t rendererReadStatus(TMS9918Renderer* r)
+{
+  r->shadowStage = 0;
+  return vrEmuTms9918ReadStatus(r->tms9918);
+}
+
+/* Function:  rendererWriteReg
+ * --------------------
+ * write a register value directly
+ */
+static void rendererWriteReg(TMS9918Renderer* r, uint8_t reg, uint8_t val)
+{
+  vrEmuTms9918WriteRegValue(r->tms9918, (vrEmuTms9918Register)reg, val);
+  markAllLinesDirty(r);
+}
+
+/* Function:  rendererReset
+ * --------------------
+ * reset the tms
+ */
+static void rendererReset(TMS9918Renderer* r)
+{
+  vrEmuTms9918Reset(r->tms9918);
+  r->shadowAddr = 0;
+  r->shadowStage = 0;
+  markAllLinesDirty(r);
+}
+
+/* Function:  rendererSpan
+ * --------------------
+ * render a span of a display row (a span never crosses a row) starting at
+ * frame pixel 'beam'. the row is regenerated at the start of each span if
+ * anything affecting it has changed, so mid-row changes are picked up. with
+ * statusOnly, rows are only generated when the status register depends on
+ * them and no output is written
+ */
+static void rendererSpan(TMS9918Renderer* r, int beam, int count, int statusOnly)
+{
+  int row = beam / TMS9918_DISPLAY_WIDTH;
+  int col = beam % TMS9918_DISPLAY_WIDTH;
+
+  int alwaysRender = spritesActive(r) || row == TMS9918_LAST_ROW;
+  if (alwaysRender || (r->lineDirty[row] && !statusOnly))
+  {
+    /* get the background color for this run of pixels */
+    uint8_t bgColor = (vrEmuTms9918DisplayEnabled(r->tms9918)
+                        ? vrEmuTms9918RegValue(r->tms9918, TMS_REG_7)
+                        : TMS_BLACK) & 0x0f;
+
+    uint8_t* scanline = r->lineCache[row];
+    int tmsRow = row - TMS9918_BORDER_Y;
+    memset(scanline, bgColor, TMS9918_DISPLAY_WIDTH);
+    if (tmsRow >= 0 && tmsRow < TMS9918_PIXELS_Y)
+    {
+      vrEmuTms9918ScanLine(r->tms9918, (uint8_t)tmsRow, scanline + TMS9918_BORDER_X);
+    }
+
+    /* a status only render leaves the cached row out of date */
+    r->lineDirty[row] = (uint8_t)statusOnly;
+  }
+
+  if (statusOnly) return;
+
+  /* update the frame buffer from the scanline pixels. palette indices only,
+     they're converted to rgba when the frame is presented */
+  memcpy(r->frameBuffer + beam, r->lineCache[row] + col, count);
+
+  /* frame finished? flip the buffers */
+  if (beam + count >= TMS9918_DISPLAY_PIXELS)
+  {
+    if (r->frameMutex) SDL_LockMutex(r->frameMutex);
+
+    uint8_t* completed = r->frameBuffer;
+    r->frameBuffer = r->frontBuffer;
+    r->frontBuffer = completed;
+    r->newFrame = 1;
+
+    if (r->frameMutex) SDL_UnlockMutex(r->frameMutex);
+  }
+}
+
+/* Function:  presentRenderer
+ * --------------------
+ * convert the last completed frame to rgba straight in to the texture.
+ * only completed frames are presented, and only once
+ */
+static void presentRenderer(TMS9918Renderer* r, SDL_Texture* texture)
+{
+  if (r->frameMutex) SDL_LockMutex(r->frameMutex);
+
+  if (r->newFrame)
+  {
+    void *pixels = NULL;
+    int pitch = 0;
+    if (SDL_LockTexture(texture, NULL, &pixels, &pitch) == 0)
+    {
+      uint8_t* dstRow = (uint8_t*)pixels;
+      const uint8_t* srcRow = r->frontBuffer;
+      for (int y = 0; y < TMS9918_DISPLAY_HEIGHT; ++y)
+      {
+        expandPalette((uint32_t*)dstRow, srcRow, TMS9918_DISPLAY_WIDTH);
+        dstRow += pitch;
+        srcRow += TMS9918_DISPLAY_WIDTH;
+      }
+      SDL_UnlockTexture(texture);
+    }
+    r->newFrame = 0;
+  }
+
+  if (r->frameMutex) SDL_UnlockMutex(r->frameMutex);
+}
+
+
+ /* Function:  createTms9918Device
+  * --------------------
+  * create a TMS9918 device
+  */
+HBC56Device createTms9918Device(uint16_t dataAddr, uint16_t regAddr, uint8_t irq, SDL_Renderer* renderer)
+{
+  HBC56Device device = createDevice("TMS9918 VDP");
+  TMS9918Device* tmsDevice = (TMS9918Device*)malloc(sizeof(TMS9918Device));
+  if (tmsDevice)
+  {
+    tmsDevice->dataAddr = dataAddr;
+    tmsDevice->regAddr = regAddr;
+    tmsDevice->irq = irq;
+    tmsDevice->tms9918 = vrEmuTms9918New();
+    tmsDevice->pixelRemainder = 0;
+    tmsDevice->currentFramePixels = 0;
+    initRenderer(&tmsDevice->renderer, tmsDevice->tms9918);
+
+    tmsDevice->threadRenderer = NULL;
+    tmsDevice->thread = NULL;
+    tmsDevice->eventSem = NULL;
+    tmsDevice->events = NULL;
+    SDL_AtomicSet(&tmsDevice->eventHead, 0);
+    SDL_AtomicSet(&tmsDevice->eventTail, 0);
+    SDL_AtomicSet(&tmsDevice->threadQuit, 0);
+    tmsDevice->profile = NULL;
+    tmsDevice->generation = 1;
+    tmsDevice->regGeneration = 1;
+    memset(tmsDevice->vramGenerations, 0, sizeof(tmsDevice->vramGenerations));
+    tmsDevice->renderEvery = 1;
+    tmsDevice->frameCount = 0;
+    tmsDevice->renderFrame = 1;
+    tmsDevice->status = 0;
+
+    initPaletteExpansion();
+
+    device.data = tmsDevice;
+    device.resetFn = &resetTms9918Device;
+    device.destroyFn = &destroyTms9918Device;
+    device.readFn = &readTms9918Device;
+    device.writeFn = &writeTms9918Device;
+    device.tickFn = &tickTms9918Device;
+    device.renderFn = &renderTms9918Device;
+    device.saveFn = &saveTms9918Device;
+    device.loadFn = &loadTms9918Device;
+
+    device.output = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING,
+                                      TMS9918_DISPLAY_WIDTH, TMS9918_DISPLAY_HEIGHT);
+    #ifndef __CLANG__
+    SDL_SetTextureScaleMode(device.output, SDL_ScaleModeBest);
+    #endif
+  }
+  else
+  {
+    destroyDevice(&device);
+  }
+
+  return device;
+}
+
+
+/* Function:  getTms9918Device
+ * --------------------
+ * helper funtion to get private structure
+ */
+inline static TMS9918Device* getTms9918Device(HBC56Device* device)
+{
+  if (!device) return NULL;
+  return (TMS9918Device*)device->data;
+}
+
+/* Function:  pushEvent
+ * --------------------
+ * add an event to the threaded rendering log. waits for the render thread
+ * if the log is full
+ */
+static void pushEvent(TMS9918Device* tmsDevice, TMS9918EventType type, uint8_t value, uint8_t reg, uint16_t count)
+{
+  int head = SDL_AtomicGet(&tmsDevice->eventHead);
+  int next = (head + 1) & TMS9918_EVENT_LOG_MASK;
+
+  while (next == SDL_AtomicGet(&tmsDevice->eventTail))
+  {
+    SDL_SemPost(tmsDevice->eventSem);
+    SDL_Delay(0);
+  }
+
+  TMS9918Event* event = tmsDevice->events + head;
+  event->type = (uint8_t)type;
+  event->value = value;
+  event->reg = reg;
+  event->count = count;
+  event->beam = (uint32_t)tmsDevice->currentFramePixels;
+
+  SDL_AtomicSet(&tmsDevice->eventHead, next);
+}
+
+/* Function:  tms9918RenderThread
+ * --------------------
+ * replays the event log against the thread's own tms instance, rendering
+ * spans exactly as the inline renderer would
+ */
+static int tms9918RenderThread(void* data)
+{
+  TMS9918Device* tmsDevice = (TMS9918Device*)data;
+  TMS9918Renderer* r = tmsDevice->threadRenderer;
+
+  while (!SDL_AtomicGet(&tmsDevice->threadQuit))
+  {
+    int tail = SDL_AtomicGet(&tmsDevice->eventTail);
+    if (tail == SDL_AtomicGet(&tmsDevice->eventHead))
+    {
+      SDL_SemWaitTimeout(tmsDevice->eventSem, 5);
+      continue;
+    }
+
+    const TMS9918Event* event = tmsDevice->events + tail;
+    switch (event->type)
+    {
+      case TMS_EVENT_WRITE_ADDR:  rendererWriteAddr(r, event->value); break;
+      case TMS_EVENT_WRITE_DATA:  rendererWriteData(r, event->value); break;
+      case TMS_EVENT_READ_DATA:   rendererReadData(r); break;
+      case TMS_EVENT_READ_STATUS: rendererReadStatus(r); break;
+      case TMS_EVENT_WRITE_REG:   rendererWriteReg(r, event->reg, event->value); break;
+      case TMS_EVENT_RESET:       rendererReset(r); break;
+      case TMS_EVENT_SPAN:        rendererSpan(r, (int)event->beam, event->count, 0); break;
+    }
+
+    SDL_AtomicSet(&tmsDevice->eventTail, (tail + 1) & TMS9918_EVENT_LOG_MASK);
+  }
+  return 0;
+}
+
+/* Function:  startTms9918RenderThread
+ * --------------------
+ * render the display on a worker thread
+ */
+int startTms9918RenderThread(HBC56Device* device)
+{
+  TMS9918Device* tmsDevice = getTms9918Device(device);
+  if (!tmsDevice || tmsDevice->thread) return 0;
+
+#ifndef __EMSCRIPTEN__
+  TMS9918Renderer* r = (TMS9918Renderer*)malloc(sizeof(TMS9918Renderer));
+  if (!r) return 0;
+
+  initRenderer(r, vrEmuTms9918New());
+
+  /* bring the thread's tms in to line with ours */
+  vrEmuTms9918WriteAddr(r->tms9918, 0x00);
+  vrEmuTms9918WriteAddr(r->tms9918, 0x40);
+  for (int i = 0; i < TMS9918_VRAM_SIZE; ++i)
+  {
+    vrEmuTms9918WriteData(r->tms9918, vrEmuTms9918VramValue(tmsDevice->tms9918, (uint16_t)i));
+  }
+  for (int i = 0; i < TMS9918_NUM_REGS; ++i)
+  {
+    vrEmuTms9918WriteRegValue(r->tms9918, (vrEmuTms9918Register)i, vrEmuTms9918RegValue(tmsDevice->tms9918, (vrEmuTms9918Register)i));
+  }
+  uint16_t addr = tmsDevice->renderer.shadowAddr;
+  vrEmuTms9918WriteAddr(r->tms9918, addr & 0xff);
+  vrEmuTms9918WriteAddr(r->tms9918, ((addr >> 8) & 0x3f) | 0x40);
+  r->shadowAddr = addr;
+  if (tmsDevice->renderer.shadowStage)
+  {
+    rendererWriteAddr(r, tmsDevice->renderer.shadowLatch);
+  }
+
+  r->frameMutex = SDL_CreateMutex();
+  tmsDevice->events = (TMS9918Event*)malloc(TMS9918_EVENT_LOG_SIZE * sizeof(TMS9918Event));
+  tmsDevice->eventSem = SDL_CreateSemaphore(0);
+  tmsDevice->threadRenderer = r;
+
+  if (r->frameMutex && tmsDevice->events && tmsDevice->eventSem)
+  {
+    tmsDevice->thread = SDL_CreateThread(tms9918RenderThread, "TMS9918 render", tmsDevice);
+  }
+
+  if (tmsDevice->thread)
+  {
+    SDL_Log("TMS9918: rendering on a worker thread\n");
+    return 1;
+  }
+
+  /* fall back to inline rendering */
+  vrEmuTms9918Destroy(r->tms9918);
+  SDL_DestroyMutex(r->frameMutex);
+  free(r);
+  free(tmsDevice->events);
+  SDL_DestroySemaphore(tmsDevice->eventSem);
+  tmsDevice->threadRenderer = NULL;
+  tmsDevice->events = NULL;
+  tmsDevice->eventSem = NULL;
+#endif
+
+  SDL_Log("TMS9918: unable to create render thread\n");
+  return 0;
+}
+
+/* Function:  stopTms9918RenderThread
+ * --------------------
+ * stop and clean up the render thread
+ */
+static void stopTms9918RenderThread(TMS9918Device* tmsDevice)
+{
+  if (!tmsDevice->thread) return;
+
+  SDL_AtomicSet(&tmsDevice->threadQuit, 1);
+  SDL_SemPost(tmsDevice->eventSem);
+  SDL_WaitThread(tmsDevice->thread, NULL);
+  tmsDevice->thread = NULL;
+
+  vrEmuTms9918Destroy(tmsDevice->threadRenderer->tms9918);
+  SDL_DestroyMutex(tmsDevice->threadRenderer->frameMutex);
+  free(tmsDevice->threadRenderer);
+  tmsDevice->threadRenderer = NULL;
+
+  free(tmsDevice->events);
+  tmsDevice->events = NULL;
+
+  SDL_DestroySemaphore(tmsDevice->eventSem);
+  tmsDevice->eventSem = NULL;
+}
+
+/* Function:  tmsWriteAddr / tmsWriteData / tmsWriteReg
+ * --------------------
+ * update our tms and log the change for the render thread
+ */
+static void tmsWriteAddr(TMS9918Device* tmsDevice, uint8_t val)
+{
+  if (tmsDevice->renderer.shadowStage && (val & 0x80))
+  {
+    tmsDevice->regGeneration = ++tmsDevice->generation;
+  }
+  rendererWriteAddr(&tmsDevice->renderer, val);
+  if (tmsDevice->thread) pushEvent(tmsDevice, TMS_EVENT_WRITE_ADDR, val, 0, 0);
+}
+
+static void tmsWriteData(TMS9918Device* tmsDevice, uint8_t val)
+{
+  tmsDevice->vramGenerations[tmsDevice->renderer.shadowAddr >> 3] = ++tmsDevice->generation;
+  rendererWriteData(&tmsDevice->renderer, val);
+  if (tmsDevice->thread) pushEvent(tmsDevice, TMS_EVENT_WRITE_DATA, val, 0, 0);
+}
+
+static void tmsWriteReg(TMS9918Device* tmsDevice, uint8_t reg, uint8_t val)
+{
+  tmsDevice->regGeneration = ++tmsDevice->generation;
+  rendererWriteReg(&tmsDevice->renderer, reg, val);
+  if (tmsDevice->thread) pushEvent(tmsDevice, TMS_EVENT_WRITE_REG, val, reg, 0);
+}
+
+/* Function:  evaluateSprites
+ * --------------------
+ * work out the status flags for a display row without rendering it. sprite
+ * rows are checked for a fifth sprite and for coincidence. the last row sets
+ * the frame flag
+ */
+static void evaluateSprites(TMS9918Device* tmsDevice, int row)
+{
+  VrEmuTms9918* tms = tmsDevice->tms9918;
+
+  int y = row - TMS9918_BORDER_Y;
+  if (y < 0 || y >= TMS9918_PIXELS_Y || !vrEmuTms9918DisplayEnabled(tms)) return;
+
+  if (y == TMS9918_PIXELS_Y - 1) tmsDevice->status |= 0x80;
+
+  uint8_t r1 = vrEmuTms9918RegValue(tms, TMS_REG_1);
+  if (r1 & TMS_R1_MODE_TEXT) return;
+
+  int size16 = (r1 & TMS_R1_SPRITE_16) != 0;
+  int mag = (r1 & TMS_R1_SPRITE_MAG2) ? 2 : 1;
+  int spriteSize = (size16 ? 16 : 8) * mag;
 
-/* tms9918 constants */
-#define TMS9918_DISPLAY_WIDTH   320
-#define TMS9918_DISPLAY_HEIGHT  240
-#define TMS9918_FPS             60.0
-#define TMS9918_TICK_MIN_PIXELS 26
+  uint16_t attrAddr = (vrEmuTms9918RegValue(tms, TMS_REG_5) & 0x7f) << 7;
+  uint16_t pattAddr = (vrEmuTms9918RegValue(tms, TMS_REG_6) & 0x07) << 11;
 
-/* tms9918 computed constants */
-#define TMS9918_FRAME_TIME      (1.0 / TMS9918_FPS)
-#define TMS9918_ROW_TIME        (TMS9918_FRAME_TIME / (double)TMS9918_DISPLAY_HEIGHT)
-#define TMS9918_PIXEL_TIME      (TMS9918_ROW_TIME / (double)TMS9918_DISPLAY_WIDTH)
-#define TMS9918_BORDER_X        ((TMS9918_DISPLAY_WIDTH - TMS9918_PIXELS_X) / 2)
-#define TMS9918_BORDER_Y        ((TMS9918_DISPLAY_HEIGHT - TMS9918_PIXELS_Y) / 2)
-#define TMS9918_DISPLAY_PIXELS  (TMS9918_DISPLAY_WIDTH * TMS9918_DISPLAY_HEIGHT)
+  uint8_t covered[TMS9918_PIXELS_X];
+  int spritesShown = 0;
+  int anyShown = 0;
 
-/* tms9918 device data */
-struct TMS9918Device
-{
-  uint16_t       dataAddr;
-  uint16_t       regAddr;
-  VrEmuTms9918  *tms9918;
-  uint32_t       frameBuffer[TMS9918_DISPLAY_PIXELS];
-  double         unusedTime;
-  int            currentFramePixels;
-  uint8_t        scanlineBuffer[TMS9918_DISPLAY_WIDTH];
-  uint8_t        irq;
-};
-typedef struct TMS9918Device TMS9918Device;
+  for (int i = 0; i < 32; ++i, attrAddr += 4)
+  {
+    int yPos = vrEmuTms9918VramValue(tms, attrAddr);
+    if (yPos == 0xd0) break;
 
+    if (yPos > 0xe0) yPos -= 256;
+    yPos += 1;
 
- /* Function:  createTms9918Device
-  * --------------------
-  * create a TMS9918 device
-  */
-HBC56Device createTms9918Device(uint16_t dataAddr, uint16_t regAddr, uint8_t irq, SDL_Renderer* renderer)
+    if (y < yPos || y >= yPos + spriteSize) continue;
+
+    if (++spritesShown > 4)
+    {
+      if (!(tmsDevice->status & 0x40)) tmsDevice->status = (tmsDevice->status & 0xe0) | 0x40 | i;
+      break;
+    }
+
+    uint8_t name = vrEmuTms9918VramValue(tms, attrAddr + 2);
+    if (size16) name &= 0xfc;
+
+    int patternRow = (y - yPos) / mag;
+    uint16_t rowAddr = pattAddr + name * 8 + patternRow;
+    uint16_t bits = vrEmuTms9918VramValue(tms, rowAddr) << 8;
+    if (size16) bits |= vrEmuTms9918VramValue(tms, rowAddr + 16);
+    if (!bits) continue;
+
+    int xPos = vrEmuTms9918VramValue(tms, attrAddr + 1);
+    if (vrEmuTms9918VramValue(tms, attrAddr + 3) & 0x80) xPos -= 32;
+
+    if (!anyShown)
+    {
+      memset(covered, 0, sizeof(covered));
+      anyShown = 1;
+    }
+
+    for (int px = 0; px < spriteSize; ++px)
+    {
+      int x = xPos + px;
+      if (x < 0 || x >= TMS9918_PIXELS_X) continue;
+      if (!(bits & (0x8000 >> (px / mag)))) continue;
+
+      if (covered[x]) tmsDevice->status |= 0x20;
+      covered[x] = 1;
+    }
+  }
+}
+
+/* Function:  profileAddrWrite
+ * --------------------
+ * count an address/register port write. called before the write is applied
+ */
+static void profileAddrWrite(TMS9918Device* tmsDevice, uint8_t val)
 {
-  HBC56Device device = createDevice("TMS9918 VDP");
-  TMS9918Device* tmsDevice = (TMS9918Device*)malloc(sizeof(TMS9918Device));
-  if (tmsDevice)
+  TMS9918ProfileData* profile = tmsDevice->profile;
+  if (!tmsDevice->renderer.shadowStage) return;
+
+  if (val & 0x80)
   {
-    tmsDevice->dataAddr = dataAddr;
-    tmsDevice->regAddr = regAddr;
-    tmsDevice->irq = irq;
-    tmsDevice->tms9918 = vrEmuTms9918New();
-    tmsDevice->unusedTime = 0.0f;
-    tmsDevice->currentFramePixels = 0;
-    memset(tmsDevice->frameBuffer, 0, sizeof(tmsDevice->frameBuffer));
-    memset(tmsDevice->scanlineBuffer, 6, sizeof(tmsDevice->scanlineBuffer));
+    ++profile->current.regWrites;
+  }
+  else
+  {
+    ++profile->current.addrSets;
+    profile->runLength = 0;
+  }
+}
 
-    device.data = tmsDevice;
-    device.resetFn = &resetTms9918Device;
-    device.destroyFn = &destroyTms9918Device;
-    device.readFn = &readTms9918Device;
-    device.writeFn = &writeTms9918Device;
-    device.tickFn = &tickTms9918Device;
-    device.renderFn = &renderTms9918Device;
+/* Function:  profileDataAccess
+ * --------------------
+ * count a data port access. called before the access is applied
+ */
+static void profileDataAccess(TMS9918Device* tmsDevice, int write)
+{
+  TMS9918ProfileData* profile = tmsDevice->profile;
+  uint16_t vramAddr = tmsDevice->renderer.shadowAddr;
 
-    device.output = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING,
-                                      TMS9918_DISPLAY_WIDTH, TMS9918_DISPLAY_HEIGHT);
-    #ifndef __CLANG__
-    SDL_SetTextureScaleMode(device.output, SDL_ScaleModeBest);
-    #endif
+  if (profile->runLength++) ++profile->current.sequential;
+  if (profile->runLength > profile->current.longestRun) profile->current.longestRun = profile->runLength;
+
+  if (write)
+  {
+    ++profile->current.dataWrites;
+    ++profile->current.tableWrites[vramTable(tmsDevice->tms9918, vramAddr)];
+    ++profile->writeHeat[vramAddr];
+
+    int row = tmsDevice->currentFramePixels / TMS9918_DISPLAY_WIDTH;
+    if (row >= TMS9918_BORDER_Y && row < TMS9918_BORDER_Y + TMS9918_PIXELS_Y &&
+        vrEmuTms9918DisplayEnabled(tmsDevice->tms9918))
+    {
+      ++profile->current.activeWrites;
+    }
+    else
+    {
+      ++profile->current.blankWrites;
+    }
   }
   else
   {
-    destroyDevice(&device);
+    ++profile->current.dataReads;
+    ++profile->readHeat[vramAddr];
   }
-
-  return device;
 }
 
-
-/* Function:  getTms9918Device
+/* Function:  profileEndFrame
  * --------------------
- * helper funtion to get private structure
+ * a frame has finished. publish its counters and start again
  */
-inline static TMS9918Device* getTms9918Device(HBC56Device* device)
+static void profileEndFrame(TMS9918Device* tmsDevice)
 {
-  if (!device) return NULL;
-  return (TMS9918Device*)device->data;
+  TMS9918ProfileData* profile = tmsDevice->profile;
+
+  profile->last = profile->current;
+  memset(&profile->current, 0, sizeof(profile->current));
+  profile->current.frame = profile->last.frame + 1;
+
+  if (profile->frameFn) profile->frameFn(&profile->last, profile->frameFnData);
 }
 
 /* Function:  resetTms9918Device
@@ -119,7 +1034,10 @@ static void resetTms9918Device(HBC56Device* device)
   TMS9918Device* tmsDevice = getTms9918Device(device);
   if (tmsDevice)
   {
-    vrEmuTms9918Reset(tmsDevice->tms9918);
+    rendererReset(&tmsDevice->renderer);
+    tmsDevice->regGeneration = ++tmsDevice->generation;
+    tmsDevice->status = 0;
+    if (tmsDevice->thread) pushEvent(tmsDevice, TMS_EVENT_RESET, 0, 0, 0);
   }
 }
 
@@ -132,7 +1050,9 @@ static void destroyTms9918Device(HBC56Device *device)
   TMS9918Device *tmsDevice = getTms9918Device(device);
   if (tmsDevice)
   {
+    stopTms9918RenderThread(tmsDevice);
     vrEmuTms9918Destroy(tmsDevice->tms9918);
+    free(tmsDevice->profile);
   }
   free(tmsDevice);
   device->data = NULL;
@@ -150,19 +1070,16 @@ static void renderTms9918Device(HBC56Device* device)
   TMS9918Device* tmsDevice = getTms9918Device(device);
   if (tmsDevice)
   {
-    void *pixels = NULL;
-    int pitch = 0;
-    SDL_LockTexture(device->output, NULL, &pixels, &pitch);
-    memcpy(pixels, tmsDevice->frameBuffer, sizeof(tmsDevice->frameBuffer));
-    SDL_UnlockTexture(device->output);
+    presentRenderer(tmsDevice->thread ? tmsDevice->threadRenderer : &tmsDevice->renderer, device->output);
   }
 }
 
 /* Function:  tickTms9918Device
  * --------------------
- * renders the portion of the screen since the last call. relies on deltaTime to determine
- * how much of the screen to render. this style of rendering allows mid-frame changes to be
- * shown in the display if called frequently enough. you can achieve beam racing effects.
+ * renders the portion of the screen since the last call. the beam is clocked from cpu
+ * cycles (deltaTicks), so it stays locked to the emulated cpu regardless of host timing.
+ * this style of rendering allows mid-frame changes to be shown in the display if called
+ * frequently enough. you can achieve beam racing effects.
  */
 int c = 0;
 static void tickTms9918Device(HBC56Device* device, uint32_t deltaTicks, double deltaTime)
@@ -170,65 +1087,55 @@ static void tickTms9918Device(HBC56Device* device, uint32_t deltaTicks, double d
   TMS9918Device* tmsDevice = getTms9918Device(device);
   if (tmsDevice)
   {
-    /* determine portion of frame to render */
-    deltaTime += tmsDevice->unusedTime;
-
-    /* how many pixels are we rendering? */
-    double thisStepTotalPixelsDbl = 0.0;
-    tmsDevice->unusedTime = modf(deltaTime / (double)TMS9918_PIXEL_TIME, &thisStepTotalPixelsDbl) * TMS9918_PIXEL_TIME;
-    int thisStepTotalPixels = (uint32_t)thisStepTotalPixelsDbl;
+    /* how many pixels are we rendering? a frame is exactly TMS9918_FRAME_CYCLES
+       cpu cycles, so integer math keeps us in lock-step with the cpu */
+    uint64_t stepPixelCycles = (uint64_t)deltaTicks * TMS9918_DISPLAY_PIXELS + tmsDevice->pixelRemainder;
+    int thisStepTotalPixels = (int)(stepPixelCycles / TMS9918_FRAME_CYCLES);
+    tmsDevice->pixelRemainder = stepPixelCycles % TMS9918_FRAME_CYCLES;
 
-    /* if we haven't reached the minimum, accumulate time for the next call and return */
-    if (thisStepTotalPixels < TMS9918_TICK_MIN_PIXELS)
+    /* if we haven't reached the minimum, accumulate for the next call and return.
+       never defer vblank though. the scheduler may have stepped precisely to it */
+    if (thisStepTotalPixels < TMS9918_TICK_MIN_PIXELS &&
+        !(tmsDevice->currentFramePixels < TMS9918_VBLANK_PIXEL &&
+          tmsDevice->currentFramePixels + thisStepTotalPixels >= TMS9918_VBLANK_PIXEL))
     {
-      tmsDevice->unusedTime += thisStepTotalPixels * TMS9918_PIXEL_TIME;
+      tmsDevice->pixelRemainder += (uint64_t)thisStepTotalPixels * TMS9918_FRAME_CYCLES;
       return;
     }
 
-    /* we only render the end end of a frame. if we need to go further, accumulate the time for the next call */
+    /* we only render the end end of a frame. if we need to go further, accumulate for the next call */
     if (tmsDevice->currentFramePixels + thisStepTotalPixels >= TMS9918_DISPLAY_PIXELS)
     {
-      tmsDevice->unusedTime += ((tmsDevice->currentFramePixels + thisStepTotalPixels) - TMS9918_DISPLAY_PIXELS) * TMS9918_PIXEL_TIME;
+      uint64_t excess = (uint64_t)((tmsDevice->currentFramePixels + thisStepTotalPixels) - TMS9918_DISPLAY_PIXELS);
+      tmsDevice->pixelRemainder += excess * TMS9918_FRAME_CYCLES;
       thisStepTotalPixels = TMS9918_DISPLAY_PIXELS - tmsDevice->currentFramePixels;
     }
 
-    /* get the background color for this run of pixels */
-    uint8_t bgColor = (vrEmuTms9918DisplayEnabled(tmsDevice->tms9918)
-                        ? vrEmuTms9918RegValue(tmsDevice->tms9918, TMS_REG_7)
-                        : TMS_BLACK) & 0x0f;
-
-    //bgColor = (++c) & 0x0f;  /* for testing */
-    int firstPix = 1;
-    uint32_t* fbPtr = tmsDevice->frameBuffer + tmsDevice->currentFramePixels;
-
-    int tmsRow = 0;
-
-    /* iterate over the pixels we need to update in this call */
-    for (int p = 0; p < thisStepTotalPixels; ++p)
+    /* render in spans. a span runs to the end of the current row or the end of this step.
+       when threaded, we only render what the status register needs and log the span */
+    int threaded = tmsDevice->thread != NULL;
+    while (thisStepTotalPixels > 0)
     {
-      div_t currentPos = div((int)tmsDevice->currentFramePixels, (int)TMS9918_DISPLAY_WIDTH);
-
-      int currentRow = currentPos.quot;
-      int currentCol = currentPos.rem;
+      int spanPixels = TMS9918_DISPLAY_WIDTH - (tmsDevice->currentFramePixels % TMS9918_DISPLAY_WIDTH);
+      if (spanPixels > thisStepTotalPixels) spanPixels = thisStepTotalPixels;
 
-      /* if this is the first pixel or the first pixel of a new row, update the scanline buffer */
-      if (firstPix || currentCol == 0)
+      if (tmsDevice->renderFrame)
       {
-        tmsRow = currentRow - TMS9918_BORDER_Y;
-        memset(tmsDevice->scanlineBuffer, bgColor, sizeof(tmsDevice->scanlineBuffer));
-        if (tmsRow >=0 && tmsRow < TMS9918_PIXELS_Y)
-        {
-          vrEmuTms9918ScanLine(tmsDevice->tms9918, (uint8_t)tmsRow, tmsDevice->scanlineBuffer + TMS9918_BORDER_X);
-        }
-
-        firstPix = 0;
+        rendererSpan(&tmsDevice->renderer, tmsDevice->currentFramePixels, spanPixels, threaded);
+        if (threaded) pushEvent(tmsDevice, TMS_EVENT_SPAN, 0, 0, (uint16_t)spanPixels);
+      }
+      else if ((tmsDevice->currentFramePixels % TMS9918_DISPLAY_WIDTH) == 0)
+      {
+        /* not rendering this frame. status only, once per row */
+        evaluateSprites(tmsDevice, tmsDevice->currentFramePixels / TMS9918_DISPLAY_WIDTH);
       }
 
-      /* update the frame buffer pixel from the scanline pixel */
-      *(fbPtr++) = vrEmuTms9918Palette[tmsDevice->scanlineBuffer[currentCol]];
+      int spanStart = tmsDevice->currentFramePixels;
+      tmsDevice->currentFramePixels += spanPixels;
+      thisStepTotalPixels -= spanPixels;
 
-      /* if we're at the end of the main tms9918 frame, trigger an interrupt */
-      if (++tmsDevice->currentFramePixels == (TMS9918_DISPLAY_WIDTH * (TMS9918_DISPLAY_HEIGHT - TMS9918_BORDER_Y)))
+      /* if this span reached the end of the main tms9918 frame, trigger an interrupt */
+      if (spanStart < TMS9918_VBLANK_PIXEL && tmsDevice->currentFramePixels >= TMS9918_VBLANK_PIXEL)
       {
         if (vrEmuTms9918DisplayEnabled(tmsDevice->tms9918) &&
             (vrEmuTms9918RegValue(tmsDevice->tms9918, TMS_REG_1) & 0x20))
@@ -239,7 +1146,18 @@ static void tickTms9918Device(HBC56Device* device, uint32_t deltaTicks, double d
     }
 
     /* reset pixel count if frame finished */
-    if (tmsDevice->currentFramePixels >= TMS9918_DISPLAY_PIXELS) tmsDevice->currentFramePixels= 0;
+    if (tmsDevice->currentFramePixels >= TMS9918_DISPLAY_PIXELS)
+    {
+      tmsDevice->currentFramePixels = 0;
+      if (tmsDevice->profile) profileEndFrame(tmsDevice);
+
+      /* render the next frame? */
+      ++tmsDevice->frameCount;
+      tmsDevice->renderFrame = tmsDevice->renderEvery && (tmsDevice->frameCount % tmsDevice->renderEvery) == 0;
+    }
+
+    /* wake the render thread */
+    if (threaded) SDL_SemPost(tmsDevice->eventSem);
   }
 }
 
@@ -255,7 +1173,9 @@ static uint8_t readTms9918Device(HBC56Device* device, uint16_t addr, uint8_t *va
   {
     if (addr == tmsDevice->regAddr)
     {
-      *val = vrEmuTms9918ReadStatus(tmsDevice->tms9918);
+      *val = rendererReadStatus(&tmsDevice->renderer) | tmsDevice->status;
+      if (!dbg) tmsDevice->status = 0;
+      if (tmsDevice->thread) pushEvent(tmsDevice, TMS_EVENT_READ_STATUS, 0, 0, 0);
       if (!dbg) hbc56Interrupt(tmsDevice->irq, INTERRUPT_RELEASE);
       return 1;
     }
@@ -267,7 +1187,9 @@ static uint8_t readTms9918Device(HBC56Device* device, uint16_t addr, uint8_t *va
       }
       else
       {
-        *val = vrEmuTms9918ReadData(tmsDevice->tms9918);
+        if (tmsDevice->profile) profileDataAccess(tmsDevice, 0);
+        *val = rendererReadData(&tmsDevice->renderer);
+        if (tmsDevice->thread) pushEvent(tmsDevice, TMS_EVENT_READ_DATA, 0, 0, 0);
       }
       return 1;
     }
@@ -286,18 +1208,91 @@ static uint8_t writeTms9918Device(HBC56Device* device, uint16_t addr, uint8_t va
   {
     if (addr == tmsDevice->regAddr)
     {
-      vrEmuTms9918WriteAddr(tmsDevice->tms9918, val);
+      if (tmsDevice->profile) profileAddrWrite(tmsDevice, val);
+      tmsWriteAddr(tmsDevice, val);
       return 1;
     }
     else if (addr == tmsDevice->dataAddr)
     {
-      vrEmuTms9918WriteData(tmsDevice->tms9918, val);
+      if (tmsDevice->profile) profileDataAccess(tmsDevice, 1);
+      tmsWriteData(tmsDevice, val);
       return 1;
     }
   }
   return 0;
 }
 
+#define TMS9918_STATE_SIZE (TMS9918_NUM_REGS + TMS9918_VRAM_SIZE + sizeof(int32_t))
+
+/* Function:  saveTms9918Device
+ * --------------------
+ * save the tms registers and vram
+ */
+static uint32_t saveTms9918Device(HBC56Device* device, uint8_t* buffer, uint32_t size)
+{
+  TMS9918Device* tmsDevice = getTms9918Device(device);
+  if (tmsDevice)
+  {
+    if (buffer)
+    {
+      if (size < TMS9918_STATE_SIZE)
+        return 0;
+
+      for (int i = 0; i < TMS9918_NUM_REGS; ++i)
+      {
+        *(buffer++) = vrEmuTms9918RegValue(tmsDevice->tms9918, (vrEmuTms9918Register)i);
+      }
+
+      for (int i = 0; i < TMS9918_VRAM_SIZE; ++i)
+      {
+        *(buffer++) = vrEmuTms9918VramValue(tmsDevice->tms9918, (uint16_t)i);
+      }
+
+      int32_t framePixels = tmsDevice->currentFramePixels;
+      memcpy(buffer, &framePixels, sizeof(framePixels));
+    }
+    return TMS9918_STATE_SIZE;
+  }
+  return 0;
+}
+
+/* Function:  loadTms9918Device
+ * --------------------
+ * restore the tms registers and vram
+ */
+static uint8_t loadTms9918Device(HBC56Device* device, const uint8_t* buffer, uint32_t size)
+{
+  TMS9918Device* tmsDevice = getTms9918Device(device);
+  if (tmsDevice && buffer && size == TMS9918_STATE_SIZE)
+  {
+    const uint8_t* regs = buffer;
+    const uint8_t* vram = buffer + TMS9918_NUM_REGS;
+
+    /* set the write address to 0x0000 and stream the vram contents back in.
+       goes through the port so the render thread (if any) follows along */
+    tmsWriteAddr(tmsDevice, 0x00);
+    tmsWriteAddr(tmsDevice, 0x40);
+    for (int i = 0; i < TMS9918_VRAM_SIZE; ++i)
+    {
+      tmsWriteData(tmsDevice, vram[i]);
+    }
+
+    for (int i = 0; i < TMS9918_NUM_REGS; ++i)
+    {
+      tmsWriteReg(tmsDevice, (uint8_t)i, regs[i]);
+    }
+
+    int32_t framePixels = 0;
+    memcpy(&framePixels, vram + TMS9918_VRAM_SIZE, sizeof(framePixels));
+    if (framePixels < 0 || framePixels >= TMS9918_DISPLAY_PIXELS) framePixels = 0;
+    tmsDevice->currentFramePixels = framePixels;
+    tmsDevice->pixelRemainder = 0;
+
+    return 1;
+  }
+  return 0;
+}
+
 /* Function:  readTms9918Vram
  * --------------------
  * read a value from vram directly
@@ -312,6 +1307,27 @@ uint8_t readTms9918Vram(HBC56Device* device, uint16_t vramAddr)
   return 0;
 }
 
+/* Function:  readTms9918VramBlock
+ * --------------------
+ * copy a block of vram in to buffer. returns bytes copied
+ */
+uint32_t readTms9918VramBlock(HBC56Device* device, uint16_t vramAddr, uint8_t* buffer, uint32_t size)
+{
+  TMS9918Device* tmsDevice = getTms9918Device(device);
+  if (tmsDevice && buffer && vramAddr < TMS9918_VRAM_SIZE)
+  {
+    if (size > TMS9918_VRAM_SIZE - vramAddr) size = TMS9918_VRAM_SIZE - vramAddr;
+
+    VrEmuTms9918* tms9918 = tmsDevice->tms9918;
+    for (uint32_t i = 0; i < size; ++i)
+    {
+      buffer[i] = vrEmuTms9918VramValue(tms9918, (uint16_t)(vramAddr + i));
+    }
+    return size;
+  }
+  return 0;
+}
+
 /* Function:  readTms9918Reg
  * --------------------
  * read a registry value directly
@@ -335,6 +1351,187 @@ void writeTms9918Reg(HBC56Device* device, uint8_t reg, uint8_t value)
   TMS9918Device* tmsDevice = getTms9918Device(device);
   if (tmsDevice)
   {
-    vrEmuTms9918WriteRegValue(tmsDevice->tms9918, reg, value);
+    tmsWriteReg(tmsDevice, reg, value);
+  }
+}
+
+/* Function:  enableTms9918Profile
+ * --------------------
+ * start counting vram port accesses
+ */
+void enableTms9918Profile(HBC56Device* device)
+{
+  TMS9918Device* tmsDevice = getTms9918Device(device);
+  if (tmsDevice && !tmsDevice->profile)
+  {
+    tmsDevice->profile = (TMS9918ProfileData*)calloc(1, sizeof(TMS9918ProfileData));
+  }
+}
+
+/* Function:  disableTms9918Profile
+ * --------------------
+ * stop counting vram port accesses unless a frame callback needs them
+ */
+void disableTms9918Profile(HBC56Device* device)
+{
+  TMS9918Device* tmsDevice = getTms9918Device(device);
+  if (tmsDevice && tmsDevice->profile && !tmsDevice->profile->frameFn)
+  {
+    free(tmsDevice->profile);
+    tmsDevice->profile = NULL;
+  }
+}
+
+/* Function:  setTms9918ProfileCallback
+ * --------------------
+ * enable profiling and report each frame's counters
+ */
+void setTms9918ProfileCallback(HBC56Device* device, TMS9918ProfileFn frameFn, void* data)
+{
+  enableTms9918Profile(device);
+
+  TMS9918Device* tmsDevice = getTms9918Device(device);
+  if (tmsDevice && tmsDevice->profile)
+  {
+    tmsDevice->profile->frameFn = frameFn;
+    tmsDevice->profile->frameFnData = data;
+  }
+}
+
+/* Function:  tms9918ProfileLastFrame
+ * --------------------
+ * counters for the last completed frame
+ */
+const TMS9918Profile* tms9918ProfileLastFrame(HBC56Device* device)
+{
+  TMS9918Device* tmsDevice = getTms9918Device(device);
+  if (tmsDevice && tmsDevice->profile)
+  {
+    return &tmsDevice->profile->last;
+  }
+  return NULL;
+}
+
+/* Function:  tms9918ProfileHeat
+ * --------------------
+ * per-address access counts
+ */
+const uint32_t* tms9918ProfileHeat(HBC56Device* device, int writes)
+{
+  TMS9918Device* tmsDevice = getTms9918Device(device);
+  if (tmsDevice && tmsDevice->profile)
+  {
+    return writes ? tmsDevice->profile->writeHeat : tmsDevice->profile->readHeat;
+  }
+  return NULL;
+}
+
+/* Function:  resetTms9918ProfileHeat
+ * --------------------
+ * clear the per-address counts
+ */
+void resetTms9918ProfileHeat(HBC56Device* device)
+{
+  TMS9918Device* tmsDevice = getTms9918Device(device);
+  if (tmsDevice && tmsDevice->profile)
+  {
+    memset(tmsDevice->profile->writeHeat, 0, sizeof(tmsDevice->profile->writeHeat));
+    memset(tmsDevice->profile->readHeat, 0, sizeof(tmsDevice->profile->readHeat));
+  }
+}
+
+/* Function:  tms9918VramTable
+ * --------------------
+ * which table a vram address belongs to
+ */
+TMS9918Table tms9918VramTable(HBC56Device* device, uint16_t vramAddr)
+{
+  TMS9918Device* tmsDevice = getTms9918Device(device);
+  if (tmsDevice)
+  {
+    return vramTable(tmsDevice->tms9918, vramAddr & (TMS9918_VRAM_SIZE - 1));
+  }
+  return TMS9918_TABLE_OTHER;
+}
+
+/* Function:  tms9918Generation
+ * --------------------
+ * the latest change stamp
+ */
+uint32_t tms9918Generation(HBC56Device* device)
+{
+  TMS9918Device* tmsDevice = getTms9918Device(device);
+  return tmsDevice ? tmsDevice->generation : 0;
+}
+
+/* Function:  tms9918RegGeneration
+ * --------------------
+ * stamp of the last register write or reset
+ */
+uint32_t tms9918RegGeneration(HBC56Device* device)
+{
+  TMS9918Device* tmsDevice = getTms9918Device(device);
+  return tmsDevice ? tmsDevice->regGeneration : 0;
+}
+
+/* Function:  tms9918VramGenerations
+ * --------------------
+ * stamps of the last write to each 8 byte block of vram
+ */
+const uint32_t* tms9918VramGenerations(HBC56Device* device)
+{
+  TMS9918Device* tmsDevice = getTms9918Device(device);
+  return tmsDevice ? tmsDevice->vramGenerations : NULL;
+}
+
+/* Function:  setTms9918RenderRate
+ * --------------------
+ * render every frame (1), every Nth frame (N) or no frames (0)
+ */
+void setTms9918RenderRate(HBC56Device* device, int renderEvery)
+{
+  TMS9918Device* tmsDevice = getTms9918Device(device);
+  if (tmsDevice)
+  {
+    tmsDevice->renderEvery = renderEvery < 0 ? 0 : renderEvery;
+
+    /* takes effect from the next frame */
+    if (tmsDevice->currentFramePixels == 0)
+    {
+      tmsDevice->renderFrame = tmsDevice->renderEvery && (tmsDevice->frameCount % tmsDevice->renderEvery) == 0;
+    }
   }
 }
+
+/* Function:  tms9918CyclesToVblank
+ * --------------------
+ * cpu cycles until the beam next reaches vblank (at least 1)
+ */
+uint32_t tms9918CyclesToVblank(HBC56Device* device)
+{
+  TMS9918Device* tmsDevice = getTms9918Device(device);
+  if (!tmsDevice) return HBC56_CLOCK_FREQ / TMS9918_FPS;
+
+  int pixelsToGo = (TMS9918_VBLANK_PIXEL - tmsDevice->currentFramePixels + TMS9918_DISPLAY_PIXELS) % TMS9918_DISPLAY_PIXELS;
+  if (pixelsToGo == 0) pixelsToGo = TMS9918_DISPLAY_PIXELS;
+
+  /* the beam is ahead of currentFramePixels by the carried remainder */
+  int64_t pixelCycles = (int64_t)pixelsToGo * TMS9918_FRAME_CYCLES - (int64_t)tmsDevice->pixelRemainder;
+  if (pixelCycles <= 0) return 1;
+
+  return (uint32_t)((pixelCycles + TMS9918_DISPLAY_PIXELS - 1) / TMS9918_DISPLAY_PIXELS);
+}
+
+/* Function:  tms9918Frame
+ * --------------------
+ * the last completed frame (palette indices)
+ */
+const uint8_t* tms9918Frame(HBC56Device* device, int* width, int* height)
+{
+  TMS9918Device* tmsDevice = getTms9918Device(device);
+  if (!tmsDevice) return NULL;
+
+  if (width) *width = TMS9918_DISPLAY_WIDTH;
+  if (height) *height = TMS9918_DISPLAY_HEIGHT;
+  return tmsDevice->renderer.frontBuffer;
+}
@@ -21,6 +21,35 @@ extern "C" {
 struct SDL_Renderer;
 typedef struct SDL_Renderer SDL_Renderer;
 
+/* vram tables (for access profiling) */
+typedef enum
+{
+  TMS9918_TABLE_NAME,
+  TMS9918_TABLE_PATTERN,
+  TMS9918_TABLE_COLOR,
+  TMS9918_TABLE_SPRITE_ATTR,
+  TMS9918_TABLE_SPRITE_PATT,
+  TMS9918_TABLE_OTHER,
+  TMS9918_TABLE_COUNT
+} TMS9918Table;
+
+/* vram port access counters for a single frame */
+typedef struct
+{
+  uint32_t frame;
+  uint32_t tableWrites[TMS9918_TABLE_COUNT];
+  uint32_t dataWrites;
+  uint32_t dataReads;
+  uint32_t addrSets;        /* random accesses (address set) */
+  uint32_t sequential;      /* data accesses which used the address auto-increment */
+  uint32_t longestRun;      /* most data accesses following a single address set */
+  uint32_t regWrites;
+  uint32_t activeWrites;    /* data writes while the beam is in the active display */
+  uint32_t blankWrites;     /* data writes while the beam is in the border or vblank */
+} TMS9918Profile;
+
+typedef void (*TMS9918ProfileFn)(const TMS9918Profile* frame, void* data);
+
 
 /* Function:  createTms9918Device
  * --------------------
@@ -35,6 +64,12 @@ HBC56Device createTms9918Device(uint16_t dataAddr, uint16_t regAddr, uint8_t irq
  */
 uint8_t readTms9918Vram(HBC56Device *device, uint16_t vramAddr);
 
+/* Function:  readTms9918VramBlock
+ * --------------------
+ * copy a block of the tms9918 vram in to buffer. returns bytes copied
+ */
+uint32_t readTms9918VramBlock(HBC56Device* device, uint16_t vramAddr, uint8_t* buffer, uint32_t size);
+
 
 /* Function:  readTms9918Reg
  * --------------------
@@ -48,6 +83,100 @@ uint8_t readTms9918Reg(HBC56Device* device, uint8_t reg);
  */
 void writeTms9918Reg(HBC56Device* device, uint8_t reg, uint8_t value);
 
+/* Function:  startTms9918RenderThread
+ * --------------------
+ * render the display on a worker thread. the emulation thread logs port
+ * accesses and display spans which the worker replays against its own copy
+ * of the tms9918. output is identical to inline rendering
+ * returns 1 if the thread was started
+ */
+int startTms9918RenderThread(HBC56Device* device);
+
+/* Function:  setTms9918RenderRate
+ * --------------------
+ * render every frame (1), every Nth frame (N) or no frames (0). frames which
+ * aren't rendered still raise interrupts and set the status register (frame,
+ * fifth sprite and coincidence flags) but don't compose any pixels
+ */
+void setTms9918RenderRate(HBC56Device* device, int renderEvery);
+
+/* Function:  tms9918CyclesToVblank
+ * --------------------
+ * cpu cycles until the next vertical blank. lets the scheduler step
+ * directly to the next frame interrupt
+ */
+uint32_t tms9918CyclesToVblank(HBC56Device* device);
+
+/* Function:  tms9918Frame
+ * --------------------
+ * the last completed frame as palette indices (including the border).
+ * only valid when rendering inline (not on a worker thread)
+ */
+const uint8_t* tms9918Frame(HBC56Device* device, int* width, int* height);
+
+/* Function:  enableTms9918Profile
+ * --------------------
+ * start counting vram port accesses
+ */
+void enableTms9918Profile(HBC56Device* device);
+
+/* Function:  disableTms9918Profile
+ * --------------------
+ * stop counting vram port accesses and free the counters. does nothing
+ * while a frame callback is set
+ */
+void disableTms9918Profile(HBC56Device* device);
+
+/* Function:  setTms9918ProfileCallback
+ * --------------------
+ * enable profiling and call frameFn with the counters at the end of each frame
+ */
+void setTms9918ProfileCallback(HBC56Device* device, TMS9918ProfileFn frameFn, void* data);
+
+/* Function:  tms9918ProfileLastFrame
+ * --------------------
+ * counters for the last completed frame. NULL if not profiling
+ */
+const TMS9918Profile* tms9918ProfileLastFrame(HBC56Device* device);
+
+/* Function:  tms9918ProfileHeat
+ * --------------------
+ * per-address (0x4000 entries) write or read counts since the last reset.
+ * NULL if not profiling
+ */
+const uint32_t* tms9918ProfileHeat(HBC56Device* device, int writes);
+
+/* Function:  resetTms9918ProfileHeat
+ * --------------------
+ * clear the per-address counts
+ */
+void resetTms9918ProfileHeat(HBC56Device* device);
+
+/* Function:  tms9918VramTable
+ * --------------------
+ * which table (for the current mode) a vram address belongs to
+ */
+TMS9918Table tms9918VramTable(HBC56Device* device, uint16_t vramAddr);
+
+/* Function:  tms9918Generation
+ * --------------------
+ * change stamp. increases with every vram write, register write or reset.
+ * compare against the stamps below to find what changed since a given stamp
+ */
+uint32_t tms9918Generation(HBC56Device* device);
+
+/* Function:  tms9918RegGeneration
+ * --------------------
+ * stamp of the last register write or reset
+ */
+uint32_t tms9918RegGeneration(HBC56Device* device);
+
+/* Function:  tms9918VramGenerations
+ * --------------------
+ * stamps of the last write to each 8 byte block of vram (0x800 entries)
+ */
+const uint32_t* tms9918VramGenerations(HBC56Device* device);
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,159 @@
+/*
+ * Troy's HBC-56 Emulator - ROM file watcher
+ *
+ * Copyright (c) 2021 Troy Schrapel
+ *
+ * This code is licensed under the MIT license
+ *
+ * https://github.com/visrealm/hbc-56/emulator
+ *
+ */
+
+#include "filewatch.h"
+
+#include "SDL.h"
+
+#include <string.h>
+
+/* wait for the files to be quiet for this long before reporting a change */
+#define FILEWATCH_DEBOUNCE_MS 250
+
+#define FILEWATCH_MAX_FILENAME 1024
+
+#if defined(__linux__)
+
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+
+static int watchFd = -1;
+static char watchRomName[FILEWATCH_MAX_FILENAME] = { 0 };
+static uint32_t changedTicks = 0;
+static int changePending = 0;
+
+/* Function:  isWatchedFile
+ * --------------------
+ * is this file the rom or one of its companion files?
+ */
+static int isWatchedFile(const char* name)
+{
+  size_t romLen = SDL_strlen(watchRomName);
+  if (SDL_strncmp(name, watchRomName, romLen) != 0) return 0;
+
+  name += romLen;
+  return *name == 0 || SDL_strcmp(name, ".lmap") == 0 || SDL_strcmp(name, ".rpt") == 0;
+}
+
+/* Function:  hbc56FileWatchOpen
+ * --------------------
+ * watch a rom file and its companion files (.lmap, .rpt) for changes
+ */
+int hbc56FileWatchOpen(const char* romFilename)
+{
+  char dir[FILEWATCH_MAX_FILENAME];
+
+  hbc56FileWatchClose();
+
+  /* assemblers and editors often replace files rather than writing them in
+     place, so watch the directory and filter by name */
+  SDL_strlcpy(dir, romFilename, sizeof(dir));
+  char* sep = SDL_strrchr(dir, '/');
+  if (sep)
+  {
+    SDL_strlcpy(watchRomName, sep + 1, sizeof(watchRomName));
+    if (sep == dir) ++sep;
+    *sep = 0;
+  }
+  else
+  {
+    SDL_strlcpy(watchRomName, dir, sizeof(watchRomName));
+    SDL_strlcpy(dir, ".", sizeof(dir));
+  }
+
+  watchFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (watchFd < 0)
+  {
+    SDL_Log("Watch: inotify unavailable\n");
+    return 0;
+  }
+
+  if (inotify_add_watch(watchFd, dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0)
+  {
+    SDL_Log("Watch: unable to watch '%s'\n", dir);
+    hbc56FileWatchClose();
+    return 0;
+  }
+
+  SDL_Log("Watch: watching '%s' in '%s'\n", watchRomName, dir);
+
+  return 1;
+}
+
+/* Function:  hbc56FileWatchPoll
+ * --------------------
+ * returns 1 once the watched files have changed and settled
+ */
+int hbc56FileWatchPoll()
+{
+  if (watchFd < 0) return 0;
+
+  char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  for (;;)
+  {
+    ssize_t len = read(watchFd, buffer, sizeof(buffer));
+    if (len <= 0) break;
+
+    for (char* p = buffer; p < buffer + len; )
+    {
+      const struct inotify_event* event = (const struct inotify_event*)p;
+      if (event->len && isWatchedFile(event->name))
+      {
+        changePending = 1;
+        changedTicks = SDL_GetTicks();
+      }
+      p += sizeof(struct inotify_event) + event->len;
+    }
+  }
+
+  if (changePending && (SDL_GetTicks() - changedTicks) >= FILEWATCH_DEBOUNCE_MS)
+  {
+    changePending = 0;
+    return 1;
+  }
+
+  return 0;
+}
+
+/* Function:  hbc56FileWatchClose
+ * --------------------
+ * stop watching
+ */
+void hbc56FileWatchClose()
+{
+  if (watchFd >= 0)
+  {
+    close(watchFd);
+    watchFd = -1;
+  }
+  changePending = 0;
+}
+
+#else
+
+int hbc56FileWatchOpen(const char* romFilename)
+{
+  SDL_Log("Watch: not supported on this platform\n");
+  return 0;
+}
+
+int hbc56FileWatchPoll()
+{
+  return 0;
+}
+
+void hbc56FileWatchClose()
+{
+}
+
+#endif
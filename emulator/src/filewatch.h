@@ -0,0 +1,43 @@
+/*
+ * Troy's HBC-56 Emulator - ROM file watcher
+ *
+ * Copyright (c) 2021 Troy Schrapel
+ *
+ * This code is licensed under the MIT license
+ *
+ * https://github.com/visrealm/hbc-56/emulator
+ *
+ */
+
+#ifndef _HBC56_FILEWATCH_H_
+#define _HBC56_FILEWATCH_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Function:  hbc56FileWatchOpen
+ * --------------------
+ * watch a rom file and its companion files (.lmap, .rpt) for changes
+ * returns 1 if ok
+ */
+int hbc56FileWatchOpen(const char* romFilename);
+
+/* Function:  hbc56FileWatchPoll
+ * --------------------
+ * returns 1 once the watched files have changed and have been quiet
+ * for a short while (the assembler has finished writing them)
+ */
+int hbc56FileWatchPoll();
+
+/* Function:  hbc56FileWatchClose
+ * --------------------
+ * stop watching
+ */
+void hbc56FileWatchClose();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,524 @@
+/*
+ * Troy's HBC-56 Emulator - golden frame checks
+ *
+ * Copyright (c) 2021 Troy Schrapel
+ *
+ * This code is licensed under the MIT license
+ *
+ * https://github.com/visrealm/hbc-56/emulator
+ *
+ */
+
+#include "framecheck.h"
+#include "config.h"
+#include "audio.h"
+#include "audiocapture.h"
+
+#include "devices/tms9918_device.h"
+#include "devices/lcd_device.h"
+
+#include "vrEmuTms9918Util.h"
+
+#include "SDL.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define FRAMECHECK_MAX_CHECKS     256
+#define FRAMECHECK_MAX_LABEL      64
+#define FRAMECHECK_MAX_FILENAME   1024
+#define FRAMECHECK_LCD_PIXELS     (256 * 128)
+
+typedef enum
+{
+  CHECK_TMS,
+  CHECK_LCD,
+  CHECK_PSG                                       /* the psg audio stream so far */
+} FrameCheckDisplay;
+
+typedef struct
+{
+  FrameCheckDisplay display;
+  uint32_t          frame;                        /* when no label */
+  char              label[FRAMECHECK_MAX_LABEL];
+  int               addr;                         /* label address */
+  uint32_t          hit;                          /* which hit of the label (1 = first) */
+  uint32_t          hits;
+  uint64_t          expected;
+  int               hasExpected;
+  uint64_t          actual;
+  int               reached;
+  int               skipped;                      /* couldn't be checked */
+} FrameCheck;
+
+static FrameCheck checks[FRAMECHECK_MAX_CHECKS];
+static int numChecks = 0;
+static int numReached = 0;
+static int numMismatched = 0;
+static int recordMode = 0;
+static int active = 0;
+
+static char manifestName[FRAMECHECK_MAX_FILENAME] = { 0 };
+static HBC56Device* tmsDevice = NULL;
+static HBC56Device* lcdDevice = NULL;
+
+/* addresses with a label checkpoint. checked every instruction */
+static uint8_t labelAddrs[0x10000 >> 3];
+
+static uint8_t lcdPixels[FRAMECHECK_LCD_PIXELS];
+
+
+/* Function:  displayName
+ * --------------------
+ * manifest name of a display
+ */
+static const char* displayName(FrameCheckDisplay display)
+{
+  switch (display)
+  {
+    case CHECK_TMS: return "tms";
+    case CHECK_LCD: return "lcd";
+    default:        return "psg";
+  }
+}
+
+/* Function:  hashBytes
+ * --------------------
+ * fnv-1a style hash over 64-bit words (with a byte-wise tail). a frame is
+ * hashed in a few microseconds
+ */
+static uint64_t hashBytes(const uint8_t* data, size_t size, uint64_t hash)
+{
+  const uint64_t prime = 0x100000001b3ULL;
+
+  while (size >= sizeof(uint64_t))
+  {
+    uint64_t word;
+    memcpy(&word, data, sizeof(word));
+    hash = (hash ^ word) * prime;
+    hash ^= hash >> 29;
+    data += sizeof(word);
+    size -= sizeof(word);
+  }
+
+  while (size--)
+  {
+    hash = (hash ^ *(data++)) * prime;
+  }
+
+  return hash;
+}
+
+/* Function:  hashImage
+ * --------------------
+ * hash an image of one byte per pixel, including its dimensions
+ */
+static uint64_t hashImage(const uint8_t* pixels, int width, int height)
+{
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  uint32_t dims[2] = { (uint32_t)width, (uint32_t)height };
+  hash = hashBytes((const uint8_t*)dims, sizeof(dims), hash);
+  return hashBytes(pixels, (size_t)width * (size_t)height, hash);
+}
+
+/* Function:  grabDisplay
+ * --------------------
+ * get the current pixels of a display
+ */
+static const uint8_t* grabDisplay(FrameCheckDisplay display, int* width, int* height)
+{
+  if (display == CHECK_TMS)
+  {
+    return tmsDevice ? tms9918Frame(tmsDevice, width, height) : NULL;
+  }
+
+  if (lcdDevice && readLcdPixels(lcdDevice, lcdPixels, sizeof(lcdPixels), width, height))
+  {
+    return lcdPixels;
+  }
+  return NULL;
+}
+
+/* Function:  saveMismatch
+ * --------------------
+ * write a display as a bmp file next to the manifest
+ */
+static void saveMismatch(const FrameCheck* check, const uint8_t* pixels, int width, int height)
+{
+  static const uint32_t lcdPal[] = { 0x7dbe00ff, 0x5fa900ff, 0x000000ff };
+
+  uint32_t* rgba = (uint32_t*)malloc((size_t)width * (size_t)height * sizeof(uint32_t));
+  if (!rgba) return;
+
+  for (int i = 0; i < width * height; ++i)
+  {
+    rgba[i] = (check->display == CHECK_TMS) ? vrEmuTms9918Palette[pixels[i] & 0x0f] : lcdPal[pixels[i] % 3];
+  }
+
+  char filename[FRAMECHECK_MAX_FILENAME + 128];
+  if (check->label[0])
+    SDL_snprintf(filename, sizeof(filename), "%s.%s.%s.%u.bmp", manifestName,
+                 displayName(check->display), check->label, check->hit);
+  else
+    SDL_snprintf(filename, sizeof(filename), "%s.%s.%u.bmp", manifestName,
+                 displayName(check->display), check->frame);
+
+  SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormatFrom(rgba, width, height, 32, width * sizeof(uint32_t), SDL_PIXELFORMAT_RGBA8888);
+  if (surface)
+  {
+    if (SDL_SaveBMP(surface, filename) == 0)
+    {
+      SDL_Log("FrameCheck: wrote '%s'\n", filename);
+    }
+    SDL_FreeSurface(surface);
+  }
+  free(rgba);
+}
+
+/* Function:  saveAudioMismatch
+ * --------------------
+ * write the psg audio and register writes so far next to the manifest
+ */
+static void saveAudioMismatch(const FrameCheck* check)
+{
+  char filename[FRAMECHECK_MAX_FILENAME + 128];
+  char base[FRAMECHECK_MAX_FILENAME + 96];
+  if (check->label[0])
+    SDL_snprintf(base, sizeof(base), "%s.psg.%s.%u", manifestName, check->label, check->hit);
+  else
+    SDL_snprintf(base, sizeof(base), "%s.psg.%u", manifestName, check->frame);
+
+  SDL_snprintf(filename, sizeof(filename), "%s.wav", base);
+  if (hbc56AudioCaptureSaveWav(filename))
+  {
+    SDL_Log("FrameCheck: wrote '%s'\n", filename);
+  }
+
+  SDL_snprintf(filename, sizeof(filename), "%s.log", base);
+  if (hbc56AudioCaptureSaveLog(filename))
+  {
+    SDL_Log("FrameCheck: wrote '%s'\n", filename);
+  }
+}
+
+/* Function:  evaluate
+ * --------------------
+ * a checkpoint has been reached. hash the display and compare
+ */
+static void evaluate(FrameCheck* check)
+{
+  if (check->display == CHECK_PSG)
+  {
+    check->reached = 1;
+    ++numReached;
+    check->actual = hbc56AudioCaptureHash();
+
+    if (recordMode) return;
+
+    if (!check->hasExpected || check->actual != check->expected)
+    {
+      if (check->label[0])
+        SDL_Log("FrameCheck: MISMATCH psg @%s#%u: expected %016llx, got %016llx\n",
+                check->label, check->hit, (unsigned long long)check->expected, (unsigned long long)check->actual);
+      else
+        SDL_Log("FrameCheck: MISMATCH psg frame %u: expected %016llx, got %016llx\n",
+                check->frame, (unsigned long long)check->expected, (unsigned long long)check->actual);
+
+      if (numMismatched++ == 0) saveAudioMismatch(check);
+    }
+    return;
+  }
+
+  int width = 0, height = 0;
+  const uint8_t* pixels = grabDisplay(check->display, &width, &height);
+
+  check->reached = 1;
+  ++numReached;
+
+  if (!pixels)
+  {
+    SDL_Log("FrameCheck: %s display not present\n", displayName(check->display));
+    ++numMismatched;
+    return;
+  }
+
+  check->actual = hashImage(pixels, width, height);
+
+  if (recordMode) return;
+
+  if (!check->hasExpected || check->actual != check->expected)
+  {
+    if (check->label[0])
+      SDL_Log("FrameCheck: MISMATCH %s @%s#%u: expected %016llx, got %016llx\n", displayName(check->display),
+              check->label, check->hit, (unsigned long long)check->expected, (unsigned long long)check->actual);
+    else
+      SDL_Log("FrameCheck: MISMATCH %s frame %u: expected %016llx, got %016llx\n", displayName(check->display),
+              check->frame, (unsigned long long)check->expected, (unsigned long long)check->actual);
+
+    /* only the first failure is saved */
+    if (numMismatched++ == 0) saveMismatch(check, pixels, width, height);
+  }
+}
+
+/* Function:  parseLine
+ * --------------------
+ * parse a manifest line in to a checkpoint. returns 1 if ok
+ */
+static int parseLine(char* line, FrameCheck* check, FrameCheckLabelFn labelFn)
+{
+  char display[8] = { 0 };
+  char when[FRAMECHECK_MAX_LABEL + 16] = { 0 };
+  char hash[32] = { 0 };
+
+  int fields = SDL_sscanf(line, "%7s %79s %31s", display, when, hash);
+  if (fields < 2) return 0;
+
+  SDL_memset(check, 0, sizeof(*check));
+
+  if (SDL_strcasecmp(display, "tms") == 0) check->display = CHECK_TMS;
+  else if (SDL_strcasecmp(display, "lcd") == 0) check->display = CHECK_LCD;
+  else if (SDL_strcasecmp(display, "psg") == 0) check->display = CHECK_PSG;
+  else return 0;
+
+  if (when[0] == '@')
+  {
+    char* hit = SDL_strchr(when, '#');
+    check->hit = 1;
+    if (hit)
+    {
+      *hit = 0;
+      check->hit = (uint32_t)SDL_strtoul(hit + 1, NULL, 10);
+      if (check->hit == 0) check->hit = 1;
+    }
+    SDL_strlcpy(check->label, when + 1, sizeof(check->label));
+
+    check->addr = labelFn ? labelFn(check->label) : -1;
+    if (check->addr < 0)
+    {
+      SDL_Log("FrameCheck: unknown label '%s'\n", check->label);
+      return 0;
+    }
+    labelAddrs[check->addr >> 3] |= 1 << (check->addr & 7);
+  }
+  else
+  {
+    check->frame = (uint32_t)SDL_strtoul(when, NULL, 10);
+    check->addr = -1;
+  }
+
+  if (fields == 3 && hash[0] != '-')
+  {
+    check->expected = (uint64_t)SDL_strtoull(hash, NULL, 16);
+    check->hasExpected = 1;
+  }
+
+  return 1;
+}
+
+/* Function:  hbc56FrameCheckOpen
+ * --------------------
+ * load a golden frame manifest
+ */
+int hbc56FrameCheckOpen(const char* manifestFilename, int record,
+                        HBC56Device* tms9918, HBC56Device* lcd,
+                        FrameCheckLabelFn labelFn)
+{
+  SDL_strlcpy(manifestName, manifestFilename, sizeof(manifestName));
+  tmsDevice = tms9918;
+  lcdDevice = lcd;
+  recordMode = record;
+  numChecks = numReached = numMismatched = 0;
+  SDL_memset(labelAddrs, 0, sizeof(labelAddrs));
+
+  SDL_RWops* file = SDL_RWFromFile(manifestFilename, "rb");
+  if (!file)
+  {
+    SDL_Log("FrameCheck: unable to open '%s'\n", manifestFilename);
+    return 0;
+  }
+
+  Sint64 size = SDL_RWsize(file);
+  char* contents = (char*)malloc((size_t)size + 1);
+  if (!contents)
+  {
+    SDL_RWclose(file);
+    return 0;
+  }
+  size = (Sint64)SDL_RWread(file, contents, 1, (size_t)size);
+  contents[size] = 0;
+  SDL_RWclose(file);
+
+  int lineNumber = 0;
+  char* next = contents;
+  while (next && *next)
+  {
+    char* line = next;
+    next = SDL_strchr(line, '\n');
+    if (next) *(next++) = 0;
+    ++lineNumber;
+
+    while (*line == ' ' || *line == '\t') ++line;
+    if (*line == 0 || *line == '\r' || *line == '#') continue;
+
+    if (numChecks == FRAMECHECK_MAX_CHECKS)
+    {
+      SDL_Log("FrameCheck: too many checkpoints\n");
+      break;
+    }
+
+    if (parseLine(line, &checks[numChecks], labelFn))
+    {
+      ++numChecks;
+    }
+    else
+    {
+      SDL_Log("FrameCheck: %s(%d): invalid checkpoint\n", manifestFilename, lineNumber);
+    }
+  }
+  free(contents);
+
+  active = numChecks > 0;
+
+  /* psg checks hash the audio as it's generated (in emulated time). the
+     hashes are only comparable at the nominal rate and channel count. an
+     audio device that negotiated something else fails them */
+  int psgOk = hbc56AudioFreq() == HBC56_AUDIO_FREQ && hbc56AudioChannels() == HBC56_AUDIO_CHANNELS;
+  int psgSkipped = 0;
+  for (int i = 0; i < numChecks; ++i)
+  {
+    FrameCheck* check = &checks[i];
+    if (check->display != CHECK_PSG) continue;
+
+    if (psgOk)
+    {
+      hbc56AudioCaptureRecord(HBC56_AUDIO_FREQ, HBC56_AUDIO_CHANNELS);
+      break;
+    }
+
+    check->skipped = 1;
+    ++psgSkipped;
+    check->reached = 1;
+    ++numReached;
+    if (!recordMode) ++numMismatched;
+  }
+
+  if (psgSkipped)
+  {
+    SDL_Log("FrameCheck: psg checks need %d Hz stereo audio, the audio device is %d Hz, %d channel(s). Use --headless\n",
+            HBC56_AUDIO_FREQ, hbc56AudioFreq(), hbc56AudioChannels());
+  }
+
+  SDL_Log("FrameCheck: %d checkpoints%s\n", numChecks, recordMode ? " (recording)" : "");
+
+  return active;
+}
+
+/* Function:  hbc56FrameCheckFrame
+ * --------------------
+ * an emulated frame has completed
+ */
+void hbc56FrameCheckFrame(uint32_t frame)
+{
+  if (!active) return;
+
+  for (int i = 0; i < numChecks; ++i)
+  {
+    FrameCheck* check = &checks[i];
+    if (!check->reached && check->addr < 0 && check->frame == frame)
+    {
+      evaluate(check);
+    }
+  }
+}
+
+/* Function:  hbc56FrameCheckAddr
+ * --------------------
+ * the cpu is about to execute addr
+ */
+void hbc56FrameCheckAddr(uint16_t addr)
+{
+  if (!(labelAddrs[addr >> 3] & (1 << (addr & 7)))) return;
+
+  for (int i = 0; i < numChecks; ++i)
+  {
+    FrameCheck* check = &checks[i];
+    if (check->addr == addr && !check->reached)
+    {
+      if (++check->hits == check->hit)
+      {
+        evaluate(check);
+      }
+    }
+  }
+}
+
+/* Function:  hbc56FrameCheckDone
+ * --------------------
+ * have all checkpoints been reached?
+ */
+int hbc56FrameCheckDone()
+{
+  return active && numReached == numChecks;
+}
+
+/* Function:  writeManifest
+ * --------------------
+ * rewrite the manifest with the recorded hashes
+ */
+static void writeManifest()
+{
+  SDL_RWops* file = SDL_RWFromFile(manifestName, "wb");
+  if (!file)
+  {
+    SDL_Log("FrameCheck: unable to write '%s'\n", manifestName);
+    return;
+  }
+
+  char line[FRAMECHECK_MAX_LABEL + 64];
+  SDL_snprintf(line, sizeof(line), "# HBC-56 golden frames: <tms|lcd|psg> <frame|@label[#hit]> <hash>\n");
+  SDL_RWwrite(file, line, 1, SDL_strlen(line));
+
+  for (int i = 0; i < numChecks; ++i)
+  {
+    const FrameCheck* check = &checks[i];
+    const char* display = displayName(check->display);
+
+    char when[FRAMECHECK_MAX_LABEL + 16];
+    if (check->label[0])
+      SDL_snprintf(when, sizeof(when), "@%s#%u", check->label, check->hit);
+    else
+      SDL_snprintf(when, sizeof(when), "%u", check->frame);
+
+    int recorded = check->reached && !check->skipped;
+    if (recorded || check->hasExpected)
+      SDL_snprintf(line, sizeof(line), "%s %s %016llx\n", display, when,
+                   (unsigned long long)(recorded ? check->actual : check->expected));
+    else
+      SDL_snprintf(line, sizeof(line), "%s %s -\n", display, when);
+
+    SDL_RWwrite(file, line, 1, SDL_strlen(line));
+  }
+  SDL_RWclose(file);
+
+  SDL_Log("FrameCheck: recorded '%s'\n", manifestName);
+}
+
+/* Function:  hbc56FrameCheckClose
+ * --------------------
+ * report the results
+ */
+int hbc56FrameCheckClose()
+{
+  if (!active) return 0;
+  active = 0;
+
+  if (recordMode)
+  {
+    writeManifest();
+  }
+
+  int missed = numChecks - numReached;
+  SDL_Log("FrameCheck: %d checkpoints, %d reached, %d failed\n", numChecks, numReached, numMismatched);
+
+  return (numMismatched || missed) ? 1 : 0;
+}
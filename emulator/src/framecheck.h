@@ -0,0 +1,67 @@
+/*
+ * Troy's HBC-56 Emulator - golden frame checks
+ *
+ * Copyright (c) 2021 Troy Schrapel
+ *
+ * This code is licensed under the MIT license
+ *
+ * https://github.com/visrealm/hbc-56/emulator
+ *
+ */
+
+#ifndef _HBC56_FRAMECHECK_H_
+#define _HBC56_FRAMECHECK_H_
+
+#include "devices/device.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef int (*FrameCheckLabelFn)(const char* label);   /* returns -1 if not found */
+
+/* Function:  hbc56FrameCheckOpen
+ * --------------------
+ * load a golden frame manifest. each line is:
+ *
+ *   <tms|lcd|psg> <frame|@label[#hit]> <hash>
+ *
+ * psg checks hash the audio generated up to that point. on a mismatch the
+ * audio (wav) and psg register writes (log) are written next to the manifest
+ *
+ * in record mode, the hashes are (re)written when the manifest is closed
+ * returns 1 if ok
+ */
+int hbc56FrameCheckOpen(const char* manifestFilename, int record,
+                        HBC56Device* tms9918, HBC56Device* lcd,
+                        FrameCheckLabelFn labelFn);
+
+/* Function:  hbc56FrameCheckFrame
+ * --------------------
+ * an emulated frame (1/60 second) has completed
+ */
+void hbc56FrameCheckFrame(uint32_t frame);
+
+/* Function:  hbc56FrameCheckAddr
+ * --------------------
+ * the cpu is about to execute addr
+ */
+void hbc56FrameCheckAddr(uint16_t addr);
+
+/* Function:  hbc56FrameCheckDone
+ * --------------------
+ * have all checkpoints been reached?
+ */
+int hbc56FrameCheckDone();
+
+/* Function:  hbc56FrameCheckClose
+ * --------------------
+ * report the results. returns 0 if every checkpoint was reached and matched
+ */
+int hbc56FrameCheckClose();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
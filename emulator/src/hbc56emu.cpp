@@ -23,6 +23,12 @@
 #include "imgui_impl_sdlrenderer.h"
 
 #include "audio.h"
+#include "snapshot.h"
+#include "sharedmem.h"
+#include "filewatch.h"
+#include "framecheck.h"
+#include "audiocapture.h"
+#include "vgmlog.h"
 
 #include "debugger/debugger.h"
 
@@ -41,6 +47,8 @@
 #include <time.h>
 #include <string.h>
 #include <queue>
+#include <string>
+#include <vector>
 
 #define DEFAULT_WINDOW_WIDTH  640
 #define DEFAULT_WINDOW_HEIGHT 480
@@ -52,10 +60,14 @@ static int deviceCount = 0;
 
 static HBC56Device* cpuDevice = NULL;
 static HBC56Device* romDevice = NULL;
+static HBC56Device* ramDevice = NULL;
 static HBC56Device* kbDevice = NULL;
+static HBC56Device* tmsDevice = NULL;
 
 static SDL_Window* window = NULL;
 
+static char romFilename[FILENAME_MAX] = { 0 };
+
 static char tempBuffer[256];
 
 #define MAX_IRQS 5
@@ -66,6 +78,32 @@ SDL_mutex* kbQueueMutex = nullptr;
 
 static std::queue<SDL_KeyboardEvent> pasteQueue;
 
+/* boot point. the kernel has finished booting when it first waits for input */
+#define BOOT_POINT_LABEL      "kbWaitForScancode"
+#define BOOT_POINT_ALT_LABEL  "nesWaitForPress"
+#define BOOT_END_LABEL        "DEFAULT_HBC56_RST_VECTOR"
+
+static const char* bootLabel = NULL;
+static int bootAddr = -1;
+static int bootAltAddr = -1;
+static int bootEndAddr = -1;
+
+/* snapshot state */
+static const char* snapshotDir = NULL;
+static uint64_t romHash = HBC56_SNAPSHOT_HASH_INIT;
+static uint64_t snapshotKey = 0;
+
+/* program injection state */
+struct PendingLoad
+{
+  std::string filename;
+  int         addr;
+};
+static std::vector<PendingLoad> pendingLoads;
+static const char* execArg = NULL;
+static bool loadExec = true;
+static int pendingExecAddr = -1;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -185,6 +223,7 @@ int hbc56LoadRom(const uint8_t* romData, int romDataSize)
     {
       status = setMemoryDeviceContents(romDevice, romData, romDataSize);
     }
+    romHash = hbc56SnapshotHash(HBC56_SNAPSHOT_HASH_INIT, romData, romDataSize);
     hbc56Reset();
   }
   return status;
@@ -323,6 +362,115 @@ void hbc56PasteText(const char* text)
   SDL_UnlockMutex(kbQueueMutex);
 }
 
+/* Function:  hbc56LoadBinary
+ * --------------------
+ * write data directly in to ram at addr. returns number of bytes written
+ * (bytes outside of ram are skipped)
+ */
+int hbc56LoadBinary(uint16_t addr, const uint8_t* data, int size)
+{
+  int written = 0;
+  for (int i = 0; i < size; ++i)
+  {
+    uint32_t a = (uint32_t)addr + i;
+    if (a >= HBC56_RAM_START && a < HBC56_RAM_END)
+    {
+      hbc56MemWrite((uint16_t)a, data[i]);
+      ++written;
+    }
+  }
+  return written;
+}
+
+/* Function:  hexValue
+ * --------------------
+ * parse count hex digits. returns -1 if invalid
+ */
+static int hexValue(const char* str, int count)
+{
+  int val = 0;
+  for (int i = 0; i < count; ++i)
+  {
+    char c = str[i];
+    val <<= 4;
+    if (c >= '0' && c <= '9') val |= c - '0';
+    else if (c >= 'a' && c <= 'f') val |= c - 'a' + 10;
+    else if (c >= 'A' && c <= 'F') val |= c - 'A' + 10;
+    else return -1;
+  }
+  return val;
+}
+
+/* Function:  hbc56LoadHex
+ * --------------------
+ * write intel hex records directly in to ram. returns number of bytes written
+ * or -1 on error. startAddr (optional) is set from a start address record or -1
+ */
+int hbc56LoadHex(const char* hexText, int* startAddr)
+{
+  int written = 0;
+  uint8_t data[256];
+
+  if (startAddr) *startAddr = -1;
+
+  for (const char* p = hexText; p && *p; )
+  {
+    const char* line = SDL_strchr(p, ':');
+    if (!line) break;
+    ++line;
+
+    int len = hexValue(line, 2);
+    int addr = hexValue(line + 2, 4);
+    int type = hexValue(line + 6, 2);
+    if (len < 0 || addr < 0 || type < 0) return -1;
+
+    uint8_t checksum = (uint8_t)(len + (addr >> 8) + addr + type);
+    for (int i = 0; i < len; ++i)
+    {
+      int val = hexValue(line + 8 + i * 2, 2);
+      if (val < 0) return -1;
+      data[i] = (uint8_t)val;
+      checksum += data[i];
+    }
+
+    int recordChecksum = hexValue(line + 8 + len * 2, 2);
+    if (recordChecksum < 0 || (uint8_t)(checksum + recordChecksum) != 0) return -1;
+
+    p = line + 10 + len * 2;
+
+    switch (type)
+    {
+      case 0x00:  /* data */
+        written += hbc56LoadBinary((uint16_t)addr, data, len);
+        break;
+
+      case 0x01:  /* end of file */
+        return written;
+
+      case 0x03:  /* start segment address (cs:ip) */
+        if (startAddr && len == 4) *startAddr = (data[2] << 8) | data[3];
+        break;
+
+      case 0x05:  /* start linear address */
+        if (startAddr && len == 4) *startAddr = (data[2] << 8) | data[3];
+        break;
+
+      default:    /* extended addresses don't apply to a 16-bit address space */
+        break;
+    }
+  }
+  return written;
+}
+
+/* Function:  hbc56Exec
+ * --------------------
+ * continue execution at addr (applied at the end of the current instruction)
+ */
+void hbc56Exec(uint16_t addr)
+{
+  pendingExecAddr = addr;
+}
+
 /* Function:  hbc56ToggleDebugger
  * --------------------
  * toggle the debugger
@@ -386,6 +534,15 @@ void hbc56DebugBreakOnInt()
   debug6502State(cpuDevice, CPU_BREAK_ON_INTERRUPT);
 }
 
+/* Function:  hbc56CpuCycles
+ * --------------------
+ * cpu cycles executed so far
+ */
+uint64_t hbc56CpuCycles()
+{
+  return getCpuCycles(cpuDevice);
+}
+
 /* Function:  hbc56MemRead
  * --------------------
  * read a value from a device
@@ -432,6 +589,267 @@ void hbc56MemWrite(uint16_t addr, uint8_t val)
 
 
 
+/* Function:  readTextFile
+ * --------------------
+ * read a whole file. returns a null terminated buffer (free() it) or NULL
+ */
+static char* readTextFile(const char* filename, long* size)
+{
+  FILE* ptr = NULL;
+#ifndef HAVE_FOPEN_S
+  ptr = fopen(filename, "rb");
+#else
+  fopen_s(&ptr, filename, "rb");
+#endif
+  if (!ptr) return NULL;
+
+  fseek(ptr, 0, SEEK_END);
+  long fsize = ftell(ptr);
+  fseek(ptr, 0, SEEK_SET);
+
+  char* content = (char*)malloc(fsize + 1);
+  if (content)
+  {
+    fsize = (long)fread(content, 1, fsize, ptr);
+    content[fsize] = 0;
+    if (size) *size = fsize;
+  }
+  fclose(ptr);
+  return content;
+}
+
+/* Function:  lmapLabelAddress
+ * --------------------
+ * find a label in an acme .lmap file. returns -1 if not found
+ */
+static int lmapLabelAddress(const char* lmapFilename, const char* label)
+{
+  char* content = readTextFile(lmapFilename, NULL);
+  if (!content) return -1;
+
+  int addr = -1;
+  char name[128];
+  unsigned int value = 0;
+  for (char* line = content; line && *line; )
+  {
+    char* next = SDL_strchr(line, '\n');
+    if (next) *(next++) = 0;
+
+    if (SDL_sscanf(line, " %127s = $%x", name, &value) == 2 && SDL_strcmp(name, label) == 0)
+    {
+      addr = (int)value;
+      break;
+    }
+    line = next;
+  }
+  free(content);
+  return addr;
+}
+
+/* Function:  romLabelAddress
+ * --------------------
+ * find a rom label. the debugger's labels may still be loading (or be stale
+ * after a rebuild), so the rom's .lmap file is checked first
+ * returns -1 if not found
+ */
+static int romLabelAddress(const char* label)
+{
+  int addr = -1;
+  if (romFilename[0])
+  {
+    char lmapFilename[FILENAME_MAX];
+    SDL_snprintf(lmapFilename, sizeof(lmapFilename), "%s.lmap", romFilename);
+    addr = lmapLabelAddress(lmapFilename, label);
+  }
+
+  if (addr < 0)
+  {
+    addr = debuggerLabelAddress(label);
+  }
+  return addr;
+}
+
+/* Function:  parseAddress
+ * --------------------
+ * parse a hex address ($1234, 0x1234 or 1234) or a label. returns -1 if invalid
+ */
+static int parseAddress(const char* str)
+{
+  if (!str || !*str) return -1;
+
+  int addr = romLabelAddress(str);
+  if (addr >= 0) return addr;
+
+  if (str[0] == '$') ++str;
+  else if (str[0] == '0' && (str[1] == 'x' || str[1] == 'X')) str += 2;
+
+  char* end = NULL;
+  long val = strtol(str, &end, 16);
+  if (end == str || *end || val < 0 || val > 0xffff) return -1;
+  return (int)val;
+}
+
+/* Function:  loadProgramFile
+ * --------------------
+ * inject a program file (intel hex or raw binary) in to ram. raw binaries
+ * require a load address. returns the program start address or -1 if unknown
+ */
+static int loadProgramFile(const char* filename, int loadAddr)
+{
+  long size = 0;
+  char* content = readTextFile(filename, &size);
+  if (!content)
+  {
+    SDL_Log("Load: unable to read '%s'\n", filename);
+    return -1;
+  }
+
+  int startAddr = -1;
+  const char* ext = SDL_strrchr(filename, '.');
+  if ((ext && SDL_strcasecmp(ext, ".hex") == 0) || content[0] == ':')
+  {
+    int written = hbc56LoadHex(content, &startAddr);
+    SDL_Log("Load: '%s' %d bytes (intel hex)\n", filename, written);
+  }
+  else if (loadAddr >= 0)
+  {
+    int written = hbc56LoadBinary((uint16_t)loadAddr, (const uint8_t*)content, (int)size);
+    SDL_Log("Load: '%s' %d bytes at $%04x\n", filename, written, loadAddr);
+  }
+  else
+  {
+    SDL_Log("Load: '%s' is a raw binary. Use --load <file>@<addr>\n", filename);
+    free(content);
+    return -1;
+  }
+  free(content);
+
+  /* program entry point from the label map (as per tools/hex2mon.py) */
+  char lmapFilename[FILENAME_MAX];
+  SDL_snprintf(lmapFilename, sizeof(lmapFilename), "%s.lmap", filename);
+  int mainAddr = lmapLabelAddress(lmapFilename, "hbc56Main");
+  if (mainAddr >= 0) startAddr = mainAddr;
+
+  return startAddr;
+}
+
+/* Function:  bootComplete
+ * --------------------
+ * called once the kernel has booted (or a boot snapshot has been restored)
+ */
+static void bootComplete(bool saveSnapshot)
+{
+  bootAddr = bootAltAddr = bootEndAddr = -1;
+
+  if (saveSnapshot && snapshotDir)
+  {
+    hbc56SnapshotSave(snapshotDir, snapshotKey);
+  }
+
+  /* inject any programs given on the command line */
+  int startAddr = -1;
+  for (size_t i = 0; i < pendingLoads.size(); ++i)
+  {
+    int addr = loadProgramFile(pendingLoads[i].filename.c_str(), pendingLoads[i].addr);
+    if (addr >= 0) startAddr = addr;
+  }
+  pendingLoads.clear();
+
+  if (execArg)
+  {
+    startAddr = parseAddress(execArg);
+    if (startAddr < 0) SDL_Log("Load: invalid --exec address '%s'\n", execArg);
+  }
+
+  if (startAddr >= 0 && (execArg || loadExec))
+  {
+    hbc56Exec((uint16_t)startAddr);
+  }
+}
+
+/* Function:  hbc56IsBreakpoint
+ * --------------------
+ * called by the cpu at the end of each instruction. handles the boot point
+ * (snapshot capture and program injection) and pending jumps
+ */
+static uint8_t hbc56IsBreakpoint(uint16_t addr)
+{
+  hbc56FrameCheckAddr(addr);
+
+  if (bootAddr >= 0 && getDebug6502State(cpuDevice) == CPU_RUNNING)
+  {
+    if (addr == bootAddr || addr == bootAltAddr)
+    {
+      bootComplete(true);
+    }
+    else if (addr == bootEndAddr)
+    {
+      /* user code reached. too late to capture a boot snapshot */
+      bootComplete(false);
+    }
+  }
+
+  if (pendingExecAddr >= 0)
+  {
+    jump6502(cpuDevice, (uint16_t)pendingExecAddr);
+    pendingExecAddr = -1;
+  }
+
+  return debuggerIsBreakpoint(addr);
+}
+
+/* Function:  bootInit
+ * --------------------
+ * restore the boot snapshot if we have one, otherwise arm the boot point
+ */
+static void bootInit(const char* config)
+{
+  if (bootLabel)
+  {
+    bootAddr = romLabelAddress(bootLabel);
+    if (bootAddr < 0)
+    {
+      SDL_Log("Boot: label '%s' not found\n", bootLabel);
+    }
+  }
+  else
+  {
+    bootAddr = romLabelAddress(BOOT_POINT_LABEL);
+    bootAltAddr = romLabelAddress(BOOT_POINT_ALT_LABEL);
+    if (bootAddr < 0) bootAddr = bootAltAddr;
+  }
+
+  if (!bootLabel || SDL_strcmp(bootLabel, BOOT_END_LABEL) != 0)
+  {
+    bootEndAddr = romLabelAddress(BOOT_END_LABEL);
+  }
+
+  if (snapshotDir)
+  {
+    snapshotKey = hbc56SnapshotHash(romHash, config, SDL_strlen(config));
+    for (int i = 0; i < hbc56NumDevices(); ++i)
+    {
+      snapshotKey = hbc56SnapshotHash(snapshotKey, devices[i].name, SDL_strlen(devices[i].name) + 1);
+    }
+
+    if (hbc56SnapshotLoad(snapshotDir, snapshotKey))
+    {
+      bootComplete(false);
+      return;
+    }
+
+    /* discard anything partially restored */
+    hbc56Reset();
+  }
+
+  /* no boot point? nothing to wait for */
+  if (bootAddr < 0)
+  {
+    bootComplete(false);
+  }
+}
+
+
 /* emulator constants */
 #define LOGICAL_DISPLAY_SIZE_X 320
 #define LOGICAL_DISPLAY_SIZE_Y 240
@@ -439,6 +857,19 @@ void hbc56MemWrite(uint16_t addr, uint8_t val)
 
 /* emulator state */
 static int done;
+static bool headless = false;       /* no window, no rendering, no audio */
+static bool turbo = false;          /* run as fast as possible */
+static uint32_t exitFrames = 0;     /* exit after this many (1/60 second) frames. 0 = run forever */
+static uint64_t emulatedTicks = 0;
+
+/* turbo mode steps. small enough that devices see the cpu's activity promptly.
+   steps are cut short at vblank so the frame interrupt lands on an exact cycle */
+#define TURBO_TICK_CLOCKS   (HBC56_CLOCK_FREQ / 10000)
+
+/* real time steps are limited to prevent a runaway condition on slow hosts.
+   applied here so every device (and the audio) sees the same step */
+#define MAX_TIMESTEP_SEC    0.001
+#define MAX_TIMESTEP_TICKS  4000
 static double perfFreq = 0.0;
 static int tickCount = 0;
 static int mouseZ = 0;
@@ -455,23 +886,81 @@ static void doTick()
   static double unusedClockTicksTime = 0.0;
   static const double maxTime = 1.0 / 60.0;
 
-  double thisTime = (double)SDL_GetPerformanceCounter() / perfFreq;
-  if (thisTime - lastTime > maxTime) lastTime = thisTime - maxTime;
+  if (turbo)
+  {
+    /* fixed steps of emulated time regardless of the host */
+    uint32_t stepTicks = TURBO_TICK_CLOCKS;
+    if (tmsDevice)
+    {
+      uint32_t vblankTicks = tms9918CyclesToVblank(tmsDevice);
+
+      /* cpu idle in WAI? nothing happens until the frame interrupt. skip to it */
+      if (vblankTicks < stepTicks || isCpu6502Waiting(cpuDevice))
+      {
+        stepTicks = vblankTicks;
+      }
+    }
+
+    for (size_t i = 0; i < deviceCount; ++i)
+    {
+      tickDevice(&devices[i], stepTicks, stepTicks / (double)HBC56_CLOCK_FREQ);
+    }
+    hbc56AudioTick();
+    emulatedTicks += stepTicks;
+    lastTime = 0.0;
+  }
+  else
+  {
+    double thisTime = (double)SDL_GetPerformanceCounter() / perfFreq;
+    if (thisTime - lastTime > maxTime) lastTime = thisTime - maxTime;
+
+    double deltaClockTicksDbl = HBC56_CLOCK_FREQ * (thisTime - lastTime) + unusedClockTicksTime;
+
+    uint32_t deltaClockTicks = (uint32_t)deltaClockTicksDbl;
+    unusedClockTicksTime = deltaClockTicksDbl - (double)deltaClockTicks;
+    double deltaTime = thisTime - lastTime;
 
-  double deltaClockTicksDbl = HBC56_CLOCK_FREQ * (thisTime - lastTime) + unusedClockTicksTime;
+    if (deltaTime > MAX_TIMESTEP_SEC)
+    {
+      deltaClockTicks = MAX_TIMESTEP_TICKS;
+      deltaTime = MAX_TIMESTEP_TICKS / (double)HBC56_CLOCK_FREQ;
+      unusedClockTicksTime = 0.0;
+    }
+
+    if (lastTime != 0)
+    {
+      for (size_t i = 0; i < deviceCount; ++i)
+      {
+        tickDevice(&devices[i], deltaClockTicks, deltaTime);
+      }
+      hbc56AudioTick();
+      emulatedTicks += deltaClockTicks;
+    }
 
-  uint32_t deltaClockTicks = (uint32_t)deltaClockTicksDbl;
-  unusedClockTicksTime = deltaClockTicksDbl - (double)deltaClockTicks;
+    lastTime = thisTime;
+  }
 
-  if (lastTime != 0)
+  /* golden frame checkpoints */
+  static uint32_t lastFrame = 0;
+  uint32_t frame = (uint32_t)(emulatedTicks / (HBC56_CLOCK_FREQ / 60));
+  if (lastFrame < frame)
   {
-    for (size_t i = 0; i < deviceCount; ++i)
+    while (lastFrame < frame)
     {
-      tickDevice(&devices[i], deltaClockTicks, thisTime - lastTime);
+      hbc56FrameCheckFrame(++lastFrame);
     }
+    hbc56SharedMemUpdate(lastFrame);
+  }
+
+  if (exitFrames && frame >= exitFrames)
+  {
+    done = 1;
   }
 
-  lastTime = thisTime;
+  if (headless && hbc56FrameCheckDone())
+  {
+    done = 1;
+  }
 }
 
 
@@ -506,6 +995,12 @@ static void doRender()
   static bool showMemory = true;
   static bool showTms9918Memory = true;
   static bool showTms9918Registers = true;
+  static bool showTms9918Profile = false;
+  static bool showMixer = false;
+  static bool showAudioMetrics = false;
+  static bool showTms9918Patterns = false;
+  static bool showTms9918Names = false;
+  static bool showTms9918Sprites = false;
 
   ImGui_ImplSDLRenderer_NewFrame();
   ImGui_ImplSDL2_NewFrame();
@@ -581,6 +1076,13 @@ static void doRender()
         ImGui::Separator();
         ImGui::MenuItem("TMS9918A VRAM", "<Ctrl> + V", &showTms9918Memory);
         ImGui::MenuItem("TMS9918A Registers", "<Ctrl> + T", &showTms9918Registers);
+        ImGui::MenuItem("TMS9918A VRAM Profile", "", &showTms9918Profile);
+        ImGui::MenuItem("TMS9918A Patterns", "", &showTms9918Patterns);
+        ImGui::MenuItem("TMS9918A Name Table", "", &showTms9918Names);
+        ImGui::MenuItem("TMS9918A Sprites", "", &showTms9918Sprites);
+        ImGui::Separator();
+        ImGui::MenuItem("Audio Mixer", "", &showMixer);
+        ImGui::MenuItem("Audio Metrics", "", &showAudioMetrics);
         ImGui::EndMenu();
       }
 
@@ -646,6 +1148,13 @@ static void doRender()
   if (showBreakpoints) debuggerBreakpointsView(&showBreakpoints);
   if (showTms9918Memory) debuggerVramMemoryView(&showTms9918Memory);
   if (showTms9918Registers) debuggerTmsRegistersView(&showTms9918Registers);
+  if (showTms9918Profile) debuggerVramProfileView(&showTms9918Profile);
+  if (!showTms9918Profile) disableTms9918Profile(tmsDevice);
+  if (showTms9918Patterns) debuggerPatternView(&showTms9918Patterns);
+  if (showTms9918Names) debuggerNameTableView(&showTms9918Names);
+  if (showTms9918Sprites) debuggerSpriteView(&showTms9918Sprites);
+  if (showMixer) debuggerMixerView(&showMixer);
+  if (showAudioMetrics) debuggerAudioMetricsView(&showAudioMetrics);
 
   ImGui::End();
 
@@ -816,6 +1325,15 @@ static void doEvents()
         mouseZ = event.wheel.y;
         break;
       }
+
+      case SDL_DROPFILE:
+      {
+        /* intel hex files are injected in to ram and run */
+        int startAddr = loadProgramFile(event.drop.file, -1);
+        if (startAddr >= 0 && loadExec) hbc56Exec((uint16_t)startAddr);
+        SDL_free(event.drop.file);
+        break;
+      }
     }
 
     if (!skipProcessing)
@@ -852,59 +1370,99 @@ static void doEvents()
   SDL_UnlockMutex(kbQueueMutex);
 }
 
-/* Function:  loop
+static char bootConfig[256] = { 0 };
+static bool watchRom = false;
+static bool tmsThread = false;
+
+static FILE* vramProfileFile = NULL;
+static TMS9918Profile vramProfileTotals;
+
+/* Function:  vramProfileFrame
  * --------------------
- * the main loop. will be called many times per frame
+ * write a frame's vram access counters to the profile csv
  */
-static void loop()
+static void vramProfileFrame(const TMS9918Profile* frame, void*)
 {
-  static uint32_t lastRenderTicks = 0;
-
-  doTick();
+  fprintf(vramProfileFile, "%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u\n",
+          frame->frame, frame->dataWrites, frame->dataReads,
+          frame->tableWrites[TMS9918_TABLE_NAME], frame->tableWrites[TMS9918_TABLE_PATTERN],
+          frame->tableWrites[TMS9918_TABLE_COLOR], frame->tableWrites[TMS9918_TABLE_SPRITE_ATTR],
+          frame->tableWrites[TMS9918_TABLE_SPRITE_PATT], frame->tableWrites[TMS9918_TABLE_OTHER],
+          frame->addrSets, frame->sequential, frame->longestRun, frame->regWrites,
+          frame->activeWrites, frame->blankWrites);
+
+  vramProfileTotals.frame++;
+  vramProfileTotals.dataWrites += frame->dataWrites;
+  vramProfileTotals.dataReads += frame->dataReads;
+  vramProfileTotals.addrSets += frame->addrSets;
+  vramProfileTotals.sequential += frame->sequential;
+  vramProfileTotals.activeWrites += frame->activeWrites;
+  if (frame->longestRun > vramProfileTotals.longestRun) vramProfileTotals.longestRun = frame->longestRun;
+}
 
-  ++tickCount;
+/* Function:  openVramProfile
+ * --------------------
+ * start writing per-frame vram access counters to a csv file
+ */
+static void openVramProfile(const char* filename, HBC56Device* tms9918Device)
+{
+#ifndef HAVE_FOPEN_S
+  vramProfileFile = fopen(filename, "w");
+#else
+  fopen_s(&vramProfileFile, filename, "w");
+#endif
 
-  uint32_t currentTicks = SDL_GetTicks();
-  if ((currentTicks - lastRenderTicks) > 17)
+  if (!vramProfileFile)
   {
-    doRender();
-
-    lastRenderTicks = currentTicks;
-    tickCount = 0;
-
-    doEvents();
-
-    SDL_snprintf(tempBuffer, sizeof(tempBuffer), "Troy's HBC-56 Emulator - %0.6f%%", getCpuUtilization(cpuDevice) * 100.0f);
-    SDL_SetWindowTitle(window, tempBuffer);
-
+    SDL_Log("VRAM profile: unable to create '%s'\n", filename);
+    return;
   }
 
-
-#ifdef __EMSCRIPTEN__
-  if (done) {
-    emscripten_cancel_main_loop();
-  }
-#endif
+  fprintf(vramProfileFile, "frame,writes,reads,name,pattern,color,sprite_attr,sprite_patt,other,"
+                           "addr_sets,sequential,longest_run,reg_writes,active_writes,blank_writes\n");
+  SDL_memset(&vramProfileTotals, 0, sizeof(vramProfileTotals));
+  setTms9918ProfileCallback(tms9918Device, vramProfileFrame, NULL);
 }
 
-#ifdef __EMSCRIPTEN__
-/* Function:  wasmLoop
+/* Function:  closeVramProfile
  * --------------------
- * calls loop() as many times as it can per frame
+ * finish the profile csv and log a summary
  */
-static void wasmLoop()
+static void closeVramProfile()
 {
-  while (1)
-  {
-    loop();
-    if (tickCount == 0) break;
-  }
+  if (!vramProfileFile) return;
+
+  fclose(vramProfileFile);
+  vramProfileFile = NULL;
+
+  uint32_t frames = vramProfileTotals.frame ? vramProfileTotals.frame : 1;
+  SDL_Log("VRAM profile: %u frames. per frame: %u writes (%u in active display), %u reads, %u address sets, %u sequential. longest run: %u\n",
+          vramProfileTotals.frame, vramProfileTotals.dataWrites / frames, vramProfileTotals.activeWrites / frames,
+          vramProfileTotals.dataReads / frames, vramProfileTotals.addrSets / frames, vramProfileTotals.sequential / frames,
+          vramProfileTotals.longestRun);
 }
-#endif
 
 
-static char labelMapFile[FILENAME_MAX] = { 0 };
+/* Function:  loadCompanionFiles
+ * --------------------
+ * load the label map (<rom>.lmap) and source listing (<rom>.rpt) if present
+ * they are parsed in the background so the rom can start running
+ */
+static void loadCompanionFiles(const char* filename)
+{
+  char companionFile[FILENAME_MAX];
+
+  SDL_snprintf(companionFile, sizeof(companionFile), "%s.lmap", filename);
+  char* labelContent = readTextFile(companionFile, NULL);
+
+  SDL_snprintf(companionFile, sizeof(companionFile), "%s.rpt", filename);
+  char* rptContent = readTextFile(companionFile, NULL);
 
+  if (labelContent || rptContent)
+  {
+    debuggerLoadAsync(labelContent, rptContent);
+  }
+}
 
 /* Function:  loadRom
  * --------------------
@@ -934,53 +1492,7 @@ static int loadRom(const char* filename)
 
     if (romLoaded)
     {
-      SDL_strlcpy(labelMapFile, filename, FILENAME_MAX);
-      size_t ln = SDL_strlen(labelMapFile);
-      SDL_strlcpy(labelMapFile + ln, ".lmap", FILENAME_MAX - ln);
-
-#ifndef HAVE_FOPEN_S
-      ptr = fopen(labelMapFile, "rb");
-#else
-      fopen_s(&ptr, labelMapFile, "rb");
-#endif
-      if (ptr)
-      {
-        fseek(ptr, 0, SEEK_END);
-        long fsize = ftell(ptr);
-        fseek(ptr, 0, SEEK_SET);  /* same as rewind(f); */
-
-        char *lblFileContent = (char*)malloc(fsize + 1);
-        fread(lblFileContent, fsize, 1, ptr);
-        lblFileContent[fsize] = 0;
-        fclose(ptr);
-
-        hbc56LoadLabels(lblFileContent);
-        free(lblFileContent);
-      }
-
-      SDL_strlcpy(labelMapFile, filename, FILENAME_MAX);
-      ln = SDL_strlen(labelMapFile);
-      SDL_strlcpy(labelMapFile + ln, ".rpt", FILENAME_MAX - ln);
-
-#ifndef HAVE_FOPEN_S
-      ptr = fopen(labelMapFile, "rb");
-#else
-      fopen_s(&ptr, labelMapFile, "rb");
-#endif
-      if (ptr)
-      {
-        fseek(ptr, 0, SEEK_END);
-        long fsize = ftell(ptr);
-        fseek(ptr, 0, SEEK_SET);  /* same as rewind(f); */
-
-        char* lblFileContent = (char*)malloc(fsize + 1);
-        fread(lblFileContent, fsize, 1, ptr);
-        lblFileContent[fsize] = 0;
-        fclose(ptr);
-
-        hbc56LoadSource(lblFileContent);
-        free(lblFileContent);
-      }
+      SDL_strlcpy(romFilename, filename, FILENAME_MAX);
     }
   }
   else
@@ -995,20 +1507,129 @@ static int loadRom(const char* filename)
   return romLoaded;
 }
 
-/* Function:  main
+/* Function:  reloadRom
  * --------------------
- * the program entry point
+ * the rom (or its companion files) changed on disk. swap in the new rom and
+ * reload labels and source. breakpoints and the debugger layout are kept
  */
-int main(int argc, char* argv[])
+static void reloadRom()
+{
+  long size = 0;
+  char* rom = readTextFile(romFilename, &size);
+  if (!rom) return;
+
+  /* a partially written rom? wait for the next change */
+  if (size != HBC56_ROM_SIZE)
+  {
+    SDL_Log("Watch: '%s' is %ld bytes. Not reloading\n", romFilename, size);
+    free(rom);
+    return;
+  }
+
+  HBC56CpuState cpuState = getDebug6502State(cpuDevice);
+
+  hbc56LoadRom((const uint8_t*)rom, (int)size);
+  free(rom);
+
+  loadCompanionFiles(romFilename);
+
+  bootInit(bootConfig);
+
+  if (cpuState != CPU_RUNNING)
+  {
+    debug6502State(cpuDevice, CPU_BREAK);
+  }
+
+  SDL_Log("Watch: reloaded '%s'\n", romFilename);
+}
+
+/* Function:  doHeadlessEvents
+ * --------------------
+ * no window, so only watch for a quit (eg. ctrl+c)
+ */
+static void doHeadlessEvents()
 {
-  if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER | SDL_INIT_GAMECONTROLLER) != 0)
+  SDL_Event event;
+  while (SDL_PollEvent(&event))
   {
-    printf("Error: %s\n", SDL_GetError());
-    return -1;
+    if (event.type == SDL_QUIT) done = 1;
   }
+}
 
-  kbQueueMutex = SDL_CreateMutex();
+/* Function:  loop
+ * --------------------
+ * the main loop. will be called many times per frame
+ */
+static void loop()
+{
+  static uint32_t lastRenderTicks = 0;
+
+  doTick();
+
+  ++tickCount;
+
+  uint32_t currentTicks = SDL_GetTicks();
+  if ((currentTicks - lastRenderTicks) > 17)
+  {
+    if (headless)
+    {
+      doHeadlessEvents();
+    }
+    else
+    {
+      doRender();
+    }
+
+    lastRenderTicks = currentTicks;
+    tickCount = 0;
+
+    if (!headless) doEvents();
+
+    debuggerUpdate();
+
+    if (hbc56FileWatchPoll())
+    {
+      reloadRom();
+    }
+
+    if (!headless)
+    {
+      SDL_snprintf(tempBuffer, sizeof(tempBuffer), "Troy's HBC-56 Emulator - %0.6f%%", getCpuUtilization(cpuDevice) * 100.0f);
+      SDL_SetWindowTitle(window, tempBuffer);
+    }
+
+  }
+
+
+#ifdef __EMSCRIPTEN__
+  if (done) {
+    emscripten_cancel_main_loop();
+  }
+#endif
+}
+
+#ifdef __EMSCRIPTEN__
+/* Function:  wasmLoop
+ * --------------------
+ * calls loop() as many times as it can per frame
+ */
+static void wasmLoop()
+{
+  while (1)
+  {
+    loop();
+    if (tickCount == 0) break;
+  }
+}
+#endif
 
+
+/* Function:  initGui
+ * --------------------
+ * create the window, renderer and imgui context. returns 0 on failure
+ */
+static int initGui()
+{
   SDL_WindowFlags window_flags = (SDL_WindowFlags)(SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI);
   window = SDL_CreateWindow("HBC-56 Emulator", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 1600, 800, window_flags);
 
@@ -1067,6 +1688,43 @@ int main(int argc, char* argv[])
   ImGui_ImplSDL2_InitForSDLRenderer(window, renderer);
   ImGui_ImplSDLRenderer_Init(renderer);
 
+  return 1;
+}
+
+
+/* Function:  main
+ * --------------------
+ * the program entry point
+ */
+int main(int argc, char* argv[])
+{
+  /* headless has to be known before anything is created */
+  for (int i = 1; i < argc; ++i)
+  {
+    if (SDL_strcasecmp(argv[i], "--headless") == 0) headless = true;
+
+    /* measure the psg synthesis cost and exit */
+    if (SDL_strcasecmp(argv[i], "--psg-benchmark") == 0)
+    {
+      SDL_LogSetPriority(SDL_LOG_CATEGORY_APPLICATION, SDL_LOG_PRIORITY_INFO);
+      int ok = ay38910SynthCheck(HBC56_AY38910_CLOCK, HBC56_AUDIO_FREQ);
+      ay38910SynthBenchmark(HBC56_AY38910_CLOCK, HBC56_AUDIO_FREQ);
+      return ok ? 0 : 1;
+    }
+  }
+
+  if (SDL_Init(headless ? SDL_INIT_TIMER : (SDL_INIT_VIDEO | SDL_INIT_TIMER | SDL_INIT_GAMECONTROLLER)) != 0)
+  {
+    printf("Error: %s\n", SDL_GetError());
+    return -1;
+  }
+
+  kbQueueMutex = SDL_CreateMutex();
+
+  if (!headless && !initGui())
+  {
+    return 0;
+  }
 
   perfFreq = (double)SDL_GetPerformanceFrequency();
 
@@ -1078,7 +1736,7 @@ int main(int argc, char* argv[])
 //  state->window_title = tempBuffer;
 
   /* add the cpu device */
-  cpuDevice = hbc56AddDevice(create6502CpuDevice(debuggerIsBreakpoint));
+  cpuDevice = hbc56AddDevice(create6502CpuDevice(hbc56IsBreakpoint));
 
   /* initialise the debugger */
   debuggerInit(getCpuDevice(cpuDevice));
@@ -1092,6 +1750,16 @@ int main(int argc, char* argv[])
   lcdType = LCD_GRAPHICS;
 #endif
   int doBreak = 0;
+  const char* sharedMemName = NULL;
+  const char* vramProfileName = NULL;
+  int tmsRenderEvery = -1;
+  int psgQuality = -1;
+  char* wavFilename = NULL;
+  int wavStems = 0;
+  char* audioMetricsFilename = NULL;
+  char* vgmFilename = NULL;
+  const char* goldenName = NULL;
+  int goldenRecord = 0;
 
   /* parse arguments */
   for (int i = 1; i < argc;)
@@ -1137,6 +1805,185 @@ int main(int argc, char* argv[])
           ++i;
         }
       }
+      /* inject a program in to ram */
+      else if (SDL_strcasecmp(argv[i], "--load") == 0)
+      {
+        if (argv[i + 1])
+        {
+          consumed = 1;
+          PendingLoad load;
+          load.filename = argv[++i];
+          load.addr = -1;
+          size_t at = load.filename.rfind('@');
+          if (at != std::string::npos)
+          {
+            load.addr = parseAddress(load.filename.c_str() + at + 1);
+            load.filename.resize(at);
+          }
+          pendingLoads.push_back(load);
+        }
+      }
+      /* start address for injected programs */
+      else if (SDL_strcasecmp(argv[i], "--exec") == 0)
+      {
+        if (argv[i + 1])
+        {
+          consumed = 1;
+          execArg = argv[++i];
+        }
+      }
+      /* load only. don't jump to injected programs */
+      else if (SDL_strcasecmp(argv[i], "--no-exec") == 0)
+      {
+        consumed = 1;
+        loadExec = false;
+      }
+      /* export machine state to shared memory? */
+      else if (SDL_strcasecmp(argv[i], "--shm") == 0)
+      {
+        if (argv[i + 1])
+        {
+          consumed = 1;
+          sharedMemName = argv[++i];
+        }
+      }
+      /* boot snapshot cache directory */
+      else if (SDL_strcasecmp(argv[i], "--snapshot-dir") == 0)
+      {
+        if (argv[i + 1])
+        {
+          consumed = 1;
+          snapshotDir = argv[++i];
+        }
+      }
+      /* reload the rom when it changes on disk */
+      else if (SDL_strcasecmp(argv[i], "--watch") == 0)
+      {
+        consumed = 1;
+        watchRom = true;
+      }
+      /* per-frame vram access counters */
+      else if (SDL_strcasecmp(argv[i], "--vram-profile") == 0)
+      {
+        if (argv[i + 1])
+        {
+          consumed = 1;
+          vramProfileName = argv[++i];
+        }
+      }
+      /* no window. implies --turbo and --tms-render 0 */
+      else if (SDL_strcasecmp(argv[i], "--headless") == 0)
+      {
+        consumed = 1;
+        headless = true;
+        turbo = true;
+      }
+      /* run as fast as possible */
+      else if (SDL_strcasecmp(argv[i], "--turbo") == 0)
+      {
+        consumed = 1;
+        turbo = true;
+      }
+      /* exit after a number of frames */
+      else if (SDL_strcasecmp(argv[i], "--frames") == 0)
+      {
+        if (argv[i + 1])
+        {
+          consumed = 1;
+          exitFrames = (uint32_t)SDL_strtoul(argv[++i], NULL, 10);
+        }
+      }
+      /* tms9918 render rate */
+      else if (SDL_strcasecmp(argv[i], "--tms-render") == 0)
+      {
+        if (argv[i + 1])
+        {
+          consumed = 1;
+          tmsRenderEvery = SDL_atoi(argv[++i]);
+        }
+      }
+      /* golden frame manifest */
+      else if (SDL_strcasecmp(argv[i], "--golden") == 0)
+      {
+        if (argv[i + 1])
+        {
+          consumed = 1;
+          goldenName = argv[++i];
+        }
+      }
+      /* record the golden frame hashes */
+      else if (SDL_strcasecmp(argv[i], "--golden-record") == 0)
+      {
+        consumed = 1;
+        goldenRecord = 1;
+      }
+      /* psg synthesis quality */
+      else if (SDL_strcasecmp(argv[i], "--psg-quality") == 0)
+      {
+        if (argv[i + 1])
+        {
+          consumed = 1;
+          psgQuality = ay38910QualityFromName(argv[++i]);
+          if (psgQuality < 0) SDL_Log("Unknown psg quality: %s", argv[i]);
+        }
+      }
+      /* capture the audio to a file */
+      else if (SDL_strcasecmp(argv[i], "--wav") == 0)
+      {
+        if (argv[i + 1])
+        {
+          consumed = 1;
+          wavFilename = argv[++i];
+        }
+      }
+      /* also capture each psg to its own file */
+      else if (SDL_strcasecmp(argv[i], "--wav-stems") == 0)
+      {
+        consumed = 1;
+        wavStems = 1;
+      }
+      /* log the psg register writes to a vgm file */
+      else if (SDL_strcasecmp(argv[i], "--vgm") == 0)
+      {
+        if (argv[i + 1])
+        {
+          consumed = 1;
+          vgmFilename = argv[++i];
+        }
+      }
+      /* audio device buffer size */
+      else if (SDL_strcasecmp(argv[i], "--audio-buffer") == 0)
+      {
+        if (argv[i + 1])
+        {
+          consumed = 1;
+          hbc56AudioSetBufferSamples(SDL_atoi(argv[++i]));
+        }
+      }
+      /* write the audio pipeline metrics on exit */
+      else if (SDL_strcasecmp(argv[i], "--audio-metrics") == 0)
+      {
+        if (argv[i + 1])
+        {
+          consumed = 1;
+          audioMetricsFilename = argv[++i];
+        }
+      }
+      /* render the tms9918 on a worker thread */
+      else if (SDL_strcasecmp(argv[i], "--tms-thread") == 0)
+      {
+        consumed = 1;
+        tmsThread = true;
+      }
+      /* boot snapshot capture label */
+      else if (SDL_strcasecmp(argv[i], "--snapshot-at") == 0)
+      {
+        if (argv[i + 1])
+        {
+          consumed = 1;
+          bootLabel = argv[++i];
+        }
+      }
     }
     if (consumed < 0)
     {
@@ -1149,12 +1996,15 @@ int main(int argc, char* argv[])
 
   if (romLoaded == 0)
   {
-    static const char* options[] = { "--rom <romfile>","[--brk]","[--keyboard]","[--lcd 1602|2004|12864]", NULL };
+    static const char* options[] = { "--rom <romfile>","[--brk]","[--keyboard]","[--lcd 1602|2004|12864]","[--snapshot-dir <dir>]","[--snapshot-at <label>]","[--shm <name>]","[--load <file>[@addr]]","[--exec <addr|label>]","[--no-exec]","[--watch]","[--tms-thread]","[--vram-profile <csvfile>]","[--headless]","[--turbo]","[--frames <n>]","[--tms-render <n>]","[--golden <manifest>]","[--golden-record]","[--psg-quality legacy|blep|low|medium|high]","[--psg-benchmark]","[--wav <file>]","[--wav-stems]","[--audio-buffer <samples>]","[--audio-metrics <csvfile>]","[--vgm <file>]", NULL };
     //SDLCommonLogUsage(state, argv[0], options);
 
 #ifndef __EMSCRIPTEN__
     SDL_snprintf(tempBuffer, sizeof(tempBuffer), "No HBC-56 ROM file.\n\nUse --rom <romfile>");
-    SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Troy's HBC-56 Emulator", tempBuffer, NULL);
+    if (headless)
+      SDL_Log("%s\n", tempBuffer);
+    else
+      SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Troy's HBC-56 Emulator", tempBuffer, NULL);
 #endif
 
     return 2;
@@ -1164,11 +2014,26 @@ int main(int argc, char* argv[])
   srand((unsigned int)time(NULL));
 
   /* add the various devices */
-  hbc56AddDevice(createRamDevice(HBC56_RAM_START, HBC56_RAM_END));
+  ramDevice = hbc56AddDevice(createRamDevice(HBC56_RAM_START, HBC56_RAM_END));
 
+  HBC56Device *tms9918Device = NULL;
+  HBC56Device *lcdDevice = NULL;
 #if HBC56_HAVE_TMS9918
-  HBC56Device *tms9918Device = hbc56AddDevice(createTms9918Device(HBC56_IO_ADDRESS(HBC56_TMS9918_DAT_PORT), HBC56_IO_ADDRESS(HBC56_TMS9918_REG_PORT), HBC56_TMS9918_IRQ, renderer));
-  debuggerInitTms(tms9918Device);
+  tms9918Device = hbc56AddDevice(createTms9918Device(HBC56_IO_ADDRESS(HBC56_TMS9918_DAT_PORT), HBC56_IO_ADDRESS(HBC56_TMS9918_REG_PORT), HBC56_TMS9918_IRQ, renderer));
+  tmsDevice = tms9918Device;
+  debuggerInitTms(tms9918Device, renderer);
+  if (goldenName)
+  {
+    /* frames are hashed from the inline renderer, every frame. fixed time
+       steps so the frames are the same each run */
+    tmsThread = false;
+    tmsRenderEvery = 1;
+    turbo = true;
+  }
+  if (tmsThread) startTms9918RenderThread(tms9918Device);
+  if (vramProfileName) openVramProfile(vramProfileName, tms9918Device);
+  if (tmsRenderEvery < 0 && headless) tmsRenderEvery = 0;
+  if (tmsRenderEvery >= 0) setTms9918RenderRate(tms9918Device, tmsRenderEvery);
 #endif
 
 #if HBC56_HAVE_KB
@@ -1183,20 +2048,35 @@ int main(int argc, char* argv[])
 #if HBC56_HAVE_LCD
   //if (lcdType != LCD_NONE)
   {
-    hbc56AddDevice(createLcdDevice(lcdType, HBC56_IO_ADDRESS(HBC56_LCD_DAT_PORT), HBC56_IO_ADDRESS(HBC56_LCD_CMD_PORT), renderer));
+    lcdDevice = hbc56AddDevice(createLcdDevice(lcdType, HBC56_IO_ADDRESS(HBC56_LCD_DAT_PORT), HBC56_IO_ADDRESS(HBC56_LCD_CMD_PORT), renderer));
   }
 #endif
 
   /* initialise audio */
-  hbc56Audio(1);
+  if (!headless) hbc56Audio(1);
 
 #if HBC56_HAVE_AY_3_8910
-  hbc56AddDevice(createAY38910Device(HBC56_IO_ADDRESS(HBC56_AY38910_A_PORT), HBC56_AY38910_CLOCK, hbc56AudioFreq(), hbc56AudioChannels()));
+  HBC56Device* ayDevice = hbc56AddDevice(createAY38910Device(HBC56_IO_ADDRESS(HBC56_AY38910_A_PORT), HBC56_AY38910_CLOCK, hbc56AudioFreq(), hbc56AudioChannels()));
+  if (psgQuality >= 0) setAy38910Quality(ayDevice, (AY38910Quality)psgQuality);
   #if HBC56_AY_3_8910_COUNT > 1
-    hbc56AddDevice(createAY38910Device(HBC56_IO_ADDRESS(HBC56_AY38910_B_PORT), HBC56_AY38910_CLOCK, hbc56AudioFreq(), hbc56AudioChannels()));
+    ayDevice = hbc56AddDevice(createAY38910Device(HBC56_IO_ADDRESS(HBC56_AY38910_B_PORT), HBC56_AY38910_CLOCK, hbc56AudioFreq(), hbc56AudioChannels()));
+    if (psgQuality >= 0) setAy38910Quality(ayDevice, (AY38910Quality)psgQuality);
   #endif
 #endif
 
+  /* audio capture. after the audio devices so their mixer channels exist */
+  if (wavFilename)
+  {
+    hbc56AudioCaptureOpen(wavFilename, wavStems, hbc56AudioFreq(), hbc56AudioChannels());
+  }
+
+#if HBC56_HAVE_AY_3_8910
+  if (vgmFilename)
+  {
+    hbc56VgmLogOpen(vgmFilename, HBC56_AY_3_8910_COUNT, HBC56_AY38910_CLOCK);
+  }
+#endif
+
 #ifdef _WINDOWS
 #if HBC56_HAVE_UART
   hbc56AddDevice(createUartDevice(HBC56_IO_ADDRESS(HBC56_UART_PORT), HBC56_UART_PORTNAME, HBC56_UART_CLOCK_FREQ, HBC56_UART_IRQ));
@@ -1208,6 +2088,28 @@ int main(int argc, char* argv[])
   /* reset the machine */
   hbc56Reset();
 
+  /* labels and source. parsed in the background once all devices exist */
+  loadCompanionFiles(romFilename);
+
+  /* restore the boot snapshot or wait for the boot point */
+  SDL_snprintf(bootConfig, sizeof(bootConfig), "clock=%d;lcd=%d;at=%s", HBC56_CLOCK_FREQ, (int)lcdType, bootLabel ? bootLabel : "");
+  bootInit(bootConfig);
+
+  if (goldenName)
+  {
+    hbc56FrameCheckOpen(goldenName, goldenRecord, tms9918Device, lcdDevice, romLabelAddress);
+  }
+
+  if (watchRom)
+  {
+    hbc56FileWatchOpen(romFilename);
+  }
+
+  if (sharedMemName)
+  {
+    hbc56SharedMemOpen(sharedMemName, cpuDevice, ramDevice, tms9918Device);
+  }
+
   if (doBreak)hbc56DebugBreak();
 
   SDL_Delay(100);
@@ -1222,25 +2124,46 @@ int main(int argc, char* argv[])
   }
 #endif
 
+  int exitCode = hbc56FrameCheckClose();
+
+  if (headless || audioMetricsFilename)
+  {
+    hbc56AudioLogMetrics(audioMetricsFilename);
+  }
+
+  /* stop the audio callback before the devices it renders go away */
+  hbc56Audio(0);
+
+  hbc56AudioCaptureClose();
+
+  hbc56VgmLogClose();
+
   /* clean up  */
   for (size_t i = 0; i < deviceCount; ++i)
   {
     destroyDevice(&devices[i]);
   }
 
-  hbc56Audio(0);
+  hbc56SharedMemClose();
+
+  hbc56FileWatchClose();
+
+  closeVramProfile();
 
   SDL_AudioQuit();
 
-  ImGui_ImplSDLRenderer_Shutdown();
-  ImGui_ImplSDL2_Shutdown();
-  ImGui::DestroyContext();
+  if (!headless)
+  {
+    ImGui_ImplSDLRenderer_Shutdown();
+    ImGui_ImplSDL2_Shutdown();
+    ImGui::DestroyContext();
 
-  SDL_DestroyRenderer(renderer);
-  SDL_DestroyWindow(window);
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+  }
   SDL_Quit();
 
   SDL_DestroyMutex(kbQueueMutex);
 
-  return 0;
+  return exitCode;
 }
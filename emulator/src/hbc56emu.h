@@ -90,6 +90,25 @@ const char *hbc56GetLayout();
  */
 void hbc56PasteText(const char* text);
 
+/* Function:  hbc56LoadBinary
+ * --------------------
+ * write data directly in to ram at addr. returns number of bytes written
+ */
+int hbc56LoadBinary(uint16_t addr, const uint8_t* data, int size);
+
+/* Function:  hbc56LoadHex
+ * --------------------
+ * write intel hex records directly in to ram. returns number of bytes written
+ * or -1 on error. startAddr (optional) is set from a start address record or -1
+ */
+int hbc56LoadHex(const char* hexText, int* startAddr);
+
+/* Function:  hbc56Exec
+ * --------------------
+ * continue execution at addr
+ */
+void hbc56Exec(uint16_t addr);
+
 /* Function:  hbc56ToggleDebugger
  * --------------------
  * toggle the debugger
@@ -132,6 +151,12 @@ void hbc56DebugStepOut();
  */
 void hbc56DebugBreakOnInt();
 
+/* Function:  hbc56CpuCycles
+ * --------------------
+ * cpu cycles executed so far. used to timestamp device accesses
+ */
+uint64_t hbc56CpuCycles();
+
 uint8_t hbc56MemRead(uint16_t addr, bool dbg);
 void hbc56MemWrite(uint16_t addr, uint8_t val);
 
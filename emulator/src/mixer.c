@@ -0,0 +1,159 @@
+/*
+ * Troy's HBC-56 Emulator - Audio mixer
+ *
+ * Copyright (c) 2021 Troy Schrapel
+ *
+ * This code is licensed under the MIT license
+ *
+ * https://github.com/visrealm/hbc-56/emulator
+ *
+ */
+
+#include "mixer.h"
+
+#include "SDL.h"
+
+#include <string.h>
+
+static HBC56MixerChannel channels[HBC56_MIXER_MAX_CHANNELS];
+static int channelCount = 0;
+
+/* planar stereo accumulators */
+static float mixLeft[HBC56_MIXER_MAX_FRAMES];
+static float mixRight[HBC56_MIXER_MAX_FRAMES];
+
+/* Function:  hbc56MixerAddChannel
+ * --------------------
+ * add a mixer channel. returns the channel number or -1 if there is no room
+ */
+int hbc56MixerAddChannel(const char* name, int group, float gain, float pan)
+{
+  if (channelCount >= HBC56_MIXER_MAX_CHANNELS) return -1;
+
+  HBC56MixerChannel* channel = &channels[channelCount];
+  SDL_memset(channel, 0, sizeof(HBC56MixerChannel));
+  SDL_strlcpy(channel->name, name, sizeof(channel->name));
+  channel->group = group;
+  channel->gain = gain;
+  channel->pan = pan;
+
+  return channelCount++;
+}
+
+/* Function:  hbc56MixerChannelCount
+ * --------------------
+ * number of mixer channels
+ */
+int hbc56MixerChannelCount()
+{
+  return channelCount;
+}
+
+/* Function:  hbc56MixerChannel
+ * --------------------
+ * a mixer channel (NULL if out of range)
+ */
+HBC56MixerChannel* hbc56MixerChannel(int channel)
+{
+  if (channel < 0 || channel >= channelCount) return NULL;
+  return &channels[channel];
+}
+
+/* Function:  mixChannels
+ * --------------------
+ * mix numFrames of the (audible) channels in group (-1 for all) into the
+ * interleaved stream. channels are accumulated into planar left/right
+ * buffers with straight multiply-adds (vectorized by the compiler) and
+ * interleaved once at the end
+ */
+static void mixChannels(float* stream, int streamChannels, int numFrames, int group)
+{
+  if (numFrames > HBC56_MIXER_MAX_FRAMES) numFrames = HBC56_MIXER_MAX_FRAMES;
+  if (numFrames <= 0) return;
+
+  int anySolo = 0;
+  for (int c = 0; c < channelCount; ++c)
+  {
+    anySolo |= channels[c].solo;
+  }
+
+  memset(mixLeft, 0, numFrames * sizeof(float));
+  memset(mixRight, 0, numFrames * sizeof(float));
+
+  for (int c = 0; c < channelCount; ++c)
+  {
+    HBC56MixerChannel* channel = &channels[c];
+    const float* in = channel->buffer;
+
+    if (group >= 0 && channel->group != group) continue;
+
+    /* level meter. measured before mute/solo so silenced channels still show */
+    if (group < 0)
+    {
+      float peak = 0.0f;
+      for (int i = 0; i < numFrames; ++i)
+      {
+        float level = in[i] < 0.0f ? -in[i] : in[i];
+        peak = level > peak ? level : peak;
+      }
+      channel->peak = peak;
+    }
+
+    if (channel->mute || (anySolo && !channel->solo)) continue;
+
+    /* balance pan. centre is full level on both sides */
+    float pan = channel->pan < -1.0f ? -1.0f : (channel->pan > 1.0f ? 1.0f : channel->pan);
+    float leftGain = channel->gain * (pan > 0.0f ? 1.0f - pan : 1.0f);
+    float rightGain = channel->gain * (pan < 0.0f ? 1.0f + pan : 1.0f);
+
+    if (leftGain != 0.0f)
+    {
+      for (int i = 0; i < numFrames; ++i)
+      {
+        mixLeft[i] += in[i] * leftGain;
+      }
+    }
+
+    if (rightGain != 0.0f)
+    {
+      for (int i = 0; i < numFrames; ++i)
+      {
+        mixRight[i] += in[i] * rightGain;
+      }
+    }
+  }
+
+  if (streamChannels > 1)
+  {
+    for (int i = 0; i < numFrames; ++i)
+    {
+      stream[i * streamChannels] += mixLeft[i];
+      stream[i * streamChannels + 1] += mixRight[i];
+    }
+  }
+  else
+  {
+    for (int i = 0; i < numFrames; ++i)
+    {
+      stream[i] += (mixLeft[i] + mixRight[i]) * 0.5f;
+    }
+  }
+}
+
+/* Function:  hbc56MixerMix
+ * --------------------
+ * mix numFrames of every (audible) channel into the interleaved stream
+ */
+void hbc56MixerMix(float* stream, int streamChannels, int numFrames)
+{
+  mixChannels(stream, streamChannels, numFrames, -1);
+}
+
+/* Function:  hbc56MixerMixGroup
+ * --------------------
+ * mix numFrames of a group's (audible) channels into the interleaved stream
+ */
+void hbc56MixerMixGroup(float* stream, int streamChannels, int numFrames, int group)
+{
+  mixChannels(stream, streamChannels, numFrames, group);
+}
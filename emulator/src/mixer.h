@@ -0,0 +1,73 @@
+/*
+ * Troy's HBC-56 Emulator - Audio mixer
+ *
+ * Copyright (c) 2021 Troy Schrapel
+ *
+ * This code is licensed under the MIT license
+ *
+ * https://github.com/visrealm/hbc-56/emulator
+ *
+ */
+
+#ifndef _HBC56_MIXER_H_
+#define _HBC56_MIXER_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HBC56_MIXER_MAX_CHANNELS  16
+#define HBC56_MIXER_MAX_FRAMES    2048      /* per mix */
+#define HBC56_MIXER_NAME_LEN      32
+
+/* a mixer channel. audio devices render their output (mono, planar) into
+   the channel buffer and the mixer combines every channel into the stream */
+typedef struct
+{
+  char      name[HBC56_MIXER_NAME_LEN];
+  int       group;        /* channels from the same device share a group (e.g. for stems) */
+  float     gain;
+  float     pan;          /* -1.0 (left) to 1.0 (right) */
+  int       mute;
+  int       solo;
+  float     peak;         /* peak level of the last mix */
+  float     buffer[HBC56_MIXER_MAX_FRAMES];
+} HBC56MixerChannel;
+
+/* Function:  hbc56MixerAddChannel
+ * --------------------
+ * add a mixer channel. returns the channel number or -1 if there is no room
+ */
+int hbc56MixerAddChannel(const char* name, int group, float gain, float pan);
+
+/* Function:  hbc56MixerChannelCount
+ * --------------------
+ * number of mixer channels
+ */
+int hbc56MixerChannelCount();
+
+/* Function:  hbc56MixerChannel
+ * --------------------
+ * a mixer channel (NULL if out of range)
+ */
+HBC56MixerChannel* hbc56MixerChannel(int channel);
+
+/* Function:  hbc56MixerMix
+ * --------------------
+ * mix numFrames of every (audible) channel into the interleaved stream
+ */
+void hbc56MixerMix(float* stream, int streamChannels, int numFrames);
+
+/* Function:  hbc56MixerMixGroup
+ * --------------------
+ * mix numFrames of a group's (audible) channels into the interleaved stream
+ */
+void hbc56MixerMixGroup(float* stream, int streamChannels, int numFrames, int group);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
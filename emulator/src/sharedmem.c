@@ -0,0 +1,180 @@
+/*
+ * Troy's HBC-56 Emulator - Shared memory export
+ *
+ * Copyright (c) 2021 Troy Schrapel
+ *
+ * This code is licensed under the MIT license
+ *
+ * https://github.com/visrealm/hbc-56/emulator
+ *
+ */
+
+#include "sharedmem.h"
+
+#include "devices/6502_device.h"
+#include "devices/memory_device.h"
+#include "devices/tms9918_device.h"
+
+#include "vrEmu6502.h"
+
+#include "SDL.h"
+
+#include <string.h>
+
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__)
+#define HBC56_HAVE_SHM 1
+#else
+#define HBC56_HAVE_SHM 0
+#endif
+
+#if HBC56_HAVE_SHM
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static HBC56SharedState* sharedState = NULL;
+static char sharedName[256] = { 0 };
+
+static HBC56Device* sharedCpu = NULL;
+static HBC56Device* sharedRam = NULL;
+static HBC56Device* sharedTms = NULL;
+static uint32_t sharedTmsGeneration = 0;
+
+/* Function:  hbc56SharedMemOpen
+ * --------------------
+ * create and map the named shared memory region
+ */
+int hbc56SharedMemOpen(const char* name, HBC56Device* cpu, HBC56Device* ram, HBC56Device* tms)
+{
+  if (sharedState || !name) return 0;
+
+  /* posix shared memory names must start with a slash */
+  SDL_snprintf(sharedName, sizeof(sharedName), "%s%s", (name[0] == '/') ? "" : "/", name);
+
+  int fd = shm_open(sharedName, O_CREAT | O_RDWR, 0644);
+  if (fd < 0)
+  {
+    SDL_Log("Shared memory: unable to open '%s'\n", sharedName);
+    return 0;
+  }
+
+  if (ftruncate(fd, sizeof(HBC56SharedState)) != 0)
+  {
+    SDL_Log("Shared memory: unable to size '%s'\n", sharedName);
+    close(fd);
+    shm_unlink(sharedName);
+    return 0;
+  }
+
+  void* ptr = mmap(NULL, sizeof(HBC56SharedState), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (ptr == MAP_FAILED)
+  {
+    SDL_Log("Shared memory: unable to map '%s'\n", sharedName);
+    shm_unlink(sharedName);
+    return 0;
+  }
+
+  sharedState = (HBC56SharedState*)ptr;
+  memset(sharedState, 0, sizeof(HBC56SharedState));
+  sharedState->magic = HBC56_SHM_MAGIC;
+  sharedState->version = HBC56_SHM_VERSION;
+
+  sharedCpu = cpu;
+  sharedRam = ram;
+  sharedTms = tms;
+  sharedTmsGeneration = 0;
+
+  SDL_Log("Shared memory: exporting to '%s'\n", sharedName);
+
+  return 1;
+}
+
+/* Function:  hbc56SharedMemUpdate
+ * --------------------
+ * copy the current machine state to the shared memory region
+ */
+void hbc56SharedMemUpdate(uint64_t frame)
+{
+  if (!sharedState) return;
+
+  /* seqlock: odd sequence while writing */
+  __atomic_store_n(&sharedState->sequence, sharedState->sequence + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  sharedState->frame = frame;
+  sharedState->cycles = getCpuCycles(sharedCpu);
+
+  VrEmu6502* cpu6502 = getCpuDevice(sharedCpu);
+  if (cpu6502)
+  {
+    sharedState->pc = vrEmu6502GetPC(cpu6502);
+    sharedState->a = vrEmu6502GetAcc(cpu6502);
+    sharedState->x = vrEmu6502GetX(cpu6502);
+    sharedState->y = vrEmu6502GetY(cpu6502);
+    sharedState->sp = vrEmu6502GetStackPointer(cpu6502);
+    sharedState->status = vrEmu6502GetStatus(cpu6502);
+    sharedState->cpuState = (uint8_t)getDebug6502State(sharedCpu);
+  }
+
+  uint32_t ramSize = 0;
+  const uint8_t* ram = getMemoryDeviceContents(sharedRam, &ramSize);
+  if (ram)
+  {
+    if (ramSize > HBC56_SHM_RAM_SIZE) ramSize = HBC56_SHM_RAM_SIZE;
+    memcpy(sharedState->ram, ram, ramSize);
+  }
+
+  if (sharedTms)
+  {
+    for (int i = 0; i < sizeof(sharedState->tmsRegs); ++i)
+    {
+      sharedState->tmsRegs[i] = readTms9918Reg(sharedTms, (uint8_t)i);
+    }
+
+    /* vram is only copied when something has changed it */
+    uint32_t generation = tms9918Generation(sharedTms);
+    if (generation != sharedTmsGeneration)
+    {
+      readTms9918VramBlock(sharedTms, 0, sharedState->vram, HBC56_SHM_VRAM_SIZE);
+      sharedTmsGeneration = generation;
+    }
+  }
+
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  __atomic_store_n(&sharedState->sequence, sharedState->sequence + 1, __ATOMIC_RELEASE);
+}
+
+/* Function:  hbc56SharedMemClose
+ * --------------------
+ * unmap and remove the shared memory region
+ */
+void hbc56SharedMemClose()
+{
+  if (!sharedState) return;
+
+  munmap(sharedState, sizeof(HBC56SharedState));
+  shm_unlink(sharedName);
+  sharedState = NULL;
+}
+
+#else
+
+int hbc56SharedMemOpen(const char* name, HBC56Device* cpu, HBC56Device* ram, HBC56Device* tms)
+{
+  SDL_Log("Shared memory: not supported on this platform\n");
+  return 0;
+}
+
+void hbc56SharedMemUpdate(uint64_t frame)
+{
+}
+
+void hbc56SharedMemClose()
+{
+}
+
+#endif
@@ -0,0 +1,84 @@
+/*
+ * Troy's HBC-56 Emulator - Shared memory export
+ *
+ * Copyright (c) 2021 Troy Schrapel
+ *
+ * This code is licensed under the MIT license
+ *
+ * https://github.com/visrealm/hbc-56/emulator
+ *
+ */
+
+#ifndef _HBC56_SHAREDMEM_H_
+#define _HBC56_SHAREDMEM_H_
+
+#include "devices/device.h"
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* the shared memory region layout. external tools can include this header.
+   readers should:
+     1. read sequence (retry while odd)
+     2. copy what they need
+     3. read sequence again. if it changed, retry */
+
+#define HBC56_SHM_MAGIC     0x4d534248   /* "HBSM" */
+#define HBC56_SHM_VERSION   1
+#define HBC56_SHM_RAM_SIZE  0x8000
+#define HBC56_SHM_VRAM_SIZE 0x4000
+
+typedef struct
+{
+  uint32_t magic;
+  uint32_t version;
+  volatile uint32_t sequence;   /* odd while the emulator is writing */
+  uint32_t reserved;
+  uint64_t frame;               /* emulated frame number */
+  uint64_t cycles;              /* cpu cycles executed */
+
+  /* cpu registers */
+  uint16_t pc;
+  uint8_t  a;
+  uint8_t  x;
+  uint8_t  y;
+  uint8_t  sp;
+  uint8_t  status;
+  uint8_t  cpuState;            /* HBC56CpuState */
+
+  /* tms9918 registers */
+  uint8_t  tmsRegs[8];
+
+  uint8_t  ram[HBC56_SHM_RAM_SIZE];
+  uint8_t  vram[HBC56_SHM_VRAM_SIZE];
+} HBC56SharedState;
+
+
+/* Function:  hbc56SharedMemOpen
+ * --------------------
+ * create and map the named shared memory region. returns 1 if ok
+ * tms may be NULL
+ */
+int hbc56SharedMemOpen(const char* name, HBC56Device* cpu, HBC56Device* ram, HBC56Device* tms);
+
+/* Function:  hbc56SharedMemUpdate
+ * --------------------
+ * copy the current machine state to the shared memory region. called when
+ * an emulated frame completes
+ */
+void hbc56SharedMemUpdate(uint64_t frame);
+
+/* Function:  hbc56SharedMemClose
+ * --------------------
+ * unmap and remove the shared memory region
+ */
+void hbc56SharedMemClose();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
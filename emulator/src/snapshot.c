@@ -0,0 +1,280 @@
+/*
+ * Troy's HBC-56 Emulator - Snapshots
+ *
+ * Copyright (c) 2021 Troy Schrapel
+ *
+ * This code is licensed under the MIT license
+ *
+ * https://github.com/visrealm/hbc-56/emulator
+ *
+ */
+
+#include "snapshot.h"
+#include "hbc56emu.h"
+#include "devices/device.h"
+
+#include "SDL.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* snapshot file format:
+     header:  magic (8 bytes), version (uint32), key (uint64), device count (uint32)
+     devices: name length (uint32), name, state size (uint32), state
+   only devices which have a save function are included */
+
+#define SNAPSHOT_MAGIC        "HBC56SNP"
+#define SNAPSHOT_MAGIC_LEN    8
+#define SNAPSHOT_VERSION      1
+#define SNAPSHOT_MAX_FILENAME 1024
+
+/* Function:  hbc56SnapshotHash
+ * --------------------
+ * accumulate data into a snapshot key (64-bit FNV-1a)
+ */
+uint64_t hbc56SnapshotHash(uint64_t hash, const void* data, size_t size)
+{
+  const uint8_t* p = (const uint8_t*)data;
+  for (size_t i = 0; i < size; ++i)
+  {
+    hash ^= p[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+/* Function:  snapshotFilename
+ * --------------------
+ * build the snapshot file name for a given key
+ */
+static void snapshotFilename(char* buffer, size_t size, const char* dir, uint64_t key)
+{
+  size_t dirLen = SDL_strlen(dir);
+  const char* sep = (dirLen && dir[dirLen - 1] != '/' && dir[dirLen - 1] != '\\') ? "/" : "";
+
+  SDL_snprintf(buffer, size, "%s%s%08x%08x.snap", dir, sep,
+               (unsigned int)(key >> 32), (unsigned int)(key & 0xffffffff));
+}
+
+/* Function:  writeUint32 / writeUint64
+ * --------------------
+ * write values (little endian)
+ */
+static int writeUint32(SDL_RWops* rw, uint32_t val)
+{
+  uint8_t buf[4];
+  for (int i = 0; i < 4; ++i) buf[i] = (uint8_t)(val >> (i * 8));
+  return SDL_RWwrite(rw, buf, sizeof(buf), 1) == 1;
+}
+
+static int writeUint64(SDL_RWops* rw, uint64_t val)
+{
+  return writeUint32(rw, (uint32_t)val) && writeUint32(rw, (uint32_t)(val >> 32));
+}
+
+/* Function:  readUint32 / readUint64
+ * --------------------
+ * read values from a buffer (little endian). advances pos
+ */
+static int readUint32(const uint8_t* data, size_t size, size_t* pos, uint32_t* val)
+{
+  if (*pos + 4 > size) return 0;
+
+  *val = 0;
+  for (int i = 0; i < 4; ++i) *val |= (uint32_t)data[*pos + i] << (i * 8);
+  *pos += 4;
+  return 1;
+}
+
+static int readUint64(const uint8_t* data, size_t size, size_t* pos, uint64_t* val)
+{
+  uint32_t lo = 0, hi = 0;
+  if (!readUint32(data, size, pos, &lo) || !readUint32(data, size, pos, &hi)) return 0;
+  *val = ((uint64_t)hi << 32) | lo;
+  return 1;
+}
+
+/* Function:  numSnapshotDevices
+ * --------------------
+ * number of devices which can be saved
+ */
+static uint32_t numSnapshotDevices()
+{
+  uint32_t count = 0;
+  int deviceCount = hbc56NumDevices();
+  for (int i = 0; i < deviceCount; ++i)
+  {
+    if (hbc56Device(i)->saveFn) ++count;
+  }
+  return count;
+}
+
+/* Function:  hbc56SnapshotSave
+ * --------------------
+ * save the state of all devices to <dir>/<key>.snap
+ */
+int hbc56SnapshotSave(const char* dir, uint64_t key)
+{
+  char filename[SNAPSHOT_MAX_FILENAME];
+  char tmpFilename[SNAPSHOT_MAX_FILENAME];
+  uint8_t* buffer = NULL;
+  uint32_t bufferSize = 0;
+  int ok = 1;
+
+  if (!dir) return 0;
+
+  snapshotFilename(filename, sizeof(filename), dir, key);
+  SDL_snprintf(tmpFilename, sizeof(tmpFilename), "%s.tmp", filename);
+
+  SDL_RWops* rw = SDL_RWFromFile(tmpFilename, "wb");
+  if (!rw)
+  {
+    SDL_Log("Snapshot: unable to create '%s'\n", tmpFilename);
+    return 0;
+  }
+
+  ok = SDL_RWwrite(rw, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_LEN, 1) == 1 &&
+       writeUint32(rw, SNAPSHOT_VERSION) &&
+       writeUint64(rw, key) &&
+       writeUint32(rw, numSnapshotDevices());
+
+  int deviceCount = hbc56NumDevices();
+  for (int i = 0; ok && i < deviceCount; ++i)
+  {
+    HBC56Device* device = hbc56Device(i);
+    if (!device->saveFn) continue;
+
+    /* a device with a save function which returns 0 can't be saved right now */
+    uint32_t size = saveDevice(device, NULL, 0);
+    if (size == 0)
+    {
+      SDL_Log("Snapshot: device '%s' can't be saved\n", device->name);
+      ok = 0;
+      break;
+    }
+
+    if (size > bufferSize)
+    {
+      uint8_t* newBuffer = (uint8_t*)realloc(buffer, size);
+      if (!newBuffer) { ok = 0; break; }
+      buffer = newBuffer;
+      bufferSize = size;
+    }
+
+    uint32_t nameLen = (uint32_t)SDL_strlen(device->name);
+    ok = saveDevice(device, buffer, size) == size &&
+         writeUint32(rw, nameLen) &&
+         SDL_RWwrite(rw, device->name, 1, nameLen) == nameLen &&
+         writeUint32(rw, size) &&
+         SDL_RWwrite(rw, buffer, 1, size) == size;
+  }
+
+  free(buffer);
+  SDL_RWclose(rw);
+
+  if (ok)
+  {
+    /* write to a temporary file and move it into place so concurrent
+       instances never see a partial snapshot */
+    if (rename(tmpFilename, filename) != 0)
+    {
+      remove(filename);
+      ok = rename(tmpFilename, filename) == 0;
+    }
+  }
+
+  if (!ok)
+  {
+    remove(tmpFilename);
+    SDL_Log("Snapshot: unable to save '%s'\n", filename);
+  }
+  else
+  {
+    SDL_Log("Snapshot: saved '%s'\n", filename);
+  }
+
+  return ok;
+}
+
+/* Function:  hbc56SnapshotLoad
+ * --------------------
+ * restore the state of all devices from <dir>/<key>.snap
+ */
+int hbc56SnapshotLoad(const char* dir, uint64_t key)
+{
+  char filename[SNAPSHOT_MAX_FILENAME];
+
+  if (!dir) return 0;
+
+  snapshotFilename(filename, sizeof(filename), dir, key);
+
+  SDL_RWops* rw = SDL_RWFromFile(filename, "rb");
+  if (!rw) return 0;
+
+  int64_t fileSize = SDL_RWsize(rw);
+  uint8_t* data = (fileSize > 0) ? (uint8_t*)malloc((size_t)fileSize) : NULL;
+  size_t size = 0;
+  if (data)
+  {
+    size = SDL_RWread(rw, data, 1, (size_t)fileSize);
+  }
+  SDL_RWclose(rw);
+
+  if (!data) return 0;
+
+  /* validate the whole file before restoring anything */
+  size_t pos = SNAPSHOT_MAGIC_LEN;
+  uint32_t version = 0, count = 0;
+  uint64_t fileKey = 0;
+  int ok = size >= SNAPSHOT_MAGIC_LEN &&
+           memcmp(data, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_LEN) == 0 &&
+           readUint32(data, size, &pos, &version) && version == SNAPSHOT_VERSION &&
+           readUint64(data, size, &pos, &fileKey) && fileKey == key &&
+           readUint32(data, size, &pos, &count) && count == numSnapshotDevices();
+
+  size_t devicesPos = pos;
+  int deviceCount = hbc56NumDevices();
+
+  for (int pass = 0; ok && pass < 2; ++pass)
+  {
+    pos = devicesPos;
+    for (int i = 0; ok && i < deviceCount; ++i)
+    {
+      HBC56Device* device = hbc56Device(i);
+      if (!device->saveFn) continue;
+
+      uint32_t nameLen = 0, stateSize = 0;
+      ok = readUint32(data, size, &pos, &nameLen) &&
+           pos + nameLen <= size &&
+           nameLen == SDL_strlen(device->name) &&
+           memcmp(data + pos, device->name, nameLen) == 0;
+      if (!ok) break;
+      pos += nameLen;
+
+      ok = readUint32(data, size, &pos, &stateSize) && pos + stateSize <= size;
+      if (!ok) break;
+
+      /* second pass restores */
+      if (pass == 1)
+      {
+        ok = loadDevice(device, data + pos, stateSize);
+        if (!ok) SDL_Log("Snapshot: device '%s' failed to restore\n", device->name);
+      }
+      pos += stateSize;
+    }
+  }
+
+  free(data);
+
+  if (ok)
+  {
+    SDL_Log("Snapshot: restored '%s'\n", filename);
+  }
+  else
+  {
+    SDL_Log("Snapshot: '%s' is invalid\n", filename);
+  }
+
+  return ok;
+}
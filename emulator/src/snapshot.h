@@ -0,0 +1,50 @@
+/*
+ * Troy's HBC-56 Emulator - Snapshots
+ *
+ * Copyright (c) 2021 Troy Schrapel
+ *
+ * This code is licensed under the MIT license
+ *
+ * https://github.com/visrealm/hbc-56/emulator
+ *
+ */
+
+#ifndef _HBC56_SNAPSHOT_H_
+#define _HBC56_SNAPSHOT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HBC56_SNAPSHOT_HASH_INIT 0xcbf29ce484222325ULL
+
+/* Function:  hbc56SnapshotHash
+ * --------------------
+ * accumulate data into a snapshot key (64-bit FNV-1a)
+ * start with HBC56_SNAPSHOT_HASH_INIT
+ */
+uint64_t hbc56SnapshotHash(uint64_t hash, const void* data, size_t size);
+
+/* Function:  hbc56SnapshotSave
+ * --------------------
+ * save the state of all devices to <dir>/<key>.snap
+ * returns 1 if saved, 0 if not
+ */
+int hbc56SnapshotSave(const char* dir, uint64_t key);
+
+/* Function:  hbc56SnapshotLoad
+ * --------------------
+ * restore the state of all devices from <dir>/<key>.snap
+ * nothing is restored unless the whole snapshot is valid
+ * returns 1 if restored, 0 if not
+ */
+int hbc56SnapshotLoad(const char* dir, uint64_t key);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
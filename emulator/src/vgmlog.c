@@ -0,0 +1,222 @@
+/*
+ * Troy's HBC-56 Emulator - VGM register log
+ *
+ * Copyright (c) 2021 Troy Schrapel
+ *
+ * This code is licensed under the MIT license
+ *
+ * https://github.com/visrealm/hbc-56/emulator
+ *
+ */
+
+#include "vgmlog.h"
+#include "hbc56emu.h"
+
+#include "SDL.h"
+
+#define VGM_SAMPLE_RATE     44100             /* vgm timing is in 1/44100 second samples */
+#define VGM_VERSION         0x151
+#define VGM_HEADER_SIZE     0x80
+#define VGM_BUFFER_SIZE     0x10000
+
+/* header offsets */
+#define VGM_EOF_OFFSET      0x04
+#define VGM_VERSION_OFFSET  0x08
+#define VGM_TOTAL_SAMPLES   0x18
+#define VGM_RATE            0x24
+#define VGM_DATA_OFFSET     0x34
+#define VGM_AY8910_CLOCK    0x74
+#define VGM_AY8910_TYPE     0x78
+#define VGM_AY8910_FLAGS    0x79
+
+#define VGM_AY8910_DUAL     0x40000000        /* clock bit: a second chip is present */
+
+/* commands */
+#define VGM_CMD_WAIT        0x61              /* nn nn: wait n samples */
+#define VGM_CMD_WAIT_NTSC   0x62              /* wait 735 samples (1/60 second) */
+#define VGM_CMD_WAIT_PAL    0x63              /* wait 882 samples (1/50 second) */
+#define VGM_CMD_END         0x66
+#define VGM_CMD_WAIT_SHORT  0x70              /* 0x7n: wait n+1 samples */
+#define VGM_CMD_AY8910      0xa0              /* aa dd: write dd to register aa. bit 7 of aa selects the second chip */
+
+static SDL_RWops* vgmFile = NULL;
+static uint8_t vgmBuffer[VGM_BUFFER_SIZE];
+static int vgmBufferCount = 0;
+static uint32_t vgmBytes = 0;                 /* data bytes written */
+static uint64_t vgmStartCycle = 0;
+static uint64_t vgmSamples = 0;               /* samples waited so far */
+static int vgmChips = 0;
+static int vgmClock = 0;
+
+/* Function:  flushVgm
+ * --------------------
+ * write out the buffered commands
+ */
+static void flushVgm()
+{
+  if (!vgmBufferCount) return;
+
+  if (SDL_RWwrite(vgmFile, vgmBuffer, 1, vgmBufferCount) != (size_t)vgmBufferCount)
+  {
+    SDL_Log("VGM: write failed: %s\n", SDL_GetError());
+  }
+  vgmBytes += vgmBufferCount;
+  vgmBufferCount = 0;
+}
+
+/* Function:  emit
+ * --------------------
+ * buffer a command of up to three bytes
+ */
+static void emit(uint8_t cmd, int count, uint8_t a, uint8_t b)
+{
+  if (vgmBufferCount + 3 > VGM_BUFFER_SIZE) flushVgm();
+
+  vgmBuffer[vgmBufferCount++] = cmd;
+  if (count > 1) vgmBuffer[vgmBufferCount++] = a;
+  if (count > 2) vgmBuffer[vgmBufferCount++] = b;
+}
+
+/* Function:  emitWait
+ * --------------------
+ * buffer the shortest wait commands for a number of samples
+ */
+static void emitWait(uint64_t samples)
+{
+  while (samples)
+  {
+    if (samples <= 16)
+    {
+      emit((uint8_t)(VGM_CMD_WAIT_SHORT + samples - 1), 1, 0, 0);
+      break;
+    }
+    else if (samples == 735)
+    {
+      emit(VGM_CMD_WAIT_NTSC, 1, 0, 0);
+      break;
+    }
+    else if (samples == 882)
+    {
+      emit(VGM_CMD_WAIT_PAL, 1, 0, 0);
+      break;
+    }
+
+    uint16_t wait = samples > 0xffff ? 0xffff : (uint16_t)samples;
+    emit(VGM_CMD_WAIT, 3, wait & 0xff, wait >> 8);
+    samples -= wait;
+  }
+}
+
+/* Function:  waitUntilNow
+ * --------------------
+ * wait to the current cpu cycle. the wait is the whole number of samples
+ * from the start of the log, so rounding doesn't drift
+ */
+static void waitUntilNow()
+{
+  uint64_t cycle = hbc56CpuCycles();
+  if (cycle < vgmStartCycle) return;
+
+  uint64_t samples = (cycle - vgmStartCycle) * VGM_SAMPLE_RATE / HBC56_CLOCK_FREQ;
+  if (samples > vgmSamples)
+  {
+    emitWait(samples - vgmSamples);
+    vgmSamples = samples;
+  }
+}
+
+/* Function:  putLE32
+ * --------------------
+ * store a little endian 32-bit header value
+ */
+static void putLE32(uint8_t* header, int offset, uint32_t value)
+{
+  header[offset] = value & 0xff;
+  header[offset + 1] = (value >> 8) & 0xff;
+  header[offset + 2] = (value >> 16) & 0xff;
+  header[offset + 3] = (value >> 24) & 0xff;
+}
+
+/* Function:  writeHeader
+ * --------------------
+ * write (or rewrite) the vgm header for the data written so far
+ */
+static void writeHeader()
+{
+  uint8_t header[VGM_HEADER_SIZE];
+  SDL_memset(header, 0, sizeof(header));
+
+  SDL_memcpy(header, "Vgm ", 4);
+  putLE32(header, VGM_EOF_OFFSET, VGM_HEADER_SIZE + vgmBytes - VGM_EOF_OFFSET);
+  putLE32(header, VGM_VERSION_OFFSET, VGM_VERSION);
+  putLE32(header, VGM_TOTAL_SAMPLES, (uint32_t)vgmSamples);
+  putLE32(header, VGM_RATE, 60);
+  putLE32(header, VGM_DATA_OFFSET, VGM_HEADER_SIZE - VGM_DATA_OFFSET);
+  putLE32(header, VGM_AY8910_CLOCK, (uint32_t)vgmClock | (vgmChips > 1 ? VGM_AY8910_DUAL : 0));
+  header[VGM_AY8910_TYPE] = 0x00;             /* AY8910 */
+  header[VGM_AY8910_FLAGS] = 0x01;            /* legacy output */
+
+  SDL_RWseek(vgmFile, 0, RW_SEEK_SET);
+  SDL_RWwrite(vgmFile, header, 1, sizeof(header));
+  SDL_RWseek(vgmFile, 0, RW_SEEK_END);
+}
+
+/* Function:  hbc56VgmLogOpen
+ * --------------------
+ * log every psg register write to a vgm file
+ */
+int hbc56VgmLogOpen(const char* filename, int chips, int chipClock)
+{
+  hbc56VgmLogClose();
+
+  vgmFile = SDL_RWFromFile(filename, "wb");
+  if (!vgmFile)
+  {
+    SDL_Log("VGM: unable to create '%s'\n", filename);
+    return 0;
+  }
+
+  vgmChips = chips > 2 ? 2 : chips;
+  vgmClock = chipClock;
+  vgmBufferCount = 0;
+  vgmBytes = 0;
+  vgmSamples = 0;
+  vgmStartCycle = hbc56CpuCycles();
+  writeHeader();
+
+  if (chips > 2) SDL_Log("VGM: only the first two PSGs are logged\n");
+  SDL_Log("VGM: logging to '%s'\n", filename);
+  return 1;
+}
+
+/* Function:  hbc56VgmLogWrite
+ * --------------------
+ * a psg register has been written (emulation side)
+ */
+void hbc56VgmLogWrite(int chip, uint8_t reg, uint8_t value)
+{
+  if (!vgmFile || chip >= vgmChips) return;
+
+  waitUntilNow();
+  emit(VGM_CMD_AY8910, 3, (uint8_t)((reg & 0x0f) | (chip ? 0x80 : 0x00)), value);
+}
+
+/* Function:  hbc56VgmLogClose
+ * --------------------
+ * flush the log and finish the vgm header
+ */
+void hbc56VgmLogClose()
+{
+  if (!vgmFile) return;
+
+  /* run to the end of the emulation */
+  waitUntilNow();
+  emit(VGM_CMD_END, 1, 0, 0);
+  flushVgm();
+  writeHeader();
+
+  SDL_RWclose(vgmFile);
+  vgmFile = NULL;
+
+  SDL_Log("VGM: %u bytes, %.1f seconds\n", VGM_HEADER_SIZE + vgmBytes, vgmSamples / (double)VGM_SAMPLE_RATE);
+}
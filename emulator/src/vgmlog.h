@@ -0,0 +1,44 @@
+/*
+ * Troy's HBC-56 Emulator - VGM register log
+ *
+ * Copyright (c) 2021 Troy Schrapel
+ *
+ * This code is licensed under the MIT license
+ *
+ * https://github.com/visrealm/hbc-56/emulator
+ *
+ */
+
+#ifndef _HBC56_VGMLOG_H_
+#define _HBC56_VGMLOG_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Function:  hbc56VgmLogOpen
+ * --------------------
+ * log every psg register write to a vgm (1.51) file. up to two
+ * AY-3-8910s of the same clock. returns 1 if ok
+ */
+int hbc56VgmLogOpen(const char* filename, int chips, int chipClock);
+
+/* Function:  hbc56VgmLogWrite
+ * --------------------
+ * a psg register has been written (emulation side). timed by the cpu cycle
+ */
+void hbc56VgmLogWrite(int chip, uint8_t reg, uint8_t value);
+
+/* Function:  hbc56VgmLogClose
+ * --------------------
+ * flush the log and finish the vgm header
+ */
+void hbc56VgmLogClose();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
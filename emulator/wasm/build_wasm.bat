@@ -36,6 +36,14 @@ emcc -o hbc56.html ^
   ..\src\devices\keyboard_device.c ^
   ..\src\devices\lcd_device.c ^
   ..\src\devices\ay38910_device.c ^
+  ..\src\devices\ay38910_synth.c ^
+  ..\src\snapshot.c ^
+  ..\src\sharedmem.c ^
+  ..\src\filewatch.c ^
+  ..\src\framecheck.c ^
+  ..\src\mixer.c ^
+  ..\src\audiocapture.c ^
+  ..\src\vgmlog.c ^
   ..\src\debugger\debugger.cpp ^
   ..\modules\ay38910\emu2149.c ^
   ..\modules\65c02\src\vrEmu6502.c ^
@@ -52,5 +60,5 @@ emcc -o hbc56.html ^
   --preload-file "rom.bin.lmap" ^
   --preload-file "rom.bin.rpt" ^
   --preload-file "imgui.ini" ^
-  -s EXPORTED_FUNCTIONS="['_hbc56Audio','_hbc56Reset','_hbc56LoadRom','_hbc56LoadLabels','_hbc56LoadSource','_hbc56LoadLayout','_hbc56GetLayout','_hbc56PasteText','_hbc56ToggleDebugger','_hbc56DebugBreak','_hbc56DebugBreakOnInt','_hbc56DebugRun','_hbc56DebugStepInto','_hbc56DebugStepOver','_hbc56DebugStepOut','_main']" ^
+  -s EXPORTED_FUNCTIONS="['_hbc56Audio','_hbc56Reset','_hbc56LoadRom','_hbc56LoadLabels','_hbc56LoadSource','_hbc56LoadLayout','_hbc56GetLayout','_hbc56PasteText','_hbc56LoadBinary','_hbc56LoadHex','_hbc56Exec','_hbc56ToggleDebugger','_hbc56DebugBreak','_hbc56DebugBreakOnInt','_hbc56DebugRun','_hbc56DebugStepInto','_hbc56DebugStepOver','_hbc56DebugStepOut','_main']" ^
   -s EXPORTED_RUNTIME_METHODS="['ccall','cwrap']"
\ No newline at end of file